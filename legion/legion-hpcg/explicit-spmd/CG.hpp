@@ -60,6 +60,7 @@
 #include "ComputeWAXPBY.hpp"
 #include "ComputeDotProduct.hpp"
 #include "ComputeMG.hpp"
+#include "ComputeFusedCG.hpp"
 #include "FutureMath.hpp"
 
 #include <fstream>
@@ -105,6 +106,13 @@
     @param[in]    doPreconditioning The flag to indicate whether the
                   preconditioner should be invoked at each iteration.
 
+    @param[in]    checkFreq The residual norm is only waited on (and
+                  convergence tested) every checkFreq iterations and after the
+                  last one. In between, the iteration runs ahead on futures.
+
+    If A.isTraced, the preconditioner and the rest of every iteration past the
+    first are issued as runtime traces (see BeginSolverTrace).
+
     @return Returns zero on success and a non-zero value otherwise.
 
     @see CG()
@@ -123,7 +131,8 @@ CG(
     double           *times,
     bool             doPreconditioning,
     Context          ctx,
-    Runtime          *lrt
+    Runtime          *lrt,
+    int              checkFreq = 1
 ) {
     using namespace std;
     // Start timing right away.
@@ -134,7 +143,8 @@ CG(
     const local_int_t nrow = A.sclrs->data()->localNumberOfRows;
     //
     Future normrFuture, pApFuture, rtzFuture, oldrtzFuture;
-    floatType alpha = 0.0, beta = 0.0;
+    // Step lengths stay futures: they are handed to the tasks that use them.
+    Future alphaFuture, betaFuture;
     double t0 = 0.0, t1 = 0.0, t2 = 0.0, t3 = 0.0, t4 = 0.0, t5 = 0.0, t6 = 0.0;
     //
     normr = 0.0;
@@ -184,28 +194,31 @@ CG(
         }
         TOCK(t5); // Preconditioner apply time.
         //
+        // From here on, iterations past the first issue identical launches.
+        Legion::TraceID tid = 0;
         if (k == 1) {
-            TICK(); // Copy Mr to p.
-            ComputeWAXPBY(nrow, 1.0, z, 0.0, z, p, ctx, lrt);
+            TICK(); // Copy Mr to p and rtz = r' * z in one pass.
+            ComputePUpdate(
+                nrow, 0.0, r, z, p, rtzFuture, t4, dcarsFT, ctx, lrt
+            );
             TOCK(t2);
-            //
-            TICK(); // rtz = r' * z
-            ComputeDotProduct(nrow, r, z, rtzFuture, t4, dcarsFT, ctx, lrt);
-            TOCK(t1);
         }
         else {
+            tid = BeginSolverTrace(
+                A, SOLVER_TRACE_CG_ITERATION, x, r, ctx, lrt
+            );
             oldrtzFuture = rtzFuture;
             //
             TICK(); // rtz = r' * z
             ComputeDotProduct(nrow, r, z, rtzFuture, t4, dcarsFT, ctx, lrt);
             TOCK(t1);
             //
-            beta = ComputeFuture(
-                       &rtzFuture, FMO_DIV, &oldrtzFuture, ctx, lrt
-                   ).get_result<floatType>(silenceWarnings);
+            betaFuture = ComputeFuture(
+                             &rtzFuture, FMO_DIV, &oldrtzFuture, ctx, lrt
+                         );
             //
             TICK(); // p = beta * p + z
-            ComputeWAXPBY(nrow, 1.0, z, beta, p, p, ctx, lrt);
+            ComputeWAXPBY(nrow, 1.0, z, betaFuture, p, p, ctx, lrt);
             TOCK(t2);
         }
         TICK(); // Ap = A * p
@@ -216,19 +229,20 @@ CG(
         ComputeDotProduct(nrow, p, Ap, pApFuture, t4, dcarsFT, ctx, lrt);
         TOCK(t1);
         //
-        alpha = ComputeFuture(
-                    &rtzFuture, FMO_DIV, &pApFuture, ctx, lrt
-                ).get_result<floatType>(silenceWarnings);
+        alphaFuture = ComputeFuture(
+                          &rtzFuture, FMO_DIV, &pApFuture, ctx, lrt
+                      );
         //
-        TICK(); // x = x + alpha * p
-        ComputeWAXPBY(nrow, 1.0, x, alpha, p, x, ctx, lrt);
-        // r = r - alpha * Ap
-        ComputeWAXPBY(nrow, 1.0, r, -alpha, Ap, r, ctx, lrt);
+        TICK(); // x = x + alpha * p, r = r - alpha * Ap, and r' * r.
+        ComputeXRUpdate(
+            nrow, alphaFuture, p, Ap, x, r, normrFuture, t4, dcarsFT, ctx, lrt
+        );
         TOCK(t2);
+        EndSolverTrace(tid, ctx, lrt);
         //
-        TICK();
-        ComputeDotProduct(nrow, r, r, normrFuture, t4, dcarsFT, ctx, lrt);
-        TOCK(t1);
+        niters = k;
+        // Only block on the residual norm when it is needed.
+        if (k % checkFreq != 0 && k != maxIter) continue;
         //
         normr = ComputeFuture(
                     &normrFuture, FMO_SQRT, NULL, ctx, lrt
@@ -238,10 +252,7 @@ CG(
             cout << "Iteration = "<< k << "   Scaled Residual = "
                  << normr / normr0 << std::endl;
         }
-        //
-        niters = k;
   }
-    // TODO pass future to WAXPBY instead of future result.
     // Store times.
     times[1] += t1; // Dot product time.
     times[2] += t2; // WAXPBY time.
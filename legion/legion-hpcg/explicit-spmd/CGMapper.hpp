@@ -0,0 +1,305 @@
+/**
+ * Copyright (c)      2017 Los Alamos National Security, LLC
+ *                         All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LA-CC 10-123
+ */
+
+
+/*!
+    @file CGMapper.hpp
+
+    Mapper for the explicit-SPMD tasks.
+ */
+
+#pragma once
+
+#include "TaskTIDs.hpp"
+
+#include "legion.h"
+#include "default_mapper.h"
+
+#include <cassert>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+
+/**
+ * Returns all CPUs ordered by (address space, ID). Query order is unspecified,
+ * so this makes it the same on every node and in every run. Shard i runs on
+ * the i-th one.
+ */
+inline std::vector<Legion::Processor>
+getShardProcs(
+    Legion::Machine machine
+) {
+    using namespace Legion;
+    //
+    std::vector<Processor> procs;
+    Machine::ProcessorQuery query(machine);
+    query.only_kind(Processor::LOC_PROC);
+    for (auto it = query.begin(); it != query.end(); ++it) {
+        procs.push_back(*it);
+    }
+    std::sort(
+        procs.begin(), procs.end(),
+        [](const Processor &a, const Processor &b) {
+            if (a.address_space() != b.address_space()) {
+                return a.address_space() < b.address_space();
+            }
+            return a.id < b.id;
+        }
+    );
+    return procs;
+}
+
+/**
+ * Returns the address space (node) each of nShards shards runs in.
+ */
+inline std::vector<unsigned>
+getShardAddressSpaces(
+    size_t nShards
+) {
+    const auto procs = getShardProcs(Legion::Machine::get_machine());
+    assert(!procs.empty());
+    std::vector<unsigned> spaces(nShards);
+    for (size_t i = 0; i < nShards; ++i) {
+        spaces[i] = procs[i % procs.size()].address_space();
+    }
+    return spaces;
+}
+
+/**
+ * Pins shard i (its GEN_PROB_TID, WIRE_SYNCHRONIZERS_TID and
+ * START_BENCHMARK_TID tasks) to the i-th CPU in a fixed machine-wide order,
+ * keeps every task a shard launches on the shard's processor, and places
+ * instances in the NUMA-local (socket) memory of the processor they are mapped
+ * for. Falls back to system memory when Realm was not started with NUMA
+ * memories (-ll:nsize).
+ */
+class CGMapper : public Legion::Mapping::DefaultMapper {
+protected:
+    // All CPUs, ordered by (address space, ID).
+    std::vector<Legion::Processor> shardProcs;
+    // Memoized NUMA-local memory of each processor.
+    std::map<Legion::Processor, Legion::Memory> localMems;
+
+public:
+    /**
+     *
+     */
+    CGMapper(
+        Legion::Mapping::MapperRuntime *rt,
+        Legion::Machine machine,
+        Legion::Processor local
+    ) : DefaultMapper(rt, machine, local, "CGMapper")
+      , shardProcs(getShardProcs(machine)) { }
+
+    /**
+     *
+     */
+    virtual ~CGMapper(void) { }
+
+    /**
+     * Shards go to their own CPU. Everything they launch (leaf kernels, copies,
+     * reductions, future math) stays on the launching processor, so the data it
+     * touches was first-touched and mapped on the same socket.
+     */
+    virtual Legion::Processor
+    default_policy_select_initial_processor(
+        Legion::Mapping::MapperContext ctx,
+        const Legion::Task &task
+    ) {
+        switch (task.task_id) {
+            case MAIN_TID:
+                return DefaultMapper::default_policy_select_initial_processor(
+                    ctx, task
+                );
+            case GEN_PROB_TID:
+            case WIRE_SYNCHRONIZERS_TID:
+            case START_BENCHMARK_TID: {
+                assert(!shardProcs.empty());
+                const size_t shard = task.index_point.point_data[0];
+                return shardProcs[shard % shardProcs.size()];
+            }
+            // Node-level collectives are created on the node of the shard
+            // named by the tag, so that node's arrivals stay local.
+            case CREATE_NODE_COLLECTIVE_TID:
+                assert(!shardProcs.empty());
+                return shardProcs[task.tag % shardProcs.size()];
+            default:
+                return task.orig_proc;
+        }
+    }
+
+    /**
+     *
+     */
+    virtual void
+    select_task_options(
+        const Legion::Mapping::MapperContext ctx,
+        const Legion::Task &task,
+        TaskOptions &output
+    ) {
+        DefaultMapper::select_task_options(ctx, task, output);
+        // Never let placement drift between runs.
+        output.stealable = false;
+        // All shard-launched tasks run where they are launched, so there is
+        // no reason to ship them elsewhere to be mapped.
+        output.map_locally = true;
+    }
+
+    /**
+     * Must-epoch launches (the shards) follow the same order as
+     * default_policy_select_initial_processor: shard i on the i-th CPU. Every
+     * shard needs a CPU of its own.
+     */
+    virtual void
+    default_policy_select_must_epoch_processors(
+        Legion::Mapping::MapperContext,
+        const std::vector< std::set<const Legion::Task *> > &tasks,
+        Legion::Processor::Kind,
+        std::map<const Legion::Task *, Legion::Processor> &targetProcs
+    ) {
+        for (const auto &taskSet : tasks) {
+            for (const auto *task : taskSet) {
+                const size_t shard = task->index_point.point_data[0];
+                assert(shard < shardProcs.size() &&
+                       "More shards than CPUs in must-epoch launch.");
+                targetProcs[task] = shardProcs[shard];
+            }
+        }
+    }
+
+    /**
+     * Point i of the (index-launched) wireSynchronizersTask runs on shard i's
+     * CPU, like the shard tasks.
+     */
+    virtual void
+    slice_task(
+        const Legion::Mapping::MapperContext ctx,
+        const Legion::Task &task,
+        const SliceTaskInput &input,
+        SliceTaskOutput &output
+    ) {
+        if (task.task_id != WIRE_SYNCHRONIZERS_TID) {
+            DefaultMapper::slice_task(ctx, task, input, output);
+            return;
+        }
+        assert(!shardProcs.empty());
+        const LegionRuntime::Arrays::Rect<1> rect =
+            input.domain.get_rect<1>();
+        for (auto i = rect.lo.x[0]; i <= rect.hi.x[0]; ++i) {
+            const LegionRuntime::Arrays::Rect<1> pointRect(
+                (LegionRuntime::Arrays::Point<1>(i)),
+                (LegionRuntime::Arrays::Point<1>(i))
+            );
+            TaskSlice slice;
+            slice.domain = Legion::Domain::from_rect<1>(pointRect);
+            slice.proc = shardProcs[i % shardProcs.size()];
+            slice.recurse = false;
+            slice.stealable = false;
+            output.slices.push_back(slice);
+        }
+    }
+
+    /**
+     * Only ever target the selected processor.
+     */
+    virtual void
+    default_policy_select_target_processors(
+        Legion::Mapping::MapperContext,
+        const Legion::Task &task,
+        std::vector<Legion::Processor> &targetProcs
+    ) {
+        targetProcs.clear();
+        targetProcs.push_back(task.target_proc);
+    }
+
+    /**
+     * Region-less tasks (future math, collective contributions, and
+     * reductions) are issued every CG iteration and need no instances, so skip
+     * the default mapper's instance selection for them. They are not inlined,
+     * since most wait on futures and would stall the shard.
+     */
+    virtual void
+    map_task(
+        const Legion::Mapping::MapperContext ctx,
+        const Legion::Task &task,
+        const MapTaskInput &input,
+        MapTaskOutput &output
+    ) {
+        if (!task.regions.empty()) {
+            DefaultMapper::map_task(ctx, task, input, output);
+            return;
+        }
+        output.chosen_variant = default_find_preferred_variant(
+            task, ctx, true /* needs tight bound */
+        ).variant;
+        output.target_procs.push_back(task.target_proc);
+    }
+
+    /**
+     * Shard-private vectors, matrices, ghost regions, and pull buffers are all
+     * mapped by (or for) their owning shard, so they land in its socket's
+     * memory. Neighbors only read pull buffers, once per exchange.
+     */
+    virtual Legion::Memory
+    default_policy_select_target_memory(
+        Legion::Mapping::MapperContext,
+        Legion::Processor targetProc,
+        const Legion::RegionRequirement &
+    ) {
+        return getLocalMemory(targetProc);
+    }
+
+protected:
+    /**
+     *
+     */
+    Legion::Memory
+    getLocalMemory(
+        Legion::Processor proc
+    ) {
+        using namespace Legion;
+        //
+        auto found = localMems.find(proc);
+        if (found != localMems.end()) return found->second;
+        //
+        Machine::MemoryQuery sockMems(machine);
+        sockMems.only_kind(Memory::SOCKET_MEM).has_affinity_to(proc);
+        Memory mem = sockMems.first();
+        if (!mem.exists()) {
+            Machine::MemoryQuery sysMems(machine);
+            sysMems.only_kind(Memory::SYSTEM_MEM).has_affinity_to(proc);
+            mem = sysMems.first();
+        }
+        assert(mem.exists());
+        localMems[proc] = mem;
+        //
+        return mem;
+    }
+};
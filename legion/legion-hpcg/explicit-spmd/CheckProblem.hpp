@@ -92,15 +92,12 @@ CheckProblem(
     const global_int_t nx =  Ageom->nx;
     const global_int_t ny =  Ageom->ny;
     const global_int_t nz =  Ageom->nz;
-    const global_int_t npx = Ageom->npx;
-    const global_int_t npy = Ageom->npy;
-    const global_int_t npz = Ageom->npz;
-    const global_int_t ipx = Ageom->ipx;
-    const global_int_t ipy = Ageom->ipy;
-    const global_int_t ipz = Ageom->ipz;
-    const global_int_t gnx = nx * npx;
-    const global_int_t gny = ny * npy;
-    const global_int_t gnz = nz * npz;
+    const global_int_t gnx = Ageom->gnx;
+    const global_int_t gny = Ageom->gny;
+    const global_int_t gnz = Ageom->gnz;
+    const global_int_t gix0 = Ageom->gix0;
+    const global_int_t giy0 = Ageom->giy0;
+    const global_int_t giz0 = Ageom->giz0;
 
     // This is the size of our subblock.
     local_int_t localNumberOfRows = nx * ny * nz;
@@ -139,11 +136,11 @@ CheckProblem(
     global_int_t localNumberOfNonzeros = 0;
     //
     for (local_int_t iz = 0; iz < nz; iz++) {
-        global_int_t giz = ipz * nz + iz;
+        global_int_t giz = giz0 + iz;
         for (local_int_t iy = 0; iy < ny; iy++) {
-            global_int_t giy = ipy * ny + iy;
+            global_int_t giy = giy0 + iy;
             for (local_int_t ix = 0; ix < nx; ix++) {
-                global_int_t gix = ipx * nx + ix;
+                global_int_t gix = gix0 + ix;
                 local_int_t currentLocalRow = iz * nx * ny + iy * nx + ix;
                 global_int_t currentGlobalRow = giz * gnx * gny + giy * gnx + gix;
                 assert(AlocalToGlobalMap[currentLocalRow] == currentGlobalRow);
@@ -0,0 +1,558 @@
+/**
+ * Copyright (c)      2017 Los Alamos National Security, LLC
+ *                         All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LA-CC 10-123
+ */
+
+
+/*!
+    @file Checkpoint.hpp
+
+    Per-shard binary checkpoints of the set-up problem hierarchy.
+ */
+
+#pragma once
+
+#include "hpcg.hpp"
+#include "LegionStuff.hpp"
+#include "LegionArrays.hpp"
+#include "LegionMatrices.hpp"
+#include "CollectiveOps.hpp"
+#include "SetupHalo.hpp"
+
+#include "mytimer.hpp"
+
+#include <string>
+#include <cassert>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LGNCG_CHECKPOINT_MAGIC "LGNCGCKP"
+#define LGNCG_CHECKPOINT_VERSION 1
+// Sections start on page boundaries, so each one can be mapped by itself.
+#define LGNCG_CHECKPOINT_ALIGN 4096
+
+/**
+ * Start of a checkpoint file, followed by nSections CheckpointSectionEntry.
+ */
+struct CheckpointHeader {
+    char magic[8];
+    int version;
+    int rank;
+    int size;
+    int nLevels;
+    // Type sizes of the build that wrote the file.
+    int floatTypeSize;
+    int localIntSize;
+    int globalIntSize;
+    int nSections;
+};
+
+/**
+ *
+ */
+struct CheckpointSectionEntry {
+    char name[32];
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+/**
+ * A named block of shard-local memory that is saved or restored verbatim.
+ */
+struct CheckpointSection {
+    std::string name;
+    void *data;
+    size_t bytes;
+};
+
+/**
+ *
+ */
+inline std::string
+CheckpointFileName(
+    const char *dir,
+    int rank
+) {
+    return std::string(dir) + "/hpcg-shard-" + std::to_string(rank) + ".ckpt";
+}
+
+/**
+ *
+ */
+template <typename TYPE>
+inline void
+AddCheckpointSection(
+    std::vector<CheckpointSection> &sections,
+    const std::string &name,
+    Array<TYPE> *a
+) {
+    sections.push_back({name, a->data(), a->length() * sizeof(TYPE)});
+}
+
+/**
+ *
+ */
+template <typename TYPE>
+inline void
+AddCheckpointSection(
+    std::vector<CheckpointSection> &sections,
+    const std::string &name,
+    Item<TYPE> *item
+) {
+    sections.push_back({name, item->data(), sizeof(TYPE)});
+}
+
+/**
+ * The region contents written by genProblemTask on every level, and b, x, and
+ * xexact.
+ */
+inline void
+ProblemCheckpointSections(
+    SparseMatrix &A,
+    Array<floatType> &b,
+    Array<floatType> &x,
+    Array<floatType> &xexact,
+    std::vector<CheckpointSection> &sections
+) {
+    int level = 0;
+    for (SparseMatrix *Al = &A; Al; Al = Al->Ac, ++level) {
+        const std::string l = "L" + std::to_string(level) + ".";
+        auto &s = sections;
+        AddCheckpointSection(s, l + "geom", Al->geom);
+        AddCheckpointSection(s, l + "sclrs", Al->sclrs);
+        AddCheckpointSection(s, l + "nonzerosInRow", Al->nonzerosInRow);
+        AddCheckpointSection(s, l + "mtxIndG", Al->mtxIndG);
+        AddCheckpointSection(s, l + "matrixValues", Al->matrixValues);
+        AddCheckpointSection(s, l + "matrixDiagonal", Al->matrixDiagonal);
+        AddCheckpointSection(s, l + "localToGlobalMap", Al->localToGlobalMap);
+        AddCheckpointSection(s, l + "neighbors", Al->neighbors);
+        AddCheckpointSection(s, l + "sendLength", Al->sendLength);
+        AddCheckpointSection(s, l + "recvLength", Al->recvLength);
+        AddCheckpointSection(s, l + "mid2rc", Al->matdIdxToMatRowCol);
+    }
+    AddCheckpointSection(sections, "b",      &b);
+    AddCheckpointSection(sections, "x",      &x);
+    AddCheckpointSection(sections, "xexact", &xexact);
+}
+
+/**
+ * What SetupHalo adds on every level: the local column indices and the send
+ * list. Only valid after SetupHalo.
+ */
+inline void
+HaloCheckpointSections(
+    SparseMatrix &A,
+    std::vector<CheckpointSection> &sections
+) {
+    int level = 0;
+    for (SparseMatrix *Al = &A; Al; Al = Al->Ac, ++level) {
+        const std::string l = "L" + std::to_string(level) + ".";
+        auto &s = sections;
+        AddCheckpointSection(s, l + "mtxIndL", Al->mtxIndL);
+        AddCheckpointSection(s, l + "elementsToSend", Al->elementsToSend);
+    }
+}
+
+/**
+ * True if a and b describe the same shard of the same problem. The thread
+ * count is a run option and is not compared.
+ */
+inline bool
+SameProblemGeometry(
+    const Geometry &a,
+    const Geometry &b
+) {
+    return a.size == b.size && a.rank == b.rank
+        && a.nx == b.nx && a.ny == b.ny && a.nz == b.nz
+        && a.npx == b.npx && a.npy == b.npy && a.npz == b.npz
+        && a.stencilSize == b.stencilSize
+        && a.ipx == b.ipx && a.ipy == b.ipy && a.ipz == b.ipz
+        && a.gnx == b.gnx && a.gny == b.gny && a.gnz == b.gnz
+        && a.gix0 == b.gix0 && a.giy0 == b.giy0 && a.giz0 == b.giz0;
+}
+
+/**
+ * Writes sections to fileName after a CheckpointHeader and the section table.
+ *
+ * @return 0 on success and non-zero otherwise.
+ */
+inline int
+WriteCheckpoint(
+    const std::string &fileName,
+    const Geometry &geom,
+    const std::vector<CheckpointSection> &sections
+) {
+    CheckpointHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, LGNCG_CHECKPOINT_MAGIC, sizeof(hdr.magic));
+    hdr.version = LGNCG_CHECKPOINT_VERSION;
+    hdr.rank = geom.rank;
+    hdr.size = geom.size;
+    hdr.nLevels = NUM_MG_LEVELS;
+    hdr.floatTypeSize = sizeof(floatType);
+    hdr.localIntSize = sizeof(local_int_t);
+    hdr.globalIntSize = sizeof(global_int_t);
+    hdr.nSections = int(sections.size());
+    //
+    auto align = [](uint64_t o) {
+        return (o + LGNCG_CHECKPOINT_ALIGN - 1)
+             / LGNCG_CHECKPOINT_ALIGN * LGNCG_CHECKPOINT_ALIGN;
+    };
+    std::vector<CheckpointSectionEntry> table(sections.size());
+    uint64_t offset = align(
+        sizeof(hdr) + sections.size() * sizeof(CheckpointSectionEntry)
+    );
+    for (size_t i = 0; i < sections.size(); ++i) {
+        memset(&table[i], 0, sizeof(table[i]));
+        assert(sections[i].name.size() < sizeof(table[i].name));
+        strncpy(table[i].name, sections[i].name.c_str(),
+                sizeof(table[i].name) - 1);
+        table[i].offset = offset;
+        table[i].bytes = sections[i].bytes;
+        offset = align(offset + sections[i].bytes);
+    }
+    //
+    FILE *f = fopen(fileName.c_str(), "wb");
+    if (!f) return 1;
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    if (!table.empty()) {
+        ok = ok && fwrite(&table[0], sizeof(table[0]), table.size(), f)
+                   == table.size();
+    }
+    for (size_t i = 0; ok && i < sections.size(); ++i) {
+        if (sections[i].bytes == 0) continue;
+        ok = fseek(f, long(table[i].offset), SEEK_SET) == 0
+          && fwrite(sections[i].data, 1, sections[i].bytes, f)
+             == sections[i].bytes;
+    }
+    ok = (fclose(f) == 0) && ok;
+    //
+    return ok ? 0 : 1;
+}
+
+/**
+ * A read-only mapping of a checkpoint file.
+ */
+class CheckpointReader {
+    void *mBase = nullptr;
+    //
+    size_t mSize = 0;
+
+    /**
+     *
+     */
+    const CheckpointHeader *
+    mHeader(void) const { return (const CheckpointHeader *)mBase; }
+
+    /**
+     *
+     */
+    const CheckpointSectionEntry *
+    mTable(void) const {
+        return (const CheckpointSectionEntry *)(mHeader() + 1);
+    }
+
+public:
+    /**
+     *
+     */
+    CheckpointReader(void) = default;
+
+    /**
+     *
+     */
+    ~CheckpointReader(void) { close(); }
+
+    /**
+     * Maps fileName and checks that it was written for this shard by a build
+     * with the same types and number of MG levels.
+     *
+     * @return 0 on success and non-zero otherwise.
+     */
+    int
+    open(
+        const std::string &fileName,
+        const Geometry &geom
+    ) {
+        close();
+        //
+        const int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) return 1;
+        struct stat st;
+        if (fstat(fd, &st) != 0
+            || size_t(st.st_size) < sizeof(CheckpointHeader)) {
+            ::close(fd);
+            return 1;
+        }
+        mSize = size_t(st.st_size);
+        mBase = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mBase == MAP_FAILED) {
+            mBase = nullptr;
+            return 1;
+        }
+        // Sections are copied out front to back.
+        madvise(mBase, mSize, MADV_SEQUENTIAL);
+        //
+        const CheckpointHeader &hdr = *mHeader();
+        const bool ok = memcmp(hdr.magic, LGNCG_CHECKPOINT_MAGIC,
+                               sizeof(hdr.magic)) == 0
+                     && hdr.version == LGNCG_CHECKPOINT_VERSION
+                     && hdr.rank == geom.rank
+                     && hdr.size == geom.size
+                     && hdr.nLevels == NUM_MG_LEVELS
+                     && hdr.floatTypeSize == int(sizeof(floatType))
+                     && hdr.localIntSize == int(sizeof(local_int_t))
+                     && hdr.globalIntSize == int(sizeof(global_int_t))
+                     && hdr.nSections >= 0
+                     && sizeof(hdr) + size_t(hdr.nSections)
+                        * sizeof(CheckpointSectionEntry) <= mSize;
+        if (!ok) {
+            close();
+            return 1;
+        }
+        // The stored geometry of the finest level must be ours.
+        Geometry stored;
+        const void *g = find("L0.geom", sizeof(Geometry));
+        if (!g) {
+            close();
+            return 1;
+        }
+        memcpy(&stored, g, sizeof(stored));
+        if (!SameProblemGeometry(stored, geom)) {
+            close();
+            return 1;
+        }
+        //
+        return 0;
+    }
+
+    /**
+     * Returns the contents of section name, or nullptr if there is no such
+     * section of the given size.
+     */
+    const void *
+    find(
+        const std::string &name,
+        size_t bytes
+    ) const {
+        if (!mBase) return nullptr;
+        const CheckpointSectionEntry *const table = mTable();
+        for (int i = 0; i < mHeader()->nSections; ++i) {
+            if (strncmp(table[i].name, name.c_str(), sizeof(table[i].name))) {
+                continue;
+            }
+            if (table[i].bytes != bytes
+                || table[i].offset + table[i].bytes > mSize) return nullptr;
+            return (const char *)mBase + table[i].offset;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @return 0 if every section is present with the expected size.
+     */
+    int
+    check(
+        const std::vector<CheckpointSection> &sections
+    ) const {
+        for (const auto &s : sections) {
+            if (!find(s.name, s.bytes)) return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * Copies every section into place. Must follow a successful check().
+     */
+    void
+    copyTo(
+        const std::vector<CheckpointSection> &sections
+    ) const {
+        for (const auto &s : sections) {
+            if (s.bytes == 0) continue;
+            memcpy(s.data, find(s.name, s.bytes), s.bytes);
+        }
+    }
+
+    /**
+     *
+     */
+    void
+    close(void) {
+        if (mBase) munmap(mBase, mSize);
+        mBase = nullptr;
+        mSize = 0;
+    }
+};
+
+/**
+ * Returns true if ok holds on every shard. Collective over the shards of A.
+ */
+inline bool
+AllShardsAgree(
+    bool ok,
+    SparseMatrix &A,
+    Context ctx,
+    Runtime *lrt
+) {
+    Future f = Future::from_value(lrt, global_int_t(ok ? 0 : 1));
+    return allReduce(
+               f, *A.dcAllRedSumGI, ctx, lrt
+           ).get_result<global_int_t>(silenceWarnings) == 0;
+}
+
+/*!
+    Writes the problem of this shard, as set up by genProblemTask and
+    SetupHalo, to CheckpointFileName(dir, rank). Must be called before
+    OptimizeProblem reorders the rows.
+
+    @return 0 on success and non-zero otherwise.
+*/
+inline int
+SaveProblemCheckpoint(
+    const char *dir,
+    SparseMatrix &A,
+    Array<floatType> &b,
+    Array<floatType> &x,
+    Array<floatType> &xexact
+) {
+    const Geometry &geom = *A.geom->data();
+    //
+    std::vector<CheckpointSection> sections;
+    ProblemCheckpointSections(A, b, x, xexact, sections);
+    HaloCheckpointSections(A, sections);
+    //
+    return WriteCheckpoint(CheckpointFileName(dir, geom.rank), geom, sections);
+}
+
+/*!
+    Replaces GenerateProblem, GetNeighborInfo, and GenerateCoarseProblem in
+    genProblemTask: copies every level of this shard's problem out of its
+    checkpoint. A.geom must hold the generated geometry of the finest level.
+    Collective: the problem is only loaded if every shard's checkpoint matches
+    (generation issues collectives, so either all shards load or none does).
+
+    @return 0 if the problem was loaded and non-zero otherwise.
+*/
+inline int
+LoadProblemCheckpoint(
+    const char *dir,
+    SparseMatrix &A,
+    Array<floatType> &b,
+    Array<floatType> &x,
+    Array<floatType> &xexact,
+    Context ctx,
+    Runtime *lrt
+) {
+    const Geometry geom = *A.geom->data();
+    //
+    std::vector<CheckpointSection> sections;
+    ProblemCheckpointSections(A, b, x, xexact, sections);
+    //
+    CheckpointReader reader;
+    int rc = reader.open(CheckpointFileName(dir, geom.rank), geom);
+    if (rc == 0) rc = reader.check(sections);
+    if (!AllShardsAgree(rc == 0, A, ctx, lrt)) return 1;
+    //
+    reader.copyTo(sections);
+    // Thread counts come from this run's options.
+    for (SparseMatrix *Al = &A; Al; Al = Al->Ac) {
+        Al->geom->data()->numThreads = geom.numThreads;
+    }
+    //
+    return 0;
+}
+
+/*!
+    Replaces SetupHalo on every level in startBenchmarkTask: copies the local
+    column indices and send lists out of this shard's checkpoint and rebuilds
+    the (cheap) global-to-local map and interior/boundary row split.
+    Collective, like LoadProblemCheckpoint.
+
+    @param[out] levelTimes Time spent on each level.
+
+    @return 0 if the halo setup was loaded and non-zero otherwise.
+*/
+inline int
+LoadHaloCheckpoint(
+    const char *dir,
+    SparseMatrix &A,
+    std::vector<double> &levelTimes,
+    Context ctx,
+    Runtime *lrt
+) {
+    const Geometry &geom = *A.geom->data();
+    //
+    CheckpointReader reader;
+    int rc = reader.open(CheckpointFileName(dir, geom.rank), geom);
+    int level = 0;
+    for (SparseMatrix *Al = &A; rc == 0 && Al; Al = Al->Ac, ++level) {
+        const std::string l = "L" + std::to_string(level) + ".";
+        const size_t sendBytes = Al->sclrs->data()->totalToBeSent
+                               * sizeof(local_int_t);
+        if (!reader.find(l + "mtxIndL",
+                         Al->mtxIndL->length() * sizeof(local_int_t))
+            || !reader.find(l + "elementsToSend", sendBytes)) rc = 1;
+    }
+    if (!AllShardsAgree(rc == 0, A, ctx, lrt)) return 1;
+    //
+    level = 0;
+    for (SparseMatrix *Al = &A; Al; Al = Al->Ac, ++level) {
+        const double start = mytimer();
+        const std::string l = "L" + std::to_string(level) + ".";
+        //
+        PopulateGlobalToLocalMap(*Al, ctx, lrt);
+        //
+        Al->lElementsToSend.allocate(
+            "elementsToSend", Al->sclrs->data()->totalToBeSent, ctx, lrt
+        );
+        Al->elementsToSend = new Array<local_int_t>(
+            Al->lElementsToSend.mapRegion(RW_E, ctx, lrt), ctx, lrt
+        );
+        //
+        std::vector<CheckpointSection> sections;
+        AddCheckpointSection(sections, l + "mtxIndL", Al->mtxIndL);
+        AddCheckpointSection(
+            sections, l + "elementsToSend", Al->elementsToSend
+        );
+        reader.copyTo(sections);
+        //
+        ClassifyHaloRows(*Al, ctx, lrt);
+        //
+        levelTimes[level] = mytimer() - start;
+    }
+    //
+    return 0;
+}
@@ -156,6 +156,99 @@ IntReduceSumAccumulate::fold<false>(RHS &rhs1, RHS rhs2) {
 /**
  *
  */
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+const FloatSums FloatSumsReduceSumAccumulate::identity = {{0.0}};
+
+template<>
+void
+FloatSumsReduceSumAccumulate::apply<true>(LHS &lhs, RHS rhs) {
+    for (int i = 0; i < LGNCG_MAX_SUMS; ++i) lhs.v[i] += rhs.v[i];
+}
+
+template<>
+void
+FloatSumsReduceSumAccumulate::apply<false>(LHS &lhs, RHS rhs) {
+    exit(1);
+}
+
+template<>
+void
+FloatSumsReduceSumAccumulate::fold<true>(RHS &rhs1, RHS rhs2) {
+    for (int i = 0; i < LGNCG_MAX_SUMS; ++i) rhs1.v[i] += rhs2.v[i];
+}
+
+template<>
+void
+FloatSumsReduceSumAccumulate::fold<false>(RHS &rhs1, RHS rhs2) {
+    exit(1);
+}
+
+/**
+ *
+ */
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+const CoarseVector CoarseVectorReduceSumAccumulate::identity = {{0.0}};
+
+template<>
+void
+CoarseVectorReduceSumAccumulate::apply<true>(LHS &lhs, RHS rhs) {
+    for (int i = 0; i < LGNCG_MAX_AGGLOMERATED_ROWS; ++i) lhs.v[i] += rhs.v[i];
+}
+
+template<>
+void
+CoarseVectorReduceSumAccumulate::apply<false>(LHS &lhs, RHS rhs) {
+    exit(1);
+}
+
+template<>
+void
+CoarseVectorReduceSumAccumulate::fold<true>(RHS &rhs1, RHS rhs2) {
+    for (int i = 0; i < LGNCG_MAX_AGGLOMERATED_ROWS; ++i) rhs1.v[i] += rhs2.v[i];
+}
+
+template<>
+void
+CoarseVectorReduceSumAccumulate::fold<false>(RHS &rhs1, RHS rhs2) {
+    exit(1);
+}
+
+/**
+ *
+ */
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+const GramSums GramSumsReduceSumAccumulate::identity = {{0.0}};
+
+template<>
+void
+GramSumsReduceSumAccumulate::apply<true>(LHS &lhs, RHS rhs) {
+    for (int i = 0; i < LGNCG_MAX_GRAM_SUMS; ++i) lhs.v[i] += rhs.v[i];
+}
+
+template<>
+void
+GramSumsReduceSumAccumulate::apply<false>(LHS &lhs, RHS rhs) {
+    exit(1);
+}
+
+template<>
+void
+GramSumsReduceSumAccumulate::fold<true>(RHS &rhs1, RHS rhs2) {
+    for (int i = 0; i < LGNCG_MAX_GRAM_SUMS; ++i) rhs1.v[i] += rhs2.v[i];
+}
+
+template<>
+void
+GramSumsReduceSumAccumulate::fold<false>(RHS &rhs1, RHS rhs2) {
+    exit(1);
+}
+
 floatType
 dynCollTaskContribFT(
     const Task *task,
@@ -184,6 +277,23 @@ dynCollTaskContribGIT(
 /**
  *
  */
+DynamicCollective
+createNodeCollectiveTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &,
+    Context ctx,
+    Runtime *runtime
+) {
+    const auto *const args = (CreateNodeCollectiveArgs *)task->args;
+    return runtime->create_dynamic_collective(
+        ctx,
+        args->nArrivals,
+        args->redop,
+        args->init,
+        args->initSize
+    );
+}
+
 void
 registerCollectiveOpsTasks(void)
 {
@@ -205,6 +315,17 @@ registerCollectiveOpsTasks(void)
         TaskConfigOptions(true /* leaf task */),
         "dynCollTaskContribFT"
     );
+    HighLevelRuntime::register_legion_task<
+        DynamicCollective, createNodeCollectiveTask
+    >(
+        CREATE_NODE_COLLECTIVE_TID /* task id */,
+        Processor::LOC_PROC /* proc kind  */,
+        true /* single */,
+        false /* index */,
+        AUTO_GENERATE_ID,
+        TaskConfigOptions(false /* leaf task */),
+        "createNodeCollectiveTask"
+    );
     HighLevelRuntime::register_reduction_op<FloatReduceSumAccumulate>(
         FLOAT_REDUCE_SUM_TID
     );
@@ -217,4 +338,13 @@ registerCollectiveOpsTasks(void)
     HighLevelRuntime::register_reduction_op<IntReduceSumAccumulate>(
         INT_REDUCE_SUM_TID
     );
+    HighLevelRuntime::register_reduction_op<FloatSumsReduceSumAccumulate>(
+        FLOAT_SUMS_REDUCE_SUM_TID
+    );
+    HighLevelRuntime::register_reduction_op<CoarseVectorReduceSumAccumulate>(
+        COARSE_VECTOR_REDUCE_SUM_TID
+    );
+    HighLevelRuntime::register_reduction_op<GramSumsReduceSumAccumulate>(
+        GRAM_SUMS_REDUCE_SUM_TID
+    );
 }
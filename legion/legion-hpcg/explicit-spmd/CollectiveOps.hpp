@@ -40,6 +40,51 @@ using namespace LegionRuntime::HighLevel;
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// Maximum number of values reduced together by allReduceSums.
+#define LGNCG_MAX_SUMS 4
+
+/**
+ * A small fixed-size vector of partial sums reduced in one collective round.
+ * Unused trailing entries are zero.
+ */
+struct FloatSums {
+    floatType v[LGNCG_MAX_SUMS];
+};
+
+// Largest global coarse problem that can be agglomerated (see
+// ComputeAgglomeratedMG.hpp).
+#ifndef LGNCG_MAX_AGGLOMERATED_ROWS
+#define LGNCG_MAX_AGGLOMERATED_ROWS 4096
+#endif
+
+/**
+ * A coarse-level vector in global row order. Every shard contributes its rows
+ * (zeros elsewhere), so summing the contributions gathers the whole vector.
+ */
+struct CoarseVector {
+    floatType v[LGNCG_MAX_AGGLOMERATED_ROWS];
+};
+
+// Largest block size of SStepCG (see SStepCG.hpp).
+#ifndef LGNCG_MAX_SSTEP
+#define LGNCG_MAX_SSTEP 8
+#endif
+
+// r' * r and the packed upper triangles of the two 2s x 2s Gram matrices of an
+// s-step CG block.
+#define LGNCG_MAX_GRAM_SUMS \
+    (1 + 2 * LGNCG_MAX_SSTEP * (2 * LGNCG_MAX_SSTEP + 1))
+
+/**
+ * The block Gram matrices of SStepCG, reduced in one collective round. Unused
+ * trailing entries are zero.
+ */
+struct GramSums {
+    floatType v[LGNCG_MAX_GRAM_SUMS];
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 template<typename TYPE>
@@ -50,8 +95,15 @@ struct DynColl {
     int nArrivals = 0;
     //
     TYPE localBuffer;
-    //
+    // Global collective. With a node level, only node leaders arrive here.
     DynamicCollective dc;
+    // Collective of the shards in this shard's address space (see
+    // hasNodeLevel).
+    DynamicCollective nodeDC;
+    // If set, reductions first combine within the node through nodeDC.
+    bool hasNodeLevel = false;
+    // If set, this shard forwards its node's result to dc.
+    bool isNodeLeader = false;
 
     /**
      *
@@ -106,6 +158,59 @@ private:
                 assert(false);
         }
     }
+
+    /**
+     *
+     */
+    void
+    mInitLocalBuffer(
+        int tid,
+        FloatSums &lb
+    ) {
+        switch (tid) {
+            case FLOAT_SUMS_REDUCE_SUM_TID:
+                for (int i = 0; i < LGNCG_MAX_SUMS; ++i) lb.v[i] = 0.0;
+                break;
+            default:
+                assert(false);
+        }
+    }
+
+    /**
+     *
+     */
+    void
+    mInitLocalBuffer(
+        int tid,
+        CoarseVector &lb
+    ) {
+        switch (tid) {
+            case COARSE_VECTOR_REDUCE_SUM_TID:
+                for (int i = 0; i < LGNCG_MAX_AGGLOMERATED_ROWS; ++i) {
+                    lb.v[i] = 0.0;
+                }
+                break;
+            default:
+                assert(false);
+        }
+    }
+
+    /**
+     *
+     */
+    void
+    mInitLocalBuffer(
+        int tid,
+        GramSums &lb
+    ) {
+        switch (tid) {
+            case GRAM_SUMS_REDUCE_SUM_TID:
+                for (int i = 0; i < LGNCG_MAX_GRAM_SUMS; ++i) lb.v[i] = 0.0;
+                break;
+            default:
+                assert(false);
+        }
+    }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -172,6 +277,109 @@ public:
     static void fold(RHS &rhs1, RHS rhs2);
 };
 
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+class FloatSumsReduceSumAccumulate {
+public:
+    typedef FloatSums LHS;
+    typedef FloatSums RHS;
+    static const FloatSums identity;
+
+    template <bool EXCLUSIVE>
+    static void apply(LHS &lhs, RHS rhs);
+
+    template <bool EXCLUSIVE>
+    static void fold(RHS &rhs1, RHS rhs2);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+class CoarseVectorReduceSumAccumulate {
+public:
+    typedef CoarseVector LHS;
+    typedef CoarseVector RHS;
+    static const CoarseVector identity;
+
+    template <bool EXCLUSIVE>
+    static void apply(LHS &lhs, RHS rhs);
+
+    template <bool EXCLUSIVE>
+    static void fold(RHS &rhs1, RHS rhs2);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+class GramSumsReduceSumAccumulate {
+public:
+    typedef GramSums LHS;
+    typedef GramSums RHS;
+    static const GramSums identity;
+
+    template <bool EXCLUSIVE>
+    static void apply(LHS &lhs, RHS rhs);
+
+    template <bool EXCLUSIVE>
+    static void fold(RHS &rhs1, RHS rhs2);
+};
+
+/**
+ * Arrives at dc's collective with localFuture and returns the global result.
+ * With a node level, shards of a node combine through their node's collective
+ * and only its leader arrives at the global one; every shard still advances
+ * both and reads the global result.
+ */
+template <typename TYPE>
+Future
+dynCollArrive(
+    Future localFuture,
+    DynColl<TYPE> &dc,
+    Context ctx,
+    Runtime *runtime
+) {
+    if (dc.hasNodeLevel) {
+        runtime->defer_dynamic_collective_arrival(ctx, dc.nodeDC, localFuture);
+        dc.nodeDC = runtime->advance_dynamic_collective(ctx, dc.nodeDC);
+        localFuture = runtime->get_dynamic_collective_result(ctx, dc.nodeDC);
+        if (!dc.isNodeLeader) {
+            dc.dc = runtime->advance_dynamic_collective(ctx, dc.dc);
+            return runtime->get_dynamic_collective_result(ctx, dc.dc);
+        }
+    }
+    runtime->defer_dynamic_collective_arrival(ctx, dc.dc, localFuture);
+    dc.dc = runtime->advance_dynamic_collective(ctx, dc.dc);
+    //
+    return runtime->get_dynamic_collective_result(ctx, dc.dc);
+}
+
+/**
+ *
+ */
+struct CreateNodeCollectiveArgs {
+    // Reduction operator.
+    int redop;
+    // Number of shards in the node.
+    int nArrivals;
+    // Initial value. Only the first initSize bytes are sent.
+    size_t initSize;
+    char init[sizeof(CoarseVector)];
+};
+
+/**
+ * Creates a node-level dynamic collective. Launched with the tag set to a
+ * shard of the node, so the collective is owned by (and its arrivals are
+ * local to) that node.
+ */
+DynamicCollective
+createNodeCollectiveTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    Runtime *runtime
+);
+
 /**
  * The type of DynColl passed in changes the behavior of the all reduce.
  */
@@ -201,10 +409,48 @@ allReduce(
     //
     Future f = runtime->execute_task(ctx, tl);
     //
-    DynamicCollective &dynCol = dc.data()->dc;
-    //
-    runtime->defer_dynamic_collective_arrival(ctx, dynCol, f);
-    dynCol = runtime->advance_dynamic_collective(ctx, dynCol);
-    //
-    return runtime->get_dynamic_collective_result(ctx, dynCol);
+    return dynCollArrive(f, *dc.data(), ctx, runtime);
+}
+
+/**
+ * Reduces every entry of a FloatSums in one dynamic collective round. The
+ * local future (e.g., the result of a task that computes several partial sums)
+ * arrives at the collective directly, without a forwarding task.
+ */
+inline Future
+allReduceSums(
+    Future localFuture,
+    Item< DynColl<FloatSums> > &dc,
+    Context ctx,
+    Runtime *runtime
+) {
+    return dynCollArrive(localFuture, *dc.data(), ctx, runtime);
+}
+
+/**
+ * Gathers a CoarseVector on every shard: each local future holds the shard's
+ * rows and zeros elsewhere.
+ */
+inline Future
+allGatherCoarse(
+    Future localFuture,
+    Item< DynColl<CoarseVector> > &dc,
+    Context ctx,
+    Runtime *runtime
+) {
+    return dynCollArrive(localFuture, *dc.data(), ctx, runtime);
+}
+
+/**
+ * Reduces the block Gram matrices of an s-step CG block in one dynamic
+ * collective round.
+ */
+inline Future
+allReduceGram(
+    Future localFuture,
+    Item< DynColl<GramSums> > &dc,
+    Context ctx,
+    Runtime *runtime
+) {
+    return dynCollArrive(localFuture, *dc.data(), ctx, runtime);
 }
@@ -0,0 +1,432 @@
+/**
+ * Copyright (c)      2017 Los Alamos National Security, LLC
+ *                         All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LA-CC 10-123
+ */
+
+
+/*!
+    @file ComputeAgglomeratedMG.hpp
+
+    Coarse-level agglomeration. Once a level has few rows per shard, its halo
+    exchanges and launches cost more than its arithmetic. Instead, the level's
+    residual is gathered on every shard in one dynamic collective round, and
+    every shard solves the whole coarse problem redundantly with symmetric
+    Gauss-Seidel sweeps over the level's global matrix (gathered once by
+    SetupAgglomeration), keeping its own rows. No scatter is needed, and the
+    levels below are skipped. The gathered vector, the reduction, and the
+    redundant solve are sized by the global level, so this only pays off (and
+    is only enabled, see SetupAgglomeration) while that level fits in a
+    CoarseVector, i.e., for small shard counts. The problem is not gathered
+    onto a subset of shards: the dynamic collectives always span every shard.
+ */
+
+#pragma once
+
+#include "LegionStuff.hpp"
+#include "LegionArrays.hpp"
+#include "LegionMatrices.hpp"
+#include "CollectiveOps.hpp"
+#include "KernelProfile.hpp"
+
+#include <cassert>
+#include <vector>
+
+/**
+ *
+ */
+struct AgglomeratedSolveArgs {
+    local_int_t nrow;
+    // Global grid of the level.
+    global_int_t gnx;
+    global_int_t gny;
+    global_int_t gnz;
+    // Number of symmetric sweeps.
+    int nSweeps;
+    KernelCost cost;
+};
+
+/**
+ * Writes this shard's rows of r into result at their global rows (zeros
+ * elsewhere).
+ */
+inline int
+AgglomerateGatherKernel(
+    const Array<floatType> &r,
+    const Array<global_int_t> &localToGlobalMap,
+    const AgglomeratedSolveArgs &args,
+    CoarseVector &result
+) {
+    const floatType *const rv = r.data();
+    assert(rv);
+    const global_int_t *const l2g = localToGlobalMap.data();
+    assert(l2g);
+    //
+    for (int i = 0; i < LGNCG_MAX_AGGLOMERATED_ROWS; ++i) result.v[i] = 0.0;
+    for (local_int_t i = 0; i < args.nrow; ++i) {
+        assert(l2g[i] < LGNCG_MAX_AGGLOMERATED_ROWS);
+        result.v[l2g[i]] = rv[i];
+    }
+    //
+    return 0;
+}
+
+/**
+ * Position of stencil offset (sx, sy, sz), each in [-1, 1], in a row of the
+ * agglomerated matrix. The diagonal is at HPCG_STENCIL / 2.
+ */
+inline int
+AgglomeratedStencilIndex(
+    int sx,
+    int sy,
+    int sz
+) {
+    return ((sz + 1) * 3 + sy + 1) * 3 + sx + 1;
+}
+
+/**
+ * Gauss-Seidel update of global row (ix, iy, iz) of the agglomerated matrix a.
+ */
+inline void
+AgglomeratedUpdateRow(
+    const AgglomeratedSolveArgs &args,
+    global_int_t ix,
+    global_int_t iy,
+    global_int_t iz,
+    const floatType *const a,
+    const floatType *const b,
+    floatType *const x
+) {
+    const global_int_t gnx = args.gnx, gny = args.gny, gnz = args.gnz;
+    const global_int_t row = (iz * gny + iy) * gnx + ix;
+    const floatType *const arow = a + row * HPCG_STENCIL;
+    double sum = b[row];
+    for (int sz = -1; sz <= 1; ++sz) {
+        if (iz + sz < 0 || iz + sz >= gnz) continue;
+        for (int sy = -1; sy <= 1; ++sy) {
+            if (iy + sy < 0 || iy + sy >= gny) continue;
+            for (int sx = -1; sx <= 1; ++sx) {
+                if (ix + sx < 0 || ix + sx >= gnx) continue;
+                if (sx == 0 && sy == 0 && sz == 0) continue;
+                sum -= arow[AgglomeratedStencilIndex(sx, sy, sz)]
+                     * x[((iz + sz) * gny + iy + sy) * gnx + ix + sx];
+            }
+        }
+    }
+    x[row] = sum / arow[HPCG_STENCIL / 2];
+}
+
+/**
+ * Solves the gathered problem from a zero guess with args.nSweeps symmetric
+ * sweeps (a symmetric operator, like the V-cycle it replaces) and writes this
+ * shard's rows of the solution to x.
+ */
+inline int
+AgglomeratedSolveKernel(
+    const Array<floatType> &agglomeratedValues,
+    const CoarseVector &b,
+    const Array<global_int_t> &localToGlobalMap,
+    Array<floatType> &x,
+    const AgglomeratedSolveArgs &args
+) {
+    const floatType *const a = agglomeratedValues.data();
+    assert(a);
+    const global_int_t gnx = args.gnx, gny = args.gny, gnz = args.gnz;
+    std::vector<floatType> xg(gnx * gny * gnz, 0.0);
+    //
+    for (int s = 0; s < args.nSweeps; ++s) {
+        for (global_int_t iz = 0; iz < gnz; ++iz) {
+            for (global_int_t iy = 0; iy < gny; ++iy) {
+                for (global_int_t ix = 0; ix < gnx; ++ix) {
+                    AgglomeratedUpdateRow(
+                        args, ix, iy, iz, a, b.v, xg.data()
+                    );
+                }
+            }
+        }
+        for (global_int_t iz = gnz - 1; iz >= 0; --iz) {
+            for (global_int_t iy = gny - 1; iy >= 0; --iy) {
+                for (global_int_t ix = gnx - 1; ix >= 0; --ix) {
+                    AgglomeratedUpdateRow(
+                        args, ix, iy, iz, a, b.v, xg.data()
+                    );
+                }
+            }
+        }
+    }
+    //
+    const global_int_t *const l2g = localToGlobalMap.data();
+    assert(l2g);
+    floatType *const xv = x.data();
+    assert(xv);
+    for (local_int_t i = 0; i < args.nrow; ++i) xv[i] = xg[l2g[i]];
+    //
+    return 0;
+}
+
+/**
+ * Replaces the V-cycle on A (and the levels below it) when A.isAgglomerated.
+ */
+inline int
+ComputeAgglomeratedMG(
+    SparseMatrix &A,
+    Array<floatType> &r,
+    Array<floatType> &x,
+    Context ctx,
+    Runtime *lrt
+) {
+    const Geometry *const Ageom = A.geom->data();
+    const double gRows = double(Ageom->gnx) * Ageom->gny * Ageom->gnz;
+    // Every sweep streams the global vectors and matrix and visits every
+    // nonzero twice.
+    const double sweeps = 2.0 * A.agglomeratedSweeps;
+    AgglomeratedSolveArgs args = {
+        .nrow    = A.sclrs->data()->localNumberOfRows,
+        .gnx     = Ageom->gnx,
+        .gny     = Ageom->gny,
+        .gnz     = Ageom->gnz,
+        .nSweeps = A.agglomeratedSweeps,
+        .cost    = KernelCost {
+            A.level,
+            sweeps * (2.0 + Ageom->stencilSize) * gRows * sizeof(floatType),
+            sweeps * 2.0 * gRows * Ageom->stencilSize
+        }
+    };
+    //
+    Future localFuture;
+#ifdef LGNCG_TASKING
+    TaskLauncher gtl(
+        AGGLOMERATE_GATHER_TID,
+        TaskArgument(&args, sizeof(args))
+    );
+    r.intent(RO_E, gtl, ctx, lrt);
+    A.localToGlobalMap->intent(RO_E, gtl, ctx, lrt);
+    //
+    localFuture = lrt->execute_task(ctx, gtl);
+#else
+    CoarseVector *local = new CoarseVector;
+    AgglomerateGatherKernel(r, *A.localToGlobalMap, args, *local);
+    localFuture = Future::from_value(lrt, *local);
+    delete local;
+#endif
+    Future globalFuture = allGatherCoarse(
+        localFuture, *A.dcAllGatherCV, ctx, lrt
+    );
+#ifdef LGNCG_TASKING
+    TaskLauncher stl(
+        AGGLOMERATED_SOLVE_TID,
+        TaskArgument(&args, sizeof(args))
+    );
+    stl.add_future(globalFuture);
+    A.agglomeratedValues->intent(RO_E, stl, ctx, lrt);
+    A.localToGlobalMap->intent(RO_E, stl, ctx, lrt);
+    x.intent(WO_E, stl, ctx, lrt);
+    //
+    lrt->execute_task(ctx, stl);
+    return 0;
+#else
+    const auto *const b = (const CoarseVector *)
+        globalFuture.get_untyped_pointer(silenceWarnings);
+    KernelTimer timer(KP_COARSE_SOLVE, args.cost, ctx, lrt);
+    return AgglomeratedSolveKernel(
+        *A.agglomeratedValues, *b, *A.localToGlobalMap, x, args
+    );
+#endif
+}
+
+/**
+ * Gathers the global matrix of level A on every shard into
+ * A.agglomeratedValues, one dynamic collective round per stencil entry. Each
+ * round carries, for every global row, its value at that stencil offset.
+ */
+inline void
+SetupAgglomeratedValues(
+    SparseMatrix &A,
+    Context ctx,
+    Runtime *lrt
+) {
+    const SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    const Geometry *const Ageom = A.geom->data();
+    const local_int_t nrow = Asclrs->localNumberOfRows;
+    const int nnpr = Ageom->stencilSize;
+    const global_int_t gnx = Ageom->gnx, gny = Ageom->gny;
+    const global_int_t gRows = gnx * gny * Ageom->gnz;
+    //
+    const char *const nonzerosInRow = A.nonzerosInRow->data();
+    const global_int_t *const l2g = A.localToGlobalMap->data();
+    Array2D<floatType> matrixValues(nrow, nnpr, A.matrixValues->data());
+    Array2D<global_int_t> mtxIndG(nrow, nnpr, A.mtxIndG->data());
+    assert(nonzerosInRow && l2g);
+    // Stencil position of every local entry.
+    std::vector<int> entryIndex(nrow * nnpr, -1);
+    for (local_int_t i = 0; i < nrow; ++i) {
+        const global_int_t row = l2g[i];
+        for (int j = 0; j < nonzerosInRow[i]; ++j) {
+            const global_int_t col = mtxIndG(i, j);
+            entryIndex[i * nnpr + j] = AgglomeratedStencilIndex(
+                int(col % gnx - row % gnx),
+                int((col / gnx) % gny - (row / gnx) % gny),
+                int(col / (gnx * gny) - row / (gnx * gny))
+            );
+        }
+    }
+    //
+    A.lAgglomeratedValues.allocate(
+        "agglomeratedValues", gRows * HPCG_STENCIL, ctx, lrt
+    );
+    A.agglomeratedValues = new Array<floatType>(
+        A.lAgglomeratedValues.mapRegion(RW_E, ctx, lrt), ctx, lrt
+    );
+    floatType *const av = A.agglomeratedValues->data();
+    assert(av);
+    //
+    CoarseVector *local = new CoarseVector;
+    for (int k = 0; k < HPCG_STENCIL; ++k) {
+        for (int i = 0; i < LGNCG_MAX_AGGLOMERATED_ROWS; ++i) {
+            local->v[i] = 0.0;
+        }
+        for (local_int_t i = 0; i < nrow; ++i) {
+            for (int j = 0; j < nonzerosInRow[i]; ++j) {
+                if (entryIndex[i * nnpr + j] != k) continue;
+                local->v[l2g[i]] = matrixValues(i, j);
+            }
+        }
+        Future globalFuture = allGatherCoarse(
+            Future::from_value(lrt, *local), *A.dcAllGatherCV, ctx, lrt
+        );
+        const auto *const global = (const CoarseVector *)
+            globalFuture.get_untyped_pointer(silenceWarnings);
+        for (global_int_t row = 0; row < gRows; ++row) {
+            av[row * HPCG_STENCIL + k] = global->v[row];
+        }
+    }
+    delete local;
+}
+
+/**
+ * Marks the first coarse level of A that has fewer than rowsPerShard rows per
+ * shard on average, and whose global problem fits in a CoarseVector, for
+ * agglomeration with nSweeps symmetric sweeps, and gathers its matrix. Returns
+ * that level, or 0 if none qualifies (or rowsPerShard is 0).
+ */
+inline int
+SetupAgglomeration(
+    SparseMatrix &A,
+    int rowsPerShard,
+    int nSweeps,
+    Context ctx,
+    Runtime *lrt
+) {
+    if (rowsPerShard <= 0) return 0;
+    //
+    for (SparseMatrix *Ac = A.Ac; Ac; Ac = Ac->Ac) {
+        const Geometry *const geom = Ac->geom->data();
+        const global_int_t gRows = geom->gnx * geom->gny * geom->gnz;
+        if (gRows >= global_int_t(rowsPerShard) * geom->size) continue;
+        if (gRows > LGNCG_MAX_AGGLOMERATED_ROWS) continue;
+        //
+        Ac->isAgglomerated = true;
+        Ac->agglomeratedSweeps = nSweeps;
+        SetupAgglomeratedValues(*Ac, ctx, lrt);
+        return Ac->level;
+    }
+    return 0;
+}
+
+/**
+ *
+ */
+CoarseVector
+AgglomerateGatherTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    Runtime *lrt
+) {
+    const auto *const args = (AgglomeratedSolveArgs *)task->args;
+    //
+    Array<floatType> r(regions[0], ctx, lrt);
+    Array<global_int_t> localToGlobalMap(regions[1], ctx, lrt);
+    //
+    CoarseVector result;
+    AgglomerateGatherKernel(r, localToGlobalMap, *args, result);
+    //
+    return result;
+}
+
+/**
+ *
+ */
+void
+AgglomeratedSolveTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    Runtime *lrt
+) {
+    const auto *const args = (AgglomeratedSolveArgs *)task->args;
+    KernelTimer timer(KP_COARSE_SOLVE, args->cost, ctx, lrt);
+    //
+    const auto *const b = (const CoarseVector *)
+        task->futures[0].get_untyped_pointer(silenceWarnings);
+    Array<floatType> agglomeratedValues(regions[0], ctx, lrt);
+    Array<global_int_t> localToGlobalMap(regions[1], ctx, lrt);
+    Array<floatType> x(regions[2], ctx, lrt);
+    //
+    AgglomeratedSolveKernel(
+        agglomeratedValues, *b, localToGlobalMap, x, *args
+    );
+}
+
+/**
+ *
+ */
+inline void
+registerAgglomeratedMGTasks(void)
+{
+#ifdef LGNCG_TASKING
+    HighLevelRuntime::register_legion_task<
+        CoarseVector, AgglomerateGatherTask
+    >(
+        AGGLOMERATE_GATHER_TID /* task id */,
+        Processor::LOC_PROC /* proc kind  */,
+        true /* single */,
+        false /* index */,
+        AUTO_GENERATE_ID,
+        TaskConfigOptions(true /* leaf task */),
+        "AgglomerateGatherTask"
+    );
+    HighLevelRuntime::register_legion_task<AgglomeratedSolveTask>(
+        AGGLOMERATED_SOLVE_TID /* task id */,
+        Processor::LOC_PROC /* proc kind  */,
+        true /* single */,
+        false /* index */,
+        AUTO_GENERATE_ID,
+        TaskConfigOptions(true /* leaf task */),
+        "AgglomeratedSolveTask"
+    );
+#endif
+}
@@ -50,6 +50,7 @@
 
 #include "LegionArrays.hpp"
 #include "CollectiveOps.hpp"
+#include "KernelProfile.hpp"
 
 #include "mytimer.hpp"
 
@@ -62,6 +63,19 @@ struct ComputeDotProductArgs {
     local_int_t n;
 };
 
+/**
+ * Modeled work of nDots local dot products of length n (all on CG vectors,
+ * level 0).
+ */
+inline KernelCost
+DotCost(
+    local_int_t n,
+    int nDots
+) {
+    const double nv = double(n) * nDots;
+    return KernelCost {0, 2.0 * nv * sizeof(floatType), 2.0 * nv};
+}
+
 /*!
     Routine to compute the dot product of two vectors where:
 
@@ -139,7 +153,10 @@ ComputeDotProduct(
     localFuture = lrt->execute_task(ctx, tl);
 #else
     floatType localResult = 0.0;
-    rc = ComputeDotProductKernel(x, y, args, localResult);
+    {
+        KernelTimer timer(KP_DDOT, DotCost(n, 1), ctx, lrt);
+        rc = ComputeDotProductKernel(x, y, args, localResult);
+    }
     localFuture = Future::from_value(lrt, localResult);
 #endif
     double t0 = mytimer(); // FIXME
@@ -160,6 +177,7 @@ ComputeDotProductTask(
     Runtime *lrt
 ) {
     const auto *const args = (ComputeDotProductArgs *)task->args;
+    KernelTimer timer(KP_DDOT, DotCost(args->n, 1), ctx, lrt);
     //
     Array<floatType> x(regions[0], ctx, lrt);
     Array<floatType> y(regions[1], ctx, lrt);
@@ -170,6 +188,142 @@ ComputeDotProductTask(
     return localResult;
 }
 
+/**
+ *
+ */
+struct ComputeDotProductsArgs {
+    local_int_t n;
+    int nDots;
+};
+
+/*!
+    Routine to compute several dot products in one pass where:
+    result.v[d] = x[d]' * y[d] for d < nDots. Entries past nDots are zero.
+
+    @param[in]  args the number of vector elements and of dot products.
+    @param[in]  x, y the input vector pairs.
+    @param[out] result the local partial sums.
+
+    @return returns 0 upon success and non-zero otherwise
+*/
+inline int
+ComputeDotProductsKernel(
+    Array<floatType> *const *x,
+    Array<floatType> *const *y,
+    const ComputeDotProductsArgs &args,
+    FloatSums &result
+) {
+    const int nDots = args.nDots;
+    assert(nDots > 0 && nDots <= LGNCG_MAX_SUMS);
+    //
+    const floatType *xv[LGNCG_MAX_SUMS];
+    const floatType *yv[LGNCG_MAX_SUMS];
+    for (int d = 0; d < nDots; ++d) {
+        assert(x[d]->length() >= size_t(args.n));
+        assert(y[d]->length() >= size_t(args.n));
+        xv[d] = x[d]->data();
+        assert(xv[d]);
+        yv[d] = y[d]->data();
+        assert(yv[d]);
+    }
+    //
+    floatType localResult[LGNCG_MAX_SUMS] = {0.0};
+    //
+    const local_int_t n = args.n;
+    for (local_int_t i = 0; i < n; i++) {
+        for (int d = 0; d < nDots; ++d) {
+            localResult[d] += xv[d][i] * yv[d][i];
+        }
+    }
+    //
+    for (int d = 0; d < LGNCG_MAX_SUMS; ++d) result.v[d] = localResult[d];
+    //
+    return 0;
+}
+
+/**
+ * Computes nDots dot products with one task and reduces them together with one
+ * dynamic collective round. resultFuture holds the global FloatSums.
+ */
+inline int
+ComputeDotProducts(
+    local_int_t n,
+    int nDots,
+    Array<floatType> *const *x,
+    Array<floatType> *const *y,
+    Future &resultFuture,
+    double &timeAllreduce,
+    Item< DynColl<FloatSums> > &dcReduceSums,
+    Context ctx,
+    Runtime *lrt
+) {
+    ComputeDotProductsArgs args = {
+        .n = n,
+        .nDots = nDots
+    };
+    //
+    Future localFuture;
+    //
+    int rc = 0;
+#ifdef LGNCG_TASKING
+    //
+    TaskLauncher tl(
+        DDOTS_TID,
+        TaskArgument(&args, sizeof(args))
+    );
+    //
+    for (int d = 0; d < nDots; ++d) {
+        x[d]->intent(RO_E, tl, ctx, lrt);
+        y[d]->intent(RO_E, tl, ctx, lrt);
+    }
+    //
+    localFuture = lrt->execute_task(ctx, tl);
+#else
+    FloatSums localResult;
+    {
+        KernelTimer timer(KP_DDOT, DotCost(n, nDots), ctx, lrt);
+        rc = ComputeDotProductsKernel(x, y, args, localResult);
+    }
+    localFuture = Future::from_value(lrt, localResult);
+#endif
+    double t0 = mytimer();
+    resultFuture = allReduceSums(localFuture, dcReduceSums, ctx, lrt);
+    timeAllreduce += mytimer() - t0;
+    //
+    return rc;
+}
+
+/**
+ *
+ */
+FloatSums
+ComputeDotProductsTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    Runtime *lrt
+) {
+    const auto *const args = (ComputeDotProductsArgs *)task->args;
+    KernelTimer timer(KP_DDOT, DotCost(args->n, args->nDots), ctx, lrt);
+    //
+    Array<floatType> *x[LGNCG_MAX_SUMS];
+    Array<floatType> *y[LGNCG_MAX_SUMS];
+    for (int d = 0; d < args->nDots; ++d) {
+        x[d] = new Array<floatType>(regions[2 * d], ctx, lrt);
+        y[d] = new Array<floatType>(regions[2 * d + 1], ctx, lrt);
+    }
+    //
+    FloatSums localResult;
+    ComputeDotProductsKernel(x, y, *args, localResult);
+    //
+    for (int d = 0; d < args->nDots; ++d) {
+        delete x[d];
+        delete y[d];
+    }
+    //
+    return localResult;
+}
+
 inline void
 registerDDotTasks(void)
 {
@@ -183,5 +337,14 @@ registerDDotTasks(void)
         TaskConfigOptions(true /* leaf task */),
         "ComputeDotProductTask"
     );
+    HighLevelRuntime::register_legion_task<FloatSums, ComputeDotProductsTask>(
+        DDOTS_TID /* task id */,
+        Processor::LOC_PROC /* proc kind  */,
+        true /* single */,
+        false /* index */,
+        AUTO_GENERATE_ID,
+        TaskConfigOptions(true /* leaf task */),
+        "ComputeDotProductsTask"
+    );
 #endif
 }
@@ -0,0 +1,569 @@
+/**
+ * Copyright (c)      2017 Los Alamos National Security, LLC
+ *                         All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LA-CC 10-123
+ */
+
+/*!
+    @file ComputeFusedCG.hpp
+
+    Fused CG vector updates. Each routine streams its vectors through memory
+    once; the CG() ones also return the local part of the dot product that CG
+    needs next.
+ */
+
+#pragma once
+
+#include "LegionArrays.hpp"
+#include "CollectiveOps.hpp"
+#include "KernelProfile.hpp"
+
+#include "mytimer.hpp"
+
+#include <cassert>
+
+/**
+ *
+ */
+struct ComputeXRUpdateArgs {
+    local_int_t n;
+    floatType alpha;
+};
+
+/**
+ * Modeled work of ComputeXRUpdate: p, Ap, x, and r read, x and r written.
+ */
+inline KernelCost
+XRUpdateCost(
+    local_int_t n
+) {
+    return KernelCost {0, 6.0 * n * sizeof(floatType), 6.0 * n};
+}
+
+/*!
+    Routine to compute the fused solution and residual update where:
+    x = x + alpha * p, r = r - alpha * Ap, result = r' * r.
+
+    @param[in]    args  the number of vector elements and the step length.
+    @param[in]    p, Ap the direction vector and A * p.
+    @param[inout] x, r  the approximate solution and residual vectors.
+    @param[out]   result the local part of the updated r' * r.
+
+    @return returns 0 upon success and non-zero otherwise
+*/
+inline int
+ComputeXRUpdateKernel(
+    const ComputeXRUpdateArgs &args,
+    const Array<floatType> &p,
+    const Array<floatType> &Ap,
+    Array<floatType> &x,
+    Array<floatType> &r,
+    floatType &result
+) {
+    const local_int_t n = args.n;
+    const floatType alpha = args.alpha;
+    //
+    assert(p.length()  >= size_t(n));
+    assert(Ap.length() >= size_t(n));
+    assert(x.length()  >= size_t(n));
+    assert(r.length()  >= size_t(n));
+    //
+    const floatType *const pv = p.data();
+    assert(pv);
+    const floatType *const Apv = Ap.data();
+    assert(Apv);
+    floatType *const xv = x.data();
+    assert(xv);
+    floatType *const rv = r.data();
+    assert(rv);
+    //
+    floatType localResult = 0.0;
+    for (local_int_t i = 0; i < n; i++) {
+        xv[i] += alpha * pv[i];
+        const floatType ri = rv[i] - alpha * Apv[i];
+        rv[i] = ri;
+        localResult += ri * ri;
+    }
+    //
+    result = localResult;
+    //
+    return 0;
+}
+
+/**
+ * Replaces the x and r WAXPBYs and the r' * r dot product at the end of a CG
+ * iteration. alpha is passed to the task as a Future, so the caller does not
+ * wait on the reductions that produce it. resultFuture holds the global r' * r.
+ */
+inline int
+ComputeXRUpdate(
+    local_int_t n,
+    const Future &alphaFuture,
+    Array<floatType> &p,
+    Array<floatType> &Ap,
+    Array<floatType> &x,
+    Array<floatType> &r,
+    Future &resultFuture,
+    double &timeAllreduce,
+    Item< DynColl<floatType> > &dcReduceSum,
+    Context ctx,
+    Runtime *lrt
+) {
+    Future localFuture;
+    //
+    int rc = 0;
+#ifdef LGNCG_TASKING
+    // alpha is filled in by the task.
+    ComputeXRUpdateArgs args {
+        .n = n,
+        .alpha = 0.0
+    };
+    //
+    TaskLauncher tl(
+        XR_UPDATE_TID,
+        TaskArgument(&args, sizeof(args))
+    );
+    //
+    tl.add_future(alphaFuture);
+    //
+    p.intent(RO_E, tl, ctx, lrt);
+    Ap.intent(RO_E, tl, ctx, lrt);
+    x.intent(RW_E, tl, ctx, lrt);
+    r.intent(RW_E, tl, ctx, lrt);
+    //
+    localFuture = lrt->execute_task(ctx, tl);
+#else
+    ComputeXRUpdateArgs args {
+        .n = n,
+        .alpha = alphaFuture.get_result<floatType>(silenceWarnings)
+    };
+    //
+    floatType localResult = 0.0;
+    {
+        KernelTimer timer(KP_FUSED_UPDATE, XRUpdateCost(n), ctx, lrt);
+        rc = ComputeXRUpdateKernel(args, p, Ap, x, r, localResult);
+    }
+    localFuture = Future::from_value(lrt, localResult);
+#endif
+    double t0 = mytimer();
+    resultFuture = allReduce(localFuture, dcReduceSum, ctx, lrt);
+    timeAllreduce += mytimer() - t0;
+    //
+    return rc;
+}
+
+/**
+ *
+ */
+floatType
+ComputeXRUpdateTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    Runtime *lrt
+) {
+    ComputeXRUpdateArgs args = *(ComputeXRUpdateArgs *)task->args;
+    args.alpha = task->futures[0].get_result<floatType>(silenceWarnings);
+    KernelTimer timer(KP_FUSED_UPDATE, XRUpdateCost(args.n), ctx, lrt);
+    //
+    Array<floatType> p (regions[0], ctx, lrt);
+    Array<floatType> Ap(regions[1], ctx, lrt);
+    Array<floatType> x (regions[2], ctx, lrt);
+    Array<floatType> r (regions[3], ctx, lrt);
+    //
+    floatType localResult = 0.0;
+    ComputeXRUpdateKernel(args, p, Ap, x, r, localResult);
+    //
+    return localResult;
+}
+
+/**
+ *
+ */
+struct ComputePUpdateArgs {
+    local_int_t n;
+    floatType beta;
+};
+
+/**
+ * Modeled work of ComputePUpdate: r and z read, p written (and read unless
+ * beta is zero).
+ */
+inline KernelCost
+PUpdateCost(
+    const ComputePUpdateArgs &args
+) {
+    const bool readP = (args.beta != 0.0);
+    return KernelCost {
+        0, (readP ? 4.0 : 3.0) * args.n * sizeof(floatType),
+        (readP ? 4.0 : 2.0) * args.n
+    };
+}
+
+/*!
+    Routine to compute the fused direction update where:
+    p = z + beta * p, result = r' * z.
+
+    When beta is zero, p is only written (p = z), so the first CG iteration
+    can build its direction vector and r' * z in one pass.
+
+    @param[in]    args the number of vector elements and beta.
+    @param[in]    r, z the residual and preconditioned residual vectors.
+    @param[inout] p    the direction vector.
+    @param[out]   result the local part of r' * z.
+
+    @return returns 0 upon success and non-zero otherwise
+*/
+inline int
+ComputePUpdateKernel(
+    const ComputePUpdateArgs &args,
+    const Array<floatType> &r,
+    const Array<floatType> &z,
+    Array<floatType> &p,
+    floatType &result
+) {
+    const local_int_t n = args.n;
+    const floatType beta = args.beta;
+    //
+    assert(r.length() >= size_t(n));
+    assert(z.length() >= size_t(n));
+    assert(p.length() >= size_t(n));
+    //
+    const floatType *const rv = r.data();
+    assert(rv);
+    const floatType *const zv = z.data();
+    assert(zv);
+    floatType *const pv = p.data();
+    assert(pv);
+    //
+    floatType localResult = 0.0;
+    if (beta == 0.0) {
+        for (local_int_t i = 0; i < n; i++) {
+            pv[i] = zv[i];
+            localResult += rv[i] * zv[i];
+        }
+    }
+    else {
+        for (local_int_t i = 0; i < n; i++) {
+            pv[i] = zv[i] + beta * pv[i];
+            localResult += rv[i] * zv[i];
+        }
+    }
+    //
+    result = localResult;
+    //
+    return 0;
+}
+
+/**
+ * resultFuture holds the global r' * z. Note that beta must already be known,
+ * so outside of the first iteration this is only useful to algorithms that do
+ * not derive beta from this r' * z.
+ */
+inline int
+ComputePUpdate(
+    local_int_t n,
+    floatType beta,
+    Array<floatType> &r,
+    Array<floatType> &z,
+    Array<floatType> &p,
+    Future &resultFuture,
+    double &timeAllreduce,
+    Item< DynColl<floatType> > &dcReduceSum,
+    Context ctx,
+    Runtime *lrt
+) {
+    ComputePUpdateArgs args {
+        .n = n,
+        .beta = beta
+    };
+    //
+    Future localFuture;
+    //
+    int rc = 0;
+#ifdef LGNCG_TASKING
+    TaskLauncher tl(
+        P_UPDATE_TID,
+        TaskArgument(&args, sizeof(args))
+    );
+    //
+    r.intent(RO_E, tl, ctx, lrt);
+    z.intent(RO_E, tl, ctx, lrt);
+    p.intent(
+        beta == 0.0 ? WO : RW,
+        EXCLUSIVE,
+        tl, ctx, lrt
+    );
+    //
+    localFuture = lrt->execute_task(ctx, tl);
+#else
+    floatType localResult = 0.0;
+    {
+        KernelTimer timer(KP_FUSED_UPDATE, PUpdateCost(args), ctx, lrt);
+        rc = ComputePUpdateKernel(args, r, z, p, localResult);
+    }
+    localFuture = Future::from_value(lrt, localResult);
+#endif
+    double t0 = mytimer();
+    resultFuture = allReduce(localFuture, dcReduceSum, ctx, lrt);
+    timeAllreduce += mytimer() - t0;
+    //
+    return rc;
+}
+
+/**
+ *
+ */
+floatType
+ComputePUpdateTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    Runtime *lrt
+) {
+    const auto *const args = (ComputePUpdateArgs *)task->args;
+    KernelTimer timer(KP_FUSED_UPDATE, PUpdateCost(*args), ctx, lrt);
+    //
+    Array<floatType> r(regions[0], ctx, lrt);
+    Array<floatType> z(regions[1], ctx, lrt);
+    Array<floatType> p(regions[2], ctx, lrt);
+    //
+    floatType localResult = 0.0;
+    ComputePUpdateKernel(*args, r, z, p, localResult);
+    //
+    return localResult;
+}
+
+/**
+ *
+ */
+struct ComputePipelinedCGUpdateArgs {
+    local_int_t n;
+    floatType alpha;
+    floatType beta;
+};
+
+/*!
+    Routine to compute the vector recurrences of one pipelined CG iteration
+    where:
+    z = n + beta * z, q = m + beta * q, s = w + beta * s, p = u + beta * p,
+    x = x + alpha * p, r = r - alpha * s, u = u - alpha * q,
+    w = w - alpha * z.
+
+    When beta is zero the old z, q, s and p are not read.
+
+    @return returns 0 upon success and non-zero otherwise
+*/
+inline int
+ComputePipelinedCGUpdateKernel(
+    const ComputePipelinedCGUpdateArgs &args,
+    const Array<floatType> &nvec,
+    const Array<floatType> &m,
+    Array<floatType> &z,
+    Array<floatType> &q,
+    Array<floatType> &s,
+    Array<floatType> &p,
+    Array<floatType> &x,
+    Array<floatType> &r,
+    Array<floatType> &u,
+    Array<floatType> &w
+) {
+    const local_int_t n = args.n;
+    const floatType alpha = args.alpha;
+    const floatType beta = args.beta;
+    //
+    const floatType *const nv = nvec.data();
+    assert(nv);
+    const floatType *const mv = m.data();
+    assert(mv);
+    floatType *const zv = z.data();
+    assert(zv);
+    floatType *const qv = q.data();
+    assert(qv);
+    floatType *const sv = s.data();
+    assert(sv);
+    floatType *const pv = p.data();
+    assert(pv);
+    floatType *const xv = x.data();
+    assert(xv);
+    floatType *const rv = r.data();
+    assert(rv);
+    floatType *const uv = u.data();
+    assert(uv);
+    floatType *const wv = w.data();
+    assert(wv);
+    //
+    if (beta == 0.0) {
+        for (local_int_t i = 0; i < n; i++) {
+            zv[i] = nv[i];
+            qv[i] = mv[i];
+            sv[i] = wv[i];
+            pv[i] = uv[i];
+        }
+    }
+    else {
+        for (local_int_t i = 0; i < n; i++) {
+            zv[i] = nv[i] + beta * zv[i];
+            qv[i] = mv[i] + beta * qv[i];
+            sv[i] = wv[i] + beta * sv[i];
+            pv[i] = uv[i] + beta * pv[i];
+        }
+    }
+    for (local_int_t i = 0; i < n; i++) {
+        xv[i] += alpha * pv[i];
+        rv[i] -= alpha * sv[i];
+        uv[i] -= alpha * qv[i];
+        wv[i] -= alpha * zv[i];
+    }
+    //
+    return 0;
+}
+
+/**
+ * alpha and beta are handed to the task as futures.
+ */
+inline int
+ComputePipelinedCGUpdate(
+    local_int_t n,
+    const Future &alphaFuture,
+    const Future &betaFuture,
+    Array<floatType> &nvec,
+    Array<floatType> &m,
+    Array<floatType> &z,
+    Array<floatType> &q,
+    Array<floatType> &s,
+    Array<floatType> &p,
+    Array<floatType> &x,
+    Array<floatType> &r,
+    Array<floatType> &u,
+    Array<floatType> &w,
+    Context ctx,
+    Runtime *lrt
+) {
+#ifdef LGNCG_TASKING
+    // alpha and beta are filled in by the task.
+    ComputePipelinedCGUpdateArgs args {
+        .n = n,
+        .alpha = 0.0,
+        .beta = 0.0
+    };
+    //
+    TaskLauncher tl(
+        PIPELINED_CG_UPDATE_TID,
+        TaskArgument(&args, sizeof(args))
+    );
+    //
+    tl.add_future(alphaFuture);
+    tl.add_future(betaFuture);
+    //
+    nvec.intent(RO_E, tl, ctx, lrt);
+    m.intent(RO_E, tl, ctx, lrt);
+    Array<floatType> *rws[] = {&z, &q, &s, &p, &x, &r, &u, &w};
+    for (auto *a : rws) {
+        a->intent(RW_E, tl, ctx, lrt);
+    }
+    //
+    lrt->execute_task(ctx, tl);
+    return 0;
+#else
+    ComputePipelinedCGUpdateArgs args {
+        .n = n,
+        .alpha = alphaFuture.get_result<floatType>(silenceWarnings),
+        .beta = betaFuture.get_result<floatType>(silenceWarnings)
+    };
+    //
+    return ComputePipelinedCGUpdateKernel(
+        args, nvec, m, z, q, s, p, x, r, u, w
+    );
+#endif
+}
+
+/**
+ *
+ */
+void
+ComputePipelinedCGUpdateTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    Runtime *lrt
+) {
+    ComputePipelinedCGUpdateArgs args
+        = *(ComputePipelinedCGUpdateArgs *)task->args;
+    args.alpha = task->futures[0].get_result<floatType>(silenceWarnings);
+    args.beta  = task->futures[1].get_result<floatType>(silenceWarnings);
+    //
+    int rid = 0;
+    Array<floatType> nvec(regions[rid++], ctx, lrt);
+    Array<floatType> m   (regions[rid++], ctx, lrt);
+    Array<floatType> z   (regions[rid++], ctx, lrt);
+    Array<floatType> q   (regions[rid++], ctx, lrt);
+    Array<floatType> s   (regions[rid++], ctx, lrt);
+    Array<floatType> p   (regions[rid++], ctx, lrt);
+    Array<floatType> x   (regions[rid++], ctx, lrt);
+    Array<floatType> r   (regions[rid++], ctx, lrt);
+    Array<floatType> u   (regions[rid++], ctx, lrt);
+    Array<floatType> w   (regions[rid++], ctx, lrt);
+    //
+    ComputePipelinedCGUpdateKernel(args, nvec, m, z, q, s, p, x, r, u, w);
+}
+
+/**
+ *
+ */
+inline void
+registerFusedCGTasks(void)
+{
+#ifdef LGNCG_TASKING
+    HighLevelRuntime::register_legion_task<floatType, ComputeXRUpdateTask>(
+        XR_UPDATE_TID /* task id */,
+        Processor::LOC_PROC /* proc kind  */,
+        true /* single */,
+        false /* index */,
+        AUTO_GENERATE_ID,
+        TaskConfigOptions(true /* leaf task */),
+        "ComputeXRUpdateTask"
+    );
+    HighLevelRuntime::register_legion_task<floatType, ComputePUpdateTask>(
+        P_UPDATE_TID /* task id */,
+        Processor::LOC_PROC /* proc kind  */,
+        true /* single */,
+        false /* index */,
+        AUTO_GENERATE_ID,
+        TaskConfigOptions(true /* leaf task */),
+        "ComputePUpdateTask"
+    );
+    HighLevelRuntime::register_legion_task<ComputePipelinedCGUpdateTask>(
+        PIPELINED_CG_UPDATE_TID /* task id */,
+        Processor::LOC_PROC /* proc kind  */,
+        true /* single */,
+        false /* index */,
+        AUTO_GENERATE_ID,
+        TaskConfigOptions(true /* leaf task */),
+        "ComputePipelinedCGUpdateTask"
+    );
+#endif
+}
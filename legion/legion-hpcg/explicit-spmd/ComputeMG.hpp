@@ -55,23 +55,15 @@
 #include "ComputeSYMGS.hpp"
 #include "ComputeRestriction.hpp"
 #include "ComputeProlongation.hpp"
+#include "ComputeAgglomeratedMG.hpp"
 
 #include <iostream>
 
-/*!
-    @param[in] A the known system matrix.
-
-    @param[in] r the input vector.
-
-    @param[inout] x On exit contains the result of the multigrid V-cycle with r
-    as the RHS, x is the approximation to Ax = r.
-
-    @return returns 0 upon success and non-zero otherwise.
-
-    @see ComputeMG
-*/
+/**
+ * One V-cycle starting at A. See ComputeMG.
+ */
 inline int
-ComputeMG(
+ComputeMGCycle(
     SparseMatrix &A,
     Array<floatType> &r,
     Array<floatType> &x,
@@ -82,39 +74,80 @@ ComputeMG(
     assert(Asclrs);
     // Make sure x contain space for halo values.
     assert(x.length() == size_t(Asclrs->localNumberOfColumns));
+    // Gathered and solved on every shard (see SetupAgglomeration).
+    if (A.isAgglomerated) return ComputeAgglomeratedMG(A, r, x, ctx, lrt);
     // Initialize x to zero.
     ZeroVector(x, ctx, lrt);
     //
     int ierr = 0;
+    const bool mixed = A.isMgMixedPrecision;
     // Go to next coarse level if defined
     if (A.mgData != NULL) {
         const int nPre = A.mgData->numberOfPresmootherSteps;
+        // The first step starts from the zero x.
         for (int i = 0; i < nPre; ++i) {
-            ierr += ComputeSYMGS(A, r, x, ctx, lrt);
+            ierr += ComputeSYMGS(A, r, x, ctx, lrt, mixed, i == 0);
         }
         if (ierr != 0) return ierr;
         //
-        ierr = ComputeSPMV(A, x, *A.mgData->Axf, ctx, lrt);
+        ierr = ComputeSPMV(A, x, *A.mgData->Axf, ctx, lrt, mixed);
         if (ierr != 0) return ierr;
         // Perform restriction operation using simple injection.
         ierr = ComputeRestriction(A, r, ctx, lrt);
         if (ierr != 0) return ierr;
         //
-        ierr = ComputeMG(*A.Ac, *A.mgData->rc, *A.mgData->xc, ctx, lrt);
+        ierr = ComputeMGCycle(*A.Ac, *A.mgData->rc, *A.mgData->xc, ctx, lrt);
         if (ierr != 0) return ierr;
         //
         ierr = ComputeProlongation(A, x, ctx, lrt);
         if (ierr!=0) return ierr;
         const int nPost = A.mgData->numberOfPostsmootherSteps;
         for (int i = 0; i < nPost; ++i) {
-            ierr += ComputeSYMGS(A, r, x, ctx, lrt);
+            ierr += ComputeSYMGS(A, r, x, ctx, lrt, mixed);
         }
         if (ierr != 0) return ierr;
     }
     else {
-        ierr = ComputeSYMGS(A, r, x, ctx, lrt);
+        const bool zeroInitialGuess = true;
+        ierr = ComputeSYMGS(A, r, x, ctx, lrt, mixed, zeroInitialGuess);
         if (ierr != 0) return ierr;
     }
     //
     return 0;
 }
+
+/*!
+    @param[in] A the known system matrix.
+
+    @param[in] r the input vector.
+
+    @param[inout] x On exit contains the result of the multigrid V-cycle with r
+    as the RHS, x is the approximation to Ax = r.
+
+    If A.isMgMixedPrecision (see SetMixedPrecisionMG), the smoother and
+    residual products on every level read the reduced-precision matrix copies;
+    all vectors stay in floatType.
+
+    Every V-cycle issues the same launches, so the cycle is run as a runtime
+    trace if A.isTraced.
+
+    @return returns 0 upon success and non-zero otherwise.
+
+    @see ComputeMG
+*/
+inline int
+ComputeMG(
+    SparseMatrix &A,
+    Array<floatType> &r,
+    Array<floatType> &x,
+    Context ctx,
+    Runtime *lrt
+) {
+    const Legion::TraceID tid = BeginSolverTrace(
+        A, SOLVER_TRACE_MG, r, x, ctx, lrt
+    );
+    const int ierr = ComputeMGCycle(A, r, x, ctx, lrt);
+    EndSolverTrace(tid, ctx, lrt);
+    //
+    return ierr;
+}
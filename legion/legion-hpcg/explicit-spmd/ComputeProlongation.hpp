@@ -51,12 +51,14 @@
 #include "LegionStuff.hpp"
 #include "LegionArrays.hpp"
 #include "LegionMatrices.hpp"
+#include "KernelProfile.hpp"
 
 /**
  *
  */
 struct ComputeProlongationArgs {
     local_int_t nc;
+    KernelCost cost;
 };
 
 /*!
@@ -108,8 +110,14 @@ ComputeProlongation(
     Context ctx,
     Runtime *lrt
 ) {
+    const local_int_t nc = Af.mgData->rc->length();
+    // Every coarse entry reads an f2c index and xc, and updates xf.
     const ComputeProlongationArgs args = {
-        .nc = local_int_t(Af.mgData->rc->length())
+        .nc   = nc,
+        .cost = KernelCost {
+            Af.level, nc * (3.0 * sizeof(floatType) + sizeof(local_int_t)),
+            double(nc)
+        }
     };
 #ifdef LGNCG_TASKING
     //
@@ -126,6 +134,7 @@ ComputeProlongation(
     lrt->execute_task(ctx, tl);
     return 0;
 #else
+    KernelTimer timer(KP_PROLONGATION, args.cost, ctx, lrt);
     return ComputeProlongationKernel(
                *Af.mgData->xc,
                *Af.mgData->f2cOperator,
@@ -146,6 +155,7 @@ ComputeProlongationTask(
     Runtime *lrt
 ) {
     const auto *const args = (ComputeProlongationArgs *)task->args;
+    KernelTimer timer(KP_PROLONGATION, args->cost, ctx, lrt);
     //
     int rid = 0;
     Array<floatType>   Afxc (regions[rid++], ctx, lrt);
@@ -51,6 +51,7 @@
 #include "LegionStuff.hpp"
 #include "LegionArrays.hpp"
 #include "LegionMatrices.hpp"
+#include "KernelProfile.hpp"
 
 /*!
     Routine to compute the coarse residual vector.
@@ -96,11 +97,16 @@ ComputeRestriction(
     Context ctx,
     Runtime *lrt
 ) {
+    // Every coarse entry reads an f2c index, rf, and Axf, and writes rc.
+    const double nc = A.mgData->rc->length();
+    const KernelCost cost {
+        A.level, nc * (3.0 * sizeof(floatType) + sizeof(local_int_t)), nc
+    };
 #ifdef LGNCG_TASKING
     //
     TaskLauncher tl(
         RESTRICTION_TID,
-        TaskArgument(NULL, 0)
+        TaskArgument(&cost, sizeof(cost))
     );
     //
     A.mgData->Axf->intent        (RO_E, tl, ctx, lrt);
@@ -112,6 +118,7 @@ ComputeRestriction(
     lrt->execute_task(ctx, tl);
     return 0;
 #else
+    KernelTimer timer(KP_RESTRICTION, cost, ctx, lrt);
     return ComputeRestrictionKernel(
                *A.mgData->Axf,
                *A.mgData->f2cOperator,
@@ -131,6 +138,7 @@ ComputeRestrictionTask(
     Context ctx,
     Runtime *lrt
 ) {
+    KernelTimer timer(KP_RESTRICTION, *(KernelCost *)task->args, ctx, lrt);
     //
     int rid = 0;
     Array<floatType>   Axf (regions[rid++], ctx, lrt);
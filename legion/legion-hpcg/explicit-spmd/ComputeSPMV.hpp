@@ -43,10 +43,12 @@
 #pragma once
 
 #include <cassert>
+#include <algorithm>
 
 #include "LegionArrays.hpp"
 #include "LegionMatrices.hpp"
 #include "ExchangeHalo.hpp"
+#include "KernelProfile.hpp"
 
 /**
  *
@@ -55,6 +57,30 @@ struct ComputeSPMVArgs {
     local_int_t localNumberOfColumns;
     local_int_t localNumberOfRows;
     int stencilSize;
+    // Number of threads used by the SELL-C-sigma kernel.
+    int numThreads;
+    // Whether the SELL-C-sigma regions replace the row-major ones.
+    bool useSell;
+    // Number of SELL slices (only valid if useSell).
+    local_int_t nSlices;
+    // Whether mgMatrixValues (mgFloatType) replaces matrixValues.
+    bool mixedPrecision;
+    // Whether the matrix-free operator (StencilOperator) replaces the matrix.
+    // Its interior rows of color c are haloSplitRows[interiorColorOffsets[c]
+    // .. interiorColorOffsets[c + 1]) (all of [0, nInteriorRows) if the rows
+    // are not colored).
+    bool useStencil;
+    StencilGrid grid;
+    local_int_t nInteriorRows;
+    local_int_t interiorColorOffsets[HPCG_STENCIL + 1];
+    // Rows computed by this launch (HaloRows). Unless HALO_ROWS_ALL, they are
+    // haloSplitRows[rowBegin .. rowEnd) and a haloSplitRows region follows the
+    // matrix regions.
+    int haloRows;
+    local_int_t rowBegin;
+    local_int_t rowEnd;
+    // Set by ComputeSPMVLaunch.
+    KernelCost cost;
 };
 
 /*!
@@ -64,22 +90,32 @@ struct ComputeSPMVArgs {
     @param[in]  A the known system matrix
     @param[in]  x the known vector
     @param[out] y the On exit contains the result: Ax.
+    @param[in]  haloSplitRows If not null, only rows
+                haloSplitRows[args.rowBegin .. args.rowEnd) are computed. For
+                interior rows, x only needs to hold the local entries.
+
+    Matrix values may be stored in a lower precision (VTYPE) than the vectors;
+    products are accumulated in double either way.
 
     @return returns 0 upon success and non-zero otherwise
 
     @see ComputeSPMV
 */
+template <typename VTYPE>
 inline int
 ComputeSPMVKernel(
-    Array<floatType>      &matrixValues,
-    Array<local_int_t>    &mtxIndL,
-    Array<char>           &nonzerosInRow,
-    Array<floatType>      &x,
-    Array<floatType>      &y,
-    const ComputeSPMVArgs &args
+    Array<VTYPE>             &matrixValues,
+    Array<local_int_t>       &mtxIndL,
+    Array<char>              &nonzerosInRow,
+    Array<floatType>         &x,
+    Array<floatType>         &y,
+    const ComputeSPMVArgs    &args,
+    const Array<local_int_t> *haloSplitRows = nullptr
 ) {
     // Test vector lengths
-    assert(x.length() >= size_t(args.localNumberOfColumns));
+    assert(x.length() >= size_t(args.haloRows == HALO_ROWS_INTERIOR
+                                ? args.localNumberOfRows
+                                : args.localNumberOfColumns));
     assert(y.length() >= size_t(args.localNumberOfRows));
     //
     const floatType *const xv = x.data();
@@ -89,15 +125,21 @@ ComputeSPMVKernel(
     // Number of non-zeros per row.
     const local_int_t nzpr    = args.stencilSize;
     //
-    Array2D<floatType> AmatrixValues(nrow, nzpr, matrixValues.data());
+    Array2D<VTYPE> AmatrixValues(nrow, nzpr, matrixValues.data());
     //
     Array2D<local_int_t> AmtxIndL(nrow, nzpr, mtxIndL.data());
     //
     const char *const AnonzerosInRow = nonzerosInRow.data();
     //
-    for (local_int_t i = 0; i < nrow; i++) {
+    const local_int_t *const rows = haloSplitRows ? haloSplitRows->data()
+                                                  : nullptr;
+    const local_int_t first = rows ? args.rowBegin : 0;
+    const local_int_t last  = rows ? args.rowEnd   : nrow;
+    //
+    for (local_int_t k = first; k < last; k++) {
+        const local_int_t i = rows ? rows[k] : k;
         double sum = 0.0;
-        const floatType *const cur_vals = AmatrixValues(i);
+        const VTYPE *const cur_vals = AmatrixValues(i);
         const local_int_t *const cur_inds = AmtxIndL(i);
         const int cur_nnz = AnonzerosInRow[i];
         //
@@ -110,25 +152,170 @@ ComputeSPMVKernel(
     return 0;
 }
 
+/*!
+    SELL-C-sigma variant of ComputeSPMVKernel. Each slice computes
+    LGNCG_SELL_C rows at once with gathers of x (see GetSellSliceDot).
+
+    @see ComputeSPMVKernel
+    @see SetupSellMatrix
+*/
+inline int
+ComputeSPMVSellKernel(
+    const Array<floatType>   &sellValues,
+    const Array<local_int_t> &sellColInds,
+    const Array<local_int_t> &sellSliceOffsets,
+    const Array<local_int_t> &sellRows,
+    Array<floatType>         &x,
+    Array<floatType>         &y,
+    const ComputeSPMVArgs    &args
+) {
+    // Test vector lengths
+    assert(x.length() >= size_t(args.localNumberOfColumns));
+    assert(y.length() >= size_t(args.localNumberOfRows));
+    //
+    const floatType *const xv = x.data();
+    floatType *const yv       = y.data();
+    //
+    const floatType *const values = sellValues.data();
+    const local_int_t *const colInds = sellColInds.data();
+    const local_int_t *const sliceOffsets = sellSliceOffsets.data();
+    const local_int_t *const rows = sellRows.data();
+    assert(values && colInds && sliceOffsets && rows);
+    //
+    const local_int_t nSlices = args.nSlices;
+    const int nThreads = args.numThreads > 0 ? args.numThreads : 1;
+    const SellSliceDotFn sliceDot = GetSellSliceDot().fn;
+    //
+    #pragma omp parallel for num_threads(nThreads) schedule(static)
+    for (local_int_t sl = 0; sl < nSlices; ++sl) {
+        const local_int_t off = sliceOffsets[sl];
+        const local_int_t width = (sliceOffsets[sl + 1] - off) / LGNCG_SELL_C;
+        floatType sums[LGNCG_SELL_C];
+        sliceDot(values + off, colInds + off, width, xv, sums);
+        //
+        const local_int_t *const sliceRows = rows + sl * LGNCG_SELL_C;
+        for (int l = 0; l < LGNCG_SELL_C; ++l) {
+            if (sliceRows[l] >= 0) yv[sliceRows[l]] = sums[l];
+        }
+    }
+    //
+    return 0;
+}
+
+/*!
+    Matrix-free variant of ComputeSPMVKernel (see StencilOperator). Which rows
+    are computed follows args.haloRows; interior rows only read x's private
+    entries.
+
+    @see ComputeSPMVKernel
+    @see SetupStencilOperator
+*/
+inline int
+ComputeSPMVStencilKernel(
+    const Array<floatType>   &matrixDiagonal,
+    const Array<local_int_t> &boundaryColInds,
+    const Array<char>        &boundaryNnz,
+    const Array<local_int_t> &haloSplitRows,
+    Array<floatType>         &x,
+    Array<floatType>         &y,
+    const ComputeSPMVArgs    &args
+) {
+    // Test vector lengths
+    assert(x.length() >= size_t(args.haloRows == HALO_ROWS_INTERIOR
+                                ? args.localNumberOfRows
+                                : args.localNumberOfColumns));
+    assert(y.length() >= size_t(args.localNumberOfRows));
+    //
+    const floatType *const xv = x.data();
+    floatType *const yv       = y.data();
+    //
+    const floatType *const diag = matrixDiagonal.data();
+    const local_int_t *const bcols = boundaryColInds.data();
+    const char *const bnnz = boundaryNnz.data();
+    const local_int_t *const rows = haloSplitRows.data();
+    assert(diag && bcols && bnnz && rows);
+    //
+    const StencilGrid &g = args.grid;
+    const int nThreads = args.numThreads > 0 ? args.numThreads : 1;
+    //
+    if (args.haloRows != HALO_ROWS_BOUNDARY) {
+        const int nColors = g.colored ? g.nColors : 1;
+        for (int c = 0; c < nColors; ++c) {
+            const local_int_t first = g.colored ? args.interiorColorOffsets[c]
+                                                : 0;
+            const local_int_t last  = g.colored
+                                    ? args.interiorColorOffsets[c + 1]
+                                    : args.nInteriorRows;
+            #pragma omp parallel for num_threads(nThreads) schedule(static)
+            for (local_int_t k = first; k < last; ++k) {
+                const local_int_t i = rows[k];
+                yv[i] = diag[i] * xv[i]
+                      - StencilInteriorNeighborSum(g, c, i, xv);
+            }
+        }
+    }
+    if (args.haloRows != HALO_ROWS_INTERIOR) {
+        const local_int_t nb = args.localNumberOfRows - args.nInteriorRows;
+        #pragma omp parallel for num_threads(nThreads) schedule(static)
+        for (local_int_t b = 0; b < nb; ++b) {
+            const local_int_t i = rows[args.nInteriorRows + b];
+            yv[i] = diag[i] * xv[i]
+                  - StencilBoundaryNeighborSum(
+                        i, bcols + b * HPCG_STENCIL, bnnz[b], xv
+                    );
+        }
+    }
+    //
+    return 0;
+}
+
 /**
- *
+ * Modeled work of the rows computed by args: the values and column indices of
+ * their nonzeros (the matrix-free operator reads the diagonal instead), x
+ * once, and y.
+ */
+inline KernelCost
+SPMVCost(
+    SparseMatrix &A,
+    const ComputeSPMVArgs &args
+) {
+    const SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    const double nrow = Asclrs->localNumberOfRows;
+    double rows = nrow;
+    if (args.haloRows == HALO_ROWS_INTERIOR) {
+        rows = A.nInteriorRows;
+    }
+    else if (args.haloRows == HALO_ROWS_BOUNDARY) {
+        rows = nrow - A.nInteriorRows;
+    }
+    const double nnz = double(Asclrs->localNumberOfNonzeros) * rows / nrow;
+    const double valueSize = args.mixedPrecision ? sizeof(mgFloatType)
+                                                 : sizeof(floatType);
+    double bytes = 2.0 * rows * sizeof(floatType);
+    if (args.useStencil) {
+        bytes += rows * sizeof(floatType);
+    }
+    else {
+        bytes += nnz * (valueSize + sizeof(local_int_t));
+    }
+    return KernelCost {A.level, bytes, 2.0 * nnz};
+}
+
+/**
+ * Launches (or runs) the SpMV kernel selected by args.
  */
 inline int
-ComputeSPMV(
+ComputeSPMVLaunch(
     SparseMatrix &A,
     Array<floatType> &x,
     Array<floatType> &y,
+    ComputeSPMVArgs args,
     Context ctx,
     Runtime *lrt
 ) {
-    ExchangeHalo(A, x, ctx, lrt);
-    //
-    const ComputeSPMVArgs args = {
-        .localNumberOfColumns = A.sclrs->data()->localNumberOfColumns,
-        .localNumberOfRows    = A.sclrs->data()->localNumberOfRows,
-        .stencilSize          = A.geom->data()->stencilSize
-    };
-    //
+    const bool useSell = args.useSell;
+    const bool split = (args.haloRows != HALO_ROWS_ALL);
+    args.cost = SPMVCost(A, args);
 #ifdef LGNCG_TASKING
     //
     TaskLauncher tl(
@@ -136,29 +323,195 @@ ComputeSPMV(
         TaskArgument(&args, sizeof(args))
     );
     //
-    A.matrixValues->intent(RO_E, tl, ctx, lrt);
-    A.mtxIndL->intent(RO_E, tl, ctx, lrt);
-    A.nonzerosInRow->intent(RO_E, tl, ctx, lrt);
-    //
-    x.intent(RO_E, tl, ctx, lrt);
+    if (args.useStencil) {
+        A.matrixDiagonal->intent(RO_E, tl, ctx, lrt);
+        A.stencil->boundaryColInds->intent(RO_E, tl, ctx, lrt);
+        A.stencil->boundaryNnz->intent(RO_E, tl, ctx, lrt);
+        A.haloSplitRows->intent(RO_E, tl, ctx, lrt);
+    }
+    else if (useSell) {
+        A.sell->values->intent(RO_E, tl, ctx, lrt);
+        A.sell->colInds->intent(RO_E, tl, ctx, lrt);
+        A.sell->sliceOffsets->intent(RO_E, tl, ctx, lrt);
+        A.sell->rows->intent(RO_E, tl, ctx, lrt);
+    }
+    else {
+        if (args.mixedPrecision) {
+            A.mgMatrixValues->intent(RO_E, tl, ctx, lrt);
+        }
+        else {
+            A.matrixValues->intent(RO_E, tl, ctx, lrt);
+        }
+        A.mtxIndL->intent(RO_E, tl, ctx, lrt);
+        A.nonzerosInRow->intent(RO_E, tl, ctx, lrt);
+    }
+    if (split && !args.useStencil) {
+        A.haloSplitRows->intent(RO_E, tl, ctx, lrt);
+    }
     //
-    y.intent(WO_E, tl, ctx, lrt);
+    if (args.haloRows == HALO_ROWS_INTERIOR) {
+        RegionRequirement xrr(
+            GetPrivateLogicalRegion(x, ctx, lrt), RO_E, x.logicalRegion
+        );
+        tl.add_region_requirement(xrr).add_field(x.fid);
+    }
+    else {
+        x.intent(RO_E, tl, ctx, lrt);
+    }
+    // The boundary rows are written after the interior ones.
+    if (args.haloRows == HALO_ROWS_BOUNDARY) {
+        y.intent(RW_E, tl, ctx, lrt);
+    }
+    else {
+        y.intent(WO_E, tl, ctx, lrt);
+    }
     //
     lrt->execute_task(ctx, tl);
     //
     return 0;
 #else
+    KernelTimer timer(KP_SPMV, args.cost, ctx, lrt);
+    if (args.useStencil) {
+        return ComputeSPMVStencilKernel(
+                   *A.matrixDiagonal,
+                   *A.stencil->boundaryColInds,
+                   *A.stencil->boundaryNnz,
+                   *A.haloSplitRows,
+                   x,
+                   y,
+                   args
+               );
+    }
+    if (useSell) {
+        return ComputeSPMVSellKernel(
+                   *A.sell->values,
+                   *A.sell->colInds,
+                   *A.sell->sliceOffsets,
+                   *A.sell->rows,
+                   x,
+                   y,
+                   args
+               );
+    }
+    if (args.mixedPrecision) {
+        return ComputeSPMVKernel(
+                   *A.mgMatrixValues,
+                   *A.mtxIndL,
+                   *A.nonzerosInRow,
+                   x,
+                   y,
+                   args,
+                   split ? A.haloSplitRows : nullptr
+               );
+    }
     return ComputeSPMVKernel(
                *A.matrixValues,
                *A.mtxIndL,
                *A.nonzerosInRow,
                x,
                y,
-               args
+               args,
+               split ? A.haloSplitRows : nullptr
            );
 #endif
 }
 
+/**
+ * If mixedPrecision and A has reduced-precision copies (SetupMixedPrecisionMG),
+ * the product uses those instead of matrixValues.
+ */
+inline int
+ComputeSPMV(
+    SparseMatrix &A,
+    Array<floatType> &x,
+    Array<floatType> &y,
+    Context ctx,
+    Runtime *lrt,
+    bool mixedPrecision = false
+) {
+    ExchangeHalo(A, x, ctx, lrt);
+    //
+    const bool useStencil = A.isMatrixFree && A.stencil;
+    // The matrix-free operator has no values to store in a lower precision.
+    mixedPrecision = mixedPrecision && A.mgMatrixValues && !useStencil;
+    // The SELL slices only hold full-precision values.
+    const bool useSell = A.isSpmvOptimized && A.sell && !mixedPrecision
+                      && !useStencil;
+    ComputeSPMVArgs args = {
+        .localNumberOfColumns = A.sclrs->data()->localNumberOfColumns,
+        .localNumberOfRows    = A.sclrs->data()->localNumberOfRows,
+        .stencilSize          = A.geom->data()->stencilSize,
+        .numThreads           = A.geom->data()->numThreads,
+        .useSell              = useSell,
+        .nSlices              = useSell ? A.sell->nSlices : 0,
+        .mixedPrecision       = mixedPrecision,
+        .useStencil           = useStencil,
+        .grid                 = useStencil ? A.stencil->grid : StencilGrid(),
+        .nInteriorRows        = A.nInteriorRows,
+        .interiorColorOffsets = {0},
+        .haloRows             = HALO_ROWS_ALL,
+        .rowBegin             = 0,
+        .rowEnd               = 0
+    };
+    if (useStencil) {
+        std::copy(
+            A.interiorColorOffsets, A.interiorColorOffsets + HPCG_STENCIL + 1,
+            args.interiorColorOffsets
+        );
+        // Both halves read the row split.
+        if (UseHaloSplit(A, x)) {
+            args.haloRows = HALO_ROWS_INTERIOR;
+            ComputeSPMVLaunch(A, x, y, args, ctx, lrt);
+            //
+            args.haloRows = HALO_ROWS_BOUNDARY;
+        }
+        return ComputeSPMVLaunch(A, x, y, args, ctx, lrt);
+    }
+    // Interior rows only read x's private entries, so they do not wait for
+    // the halo copies issued above. The SELL slices are not split.
+    if (!useSell && UseHaloSplit(A, x)) {
+        args.haloRows = HALO_ROWS_INTERIOR;
+        args.rowBegin = 0;
+        args.rowEnd   = A.nInteriorRows;
+        ComputeSPMVLaunch(A, x, y, args, ctx, lrt);
+        //
+        args.haloRows = HALO_ROWS_BOUNDARY;
+        args.rowBegin = A.nInteriorRows;
+        args.rowEnd   = args.localNumberOfRows;
+    }
+    return ComputeSPMVLaunch(A, x, y, args, ctx, lrt);
+}
+
+/**
+ * Unpacks the row-major regions (starting at rid) and runs ComputeSPMVKernel.
+ */
+template <typename VTYPE>
+inline void
+ComputeSPMVRowMajorTask(
+    const std::vector<PhysicalRegion> &regions,
+    int rid,
+    const ComputeSPMVArgs &args,
+    Context ctx,
+    Runtime *lrt
+) {
+    Array<VTYPE> matrixValues(regions[rid++], ctx, lrt);
+    Array<local_int_t> mtxIndL(regions[rid++], ctx, lrt);
+    Array<char> nonzerosInRow(regions[rid++], ctx, lrt);
+    //
+    Array<local_int_t> *haloSplitRows = nullptr;
+    if (args.haloRows != HALO_ROWS_ALL) {
+        haloSplitRows = new Array<local_int_t>(regions[rid++], ctx, lrt);
+    }
+    //
+    Array<floatType> x(regions[rid++], ctx, lrt);
+    Array<floatType> y(regions[rid++], ctx, lrt);
+    //
+    ComputeSPMVKernel(
+        matrixValues, mtxIndL, nonzerosInRow, x, y, args, haloSplitRows
+    );
+    delete haloSplitRows;
+}
+
 /**
  *
  */
@@ -170,16 +523,44 @@ ComputeSPMVTask(
     Runtime *lrt
 ) {
     const auto *const args = (ComputeSPMVArgs *)task->args;
+    KernelTimer timer(KP_SPMV, args->cost, ctx, lrt);
     //
     int rid = 0;
-    Array<floatType> matrixValues(regions[rid++], ctx, lrt);
-    Array<local_int_t> mtxIndL(regions[rid++], ctx, lrt);
-    Array<char> nonzerosInRow(regions[rid++], ctx, lrt);
-    //
-    Array<floatType> x(regions[rid++], ctx, lrt);
-    Array<floatType> y(regions[rid++], ctx, lrt);
-    //
-    ComputeSPMVKernel(matrixValues, mtxIndL, nonzerosInRow, x, y, *args);
+    if (args->useStencil) {
+        Array<floatType> matrixDiagonal(regions[rid++], ctx, lrt);
+        Array<local_int_t> boundaryColInds(regions[rid++], ctx, lrt);
+        Array<char> boundaryNnz(regions[rid++], ctx, lrt);
+        Array<local_int_t> haloSplitRows(regions[rid++], ctx, lrt);
+        //
+        Array<floatType> x(regions[rid++], ctx, lrt);
+        Array<floatType> y(regions[rid++], ctx, lrt);
+        //
+        ComputeSPMVStencilKernel(
+            matrixDiagonal, boundaryColInds, boundaryNnz, haloSplitRows,
+            x, y, *args
+        );
+        return;
+    }
+    if (args->useSell) {
+        Array<floatType> sellValues(regions[rid++], ctx, lrt);
+        Array<local_int_t> sellColInds(regions[rid++], ctx, lrt);
+        Array<local_int_t> sellSliceOffsets(regions[rid++], ctx, lrt);
+        Array<local_int_t> sellRows(regions[rid++], ctx, lrt);
+        //
+        Array<floatType> x(regions[rid++], ctx, lrt);
+        Array<floatType> y(regions[rid++], ctx, lrt);
+        //
+        ComputeSPMVSellKernel(
+            sellValues, sellColInds, sellSliceOffsets, sellRows, x, y, *args
+        );
+        return;
+    }
+    if (args->mixedPrecision) {
+        ComputeSPMVRowMajorTask<mgFloatType>(regions, rid, *args, ctx, lrt);
+    }
+    else {
+        ComputeSPMVRowMajorTask<floatType>(regions, rid, *args, ctx, lrt);
+    }
 }
 
 /**
@@ -52,6 +52,7 @@
 #include "LegionArrays.hpp"
 #include "LegionMatrices.hpp"
 #include "ExchangeHalo.hpp"
+#include "KernelProfile.hpp"
 
 #include <cassert>
 
@@ -62,8 +63,120 @@ struct ComputeSYMGSArgs {
     local_int_t localNumberOfColumns;
     local_int_t localNumberOfRows;
     int stencilSize;
+    // Number of threads used for the multicolor sweeps.
+    int numThreads;
+    // Number of row colors. Zero selects the sequential (reference) sweeps.
+    int nColors;
+    // Rows of color c are stored contiguously in
+    // [colorOffsets[c], colorOffsets[c + 1]).
+    local_int_t colorOffsets[HPCG_STENCIL + 1];
+    // Whether a naturalOrder region follows x in the region list.
+    bool hasNaturalOrder;
+    // Whether the SELL-C-sigma regions replace the row-major ones.
+    bool useSell;
+    // Whether mgMatrixValues and mgMatrixDiagonal (mgFloatType) replace
+    // matrixValues and matrixDiagonal.
+    bool mixedPrecision;
+    // Whether the matrix-free operator (StencilOperator) replaces the matrix.
+    // Multicolor only; a haloSplitRows region always follows x.
+    bool useStencil;
+    StencilGrid grid;
+    // Slices of color c are [colorSliceOffsets[c], colorSliceOffsets[c + 1]).
+    local_int_t colorSliceOffsets[HPCG_STENCIL + 1];
+    // Multicolor sweeps split around the halo exchange (HaloRows). Unless
+    // HALO_ROWS_ALL, a haloSplitRows region follows x in the region list.
+    int haloRows;
+    local_int_t interiorColorOffsets[HPCG_STENCIL + 1];
+    local_int_t boundaryColorOffsets[HPCG_STENCIL + 1];
+    // Whether x (ghosts included) is zero on entry. The multicolor forward
+    // sweeps then skip the products with entries they have not updated yet.
+    bool zeroGuess;
+    // Set by ComputeSYMGSLaunch.
+    KernelCost cost;
 };
 
+/**
+ * Performs one Gauss-Seidel update of row i. For simplicity we include the
+ * diagonal contribution in the for-j loop, then correct the sum after. Matrix
+ * entries (VTYPE) may be stored in a lower precision than the vectors.
+ */
+template <typename VTYPE>
+inline void
+SYMGSUpdateRow(
+    local_int_t i,
+    Array2D<VTYPE> &matrixValues,
+    Array2D<local_int_t> &mtxIndL,
+    const char *const nonzerosInRow,
+    const VTYPE *const matrixDiagonal,
+    const floatType *const rv,
+    floatType *const xv
+) {
+    const VTYPE *const currentValues = matrixValues(i);
+    const local_int_t *const currentColIndices = mtxIndL(i);
+    const uint8_t currentNumberOfNonzeros = nonzerosInRow[i];
+    const floatType currentDiagonal = matrixDiagonal[i];
+    floatType sum = rv[i]; // RHS value
+    //
+    for (uint8_t j = 0; j < currentNumberOfNonzeros; j++) {
+        const local_int_t curCol = currentColIndices[j];
+        sum -= currentValues[j] * xv[curCol];
+    }
+    // Remove diagonal contribution from previous loop.
+    sum += xv[i] * currentDiagonal;
+    //
+    xv[i] = sum / currentDiagonal;
+}
+
+/**
+ * SYMGSUpdateRow for a forward sweep from a zero x: x is still zero in row i
+ * and in every column from firstZero on (the rows of the current color and
+ * of later ones, and the ghosts), so only the other products are done.
+ */
+template <typename VTYPE>
+inline void
+SYMGSUpdateRowZeroGuess(
+    local_int_t i,
+    local_int_t firstZero,
+    Array2D<VTYPE> &matrixValues,
+    Array2D<local_int_t> &mtxIndL,
+    const char *const nonzerosInRow,
+    const VTYPE *const matrixDiagonal,
+    const floatType *const rv,
+    floatType *const xv
+) {
+    const VTYPE *const currentValues = matrixValues(i);
+    const local_int_t *const currentColIndices = mtxIndL(i);
+    const uint8_t currentNumberOfNonzeros = nonzerosInRow[i];
+    floatType sum = rv[i]; // RHS value
+    // Nothing has been updated before the first color.
+    if (firstZero > 0) {
+        for (uint8_t j = 0; j < currentNumberOfNonzeros; j++) {
+            const local_int_t curCol = currentColIndices[j];
+            if (curCol < firstZero) sum -= currentValues[j] * xv[curCol];
+        }
+    }
+    xv[i] = sum / matrixDiagonal[i];
+}
+
+/**
+ * Forward-sweep update of the rows [first, last) of the first color from a
+ * zero x: all their neighbors are still zero, so x = r / diag.
+ */
+inline void
+SYMGSFirstColorZeroGuess(
+    local_int_t first,
+    local_int_t last,
+    const floatType *const matrixDiagonal,
+    const floatType *const rv,
+    floatType *const xv,
+    int nThreads
+) {
+    #pragma omp parallel for num_threads(nThreads) schedule(static)
+    for (local_int_t i = first; i < last; i++) {
+        xv[i] = rv[i] / matrixDiagonal[i];
+    }
+}
+
 /*!
     Computes one step of symmetric Gauss-Seidel:
 
@@ -79,10 +192,12 @@ struct ComputeSYMGSArgs {
     - We use the input vector x as the RHS and start with an initial guess for y
     of all zeros.
     - We perform one forward sweep.  x should be initially zero on the first GS
-      sweep, but we do not attempt to exploit this fact.
+      sweep, but we do not attempt to exploit this fact here (the multicolor
+      kernels do, see ComputeSYMGSArgs::zeroGuess).
     - We then perform one back sweep.
-    - For simplicity we include the diagonal contribution in the for-j loop,
-      then correct the sum after
+    - If OptimizeProblem reordered A, rows are visited in their natural
+      (pre-permutation) order through naturalOrder so that the sweeps match
+      the reference ordering exactly.
 
     @param[in] A the known system matrix.
 
@@ -92,6 +207,9 @@ struct ComputeSYMGSArgs {
                   contains the result of one symmetric GS sweep with r as the
                   RHS.
 
+    @param[in] naturalOrder Storage row of each row in natural order (may be
+               null if A has not been reordered).
+
     @warning Early versions of this kernel (Version 1.1 and earlier) had the r
     and x arguments in reverse order, and out of sync with other kernels.
 
@@ -99,15 +217,17 @@ struct ComputeSYMGSArgs {
 
     @see ComputeSYMGS
 */
+template <typename VTYPE>
 inline int
 ComputeSYMGSKernel(
-    Array<floatType>       &AmatrixValues,
-    Array<local_int_t>     &AmtxIndL,
-    const Array<char>      &AnonzerosInRow,
-    const Array<floatType> &AmatrixDiagonal,
-    const Array<floatType> &r,
-    Array<floatType>       &x,
-    const ComputeSYMGSArgs &args
+    Array<VTYPE>             &AmatrixValues,
+    Array<local_int_t>       &AmtxIndL,
+    const Array<char>        &AnonzerosInRow,
+    const Array<VTYPE>       &AmatrixDiagonal,
+    const Array<floatType>   &r,
+    Array<floatType>         &x,
+    const Array<local_int_t> *naturalOrder,
+    const ComputeSYMGSArgs   &args
 ) {
     // Make sure x contain space for halo values.
     assert(x.length() == size_t(args.localNumberOfColumns));
@@ -115,7 +235,90 @@ ComputeSYMGSKernel(
     const local_int_t nrow = args.localNumberOfRows;
     const local_int_t nnpr = args.stencilSize;
     //
-    const floatType *const matrixDiagonal = AmatrixDiagonal.data();
+    const VTYPE *const matrixDiagonal = AmatrixDiagonal.data();
+    assert(matrixDiagonal);
+    //
+    const floatType *const rv = r.data();
+    assert(rv);
+    floatType *const xv = x.data();
+    assert(xv);
+    // Interpreted as 2D array
+    Array2D<VTYPE> matrixValues(
+        nrow, nnpr, AmatrixValues.data()
+    );
+    // Interpreted as 2D array
+    Array2D<local_int_t> mtxIndL(
+        nrow, nnpr, AmtxIndL.data()
+    );
+    const char *const nonzerosInRow = AnonzerosInRow.data();
+    //
+    const local_int_t *const order = naturalOrder ? naturalOrder->data()
+                                                  : nullptr;
+    //
+    for (local_int_t k = 0; k < nrow; k++) {
+        const local_int_t i = order ? order[k] : k;
+        SYMGSUpdateRow(
+            i, matrixValues, mtxIndL, nonzerosInRow, matrixDiagonal, rv, xv
+        );
+    }
+    // Now the back sweep.
+    for (local_int_t k = nrow - 1; k >= 0; k--) {
+        const local_int_t i = order ? order[k] : k;
+        SYMGSUpdateRow(
+            i, matrixValues, mtxIndL, nonzerosInRow, matrixDiagonal, rv, xv
+        );
+    }
+    //
+    return 0;
+}
+
+/*!
+    Multicolor variant of ComputeSYMGSKernel. Rows of the same color do not
+    couple, so each color is updated in parallel. The forward sweep visits
+    colors 0 .. nColors - 1 and the back sweep visits them in reverse, which
+    keeps the smoother symmetric.
+
+    With haloSplitRows, the forward sweep instead visits the interior rows of
+    every color and then the boundary rows of every color (the back sweep is
+    again the exact reverse). The HALO_ROWS_INTERIOR launch only does the
+    interior part of the forward sweep, which needs no ghosts, and the
+    HALO_ROWS_BOUNDARY launch does the rest.
+
+    If args.zeroGuess, the forward sweep only multiplies with the columns of
+    the colors already visited (the rows of a color are stored before those
+    of later colors, and the ghosts come last). With haloSplitRows, only the
+    interior part does so: the boundary rows of a color follow the interior
+    rows of all colors, so they do the full products (x is still zero where
+    it has not been updated, ghosts included).
+
+    @see ComputeSYMGSKernel
+    @see OptimizeProblem
+    @see ClassifyHaloRows
+*/
+template <typename VTYPE>
+inline int
+ComputeSYMGSMulticolorKernel(
+    Array<VTYPE>             &AmatrixValues,
+    Array<local_int_t>       &AmtxIndL,
+    const Array<char>        &AnonzerosInRow,
+    const Array<VTYPE>       &AmatrixDiagonal,
+    const Array<floatType>   &r,
+    Array<floatType>         &x,
+    const ComputeSYMGSArgs   &args,
+    const Array<local_int_t> *haloSplitRows = nullptr
+) {
+    // Make sure x contain space for halo values (or for the local values when
+    // only sweeping interior rows).
+    assert(x.length() == size_t(args.haloRows == HALO_ROWS_INTERIOR
+                                ? args.localNumberOfRows
+                                : args.localNumberOfColumns));
+    //
+    const local_int_t nrow = args.localNumberOfRows;
+    const local_int_t nnpr = args.stencilSize;
+    const int nColors = args.nColors;
+    const int nThreads = args.numThreads > 0 ? args.numThreads : 1;
+    //
+    const VTYPE *const matrixDiagonal = AmatrixDiagonal.data();
     assert(matrixDiagonal);
     //
     const floatType *const rv = r.data();
@@ -123,7 +326,7 @@ ComputeSYMGSKernel(
     floatType *const xv = x.data();
     assert(xv);
     // Interpreted as 2D array
-    Array2D<floatType> matrixValues(
+    Array2D<VTYPE> matrixValues(
         nrow, nnpr, AmatrixValues.data()
     );
     // Interpreted as 2D array
@@ -132,61 +335,371 @@ ComputeSYMGSKernel(
     );
     const char *const nonzerosInRow = AnonzerosInRow.data();
     //
-    for (local_int_t i = 0; i < nrow; i++) {
-        const floatType *const currentValues = matrixValues(i);
-        const local_int_t *const currentColIndices = mtxIndL(i);
-        const uint8_t currentNumberOfNonzeros = nonzerosInRow[i];
-        const floatType currentDiagonal = matrixDiagonal[i];
-        floatType sum = rv[i]; // RHS value
+    if (haloSplitRows) {
+        const local_int_t *const rows = haloSplitRows->data();
+        assert(rows);
         //
-        for (uint8_t j = 0; j < currentNumberOfNonzeros; j++) {
-            const local_int_t curCol = currentColIndices[j];
-            sum -= currentValues[j] * xv[curCol];
-        }
-        // Remove diagonal contribution from previous loop.
-        sum += xv[i] * currentDiagonal;
+        auto sweepRows = [&](local_int_t first, local_int_t last) {
+            #pragma omp parallel for num_threads(nThreads) schedule(static)
+            for (local_int_t k = first; k < last; k++) {
+                SYMGSUpdateRow(
+                    rows[k], matrixValues, mtxIndL,
+                    nonzerosInRow, matrixDiagonal, rv, xv
+                );
+            }
+        };
+        const local_int_t *const io = args.interiorColorOffsets;
+        const local_int_t *const bo = args.boundaryColorOffsets;
         //
-        xv[i] = sum / currentDiagonal;
+        if (args.haloRows == HALO_ROWS_INTERIOR) {
+            for (int c = 0; c < nColors; ++c) {
+                if (!args.zeroGuess) {
+                    sweepRows(io[c], io[c + 1]);
+                    continue;
+                }
+                const local_int_t firstZero = args.colorOffsets[c];
+                #pragma omp parallel for num_threads(nThreads) schedule(static)
+                for (local_int_t k = io[c]; k < io[c + 1]; k++) {
+                    SYMGSUpdateRowZeroGuess(
+                        rows[k], firstZero, matrixValues, mtxIndL,
+                        nonzerosInRow, matrixDiagonal, rv, xv
+                    );
+                }
+            }
+            return 0;
+        }
+        for (int c = 0; c < nColors; ++c) sweepRows(bo[c], bo[c + 1]);
+        // Now the back sweep.
+        for (int c = nColors - 1; c >= 0; --c) sweepRows(bo[c], bo[c + 1]);
+        for (int c = nColors - 1; c >= 0; --c) sweepRows(io[c], io[c + 1]);
+        return 0;
+    }
+    //
+    for (int c = 0; c < nColors; ++c) {
+        const local_int_t first = args.colorOffsets[c];
+        const local_int_t last  = args.colorOffsets[c + 1];
+        if (args.zeroGuess) {
+            #pragma omp parallel for num_threads(nThreads) schedule(static)
+            for (local_int_t i = first; i < last; i++) {
+                SYMGSUpdateRowZeroGuess(
+                    i, first, matrixValues, mtxIndL,
+                    nonzerosInRow, matrixDiagonal, rv, xv
+                );
+            }
+            continue;
+        }
+        #pragma omp parallel for num_threads(nThreads) schedule(static)
+        for (local_int_t i = first; i < last; i++) {
+            SYMGSUpdateRow(
+                i, matrixValues, mtxIndL, nonzerosInRow, matrixDiagonal, rv, xv
+            );
+        }
     }
     // Now the back sweep.
-    for (local_int_t i = nrow - 1; i >= 0; i--) {
-        const floatType *const currentValues = matrixValues(i);
-        const local_int_t *const currentColIndices = mtxIndL(i);
-        const uint8_t currentNumberOfNonzeros = nonzerosInRow[i];
-        const floatType currentDiagonal = matrixDiagonal[i];
-        floatType sum = rv[i]; // RHS value
-        //
-        for (uint8_t j = 0; j < currentNumberOfNonzeros; j++) {
-            const local_int_t curCol = currentColIndices[j];
-            sum -= currentValues[j] * xv[curCol];
+    for (int c = nColors - 1; c >= 0; --c) {
+        const local_int_t first = args.colorOffsets[c];
+        const local_int_t last  = args.colorOffsets[c + 1];
+        #pragma omp parallel for num_threads(nThreads) schedule(static)
+        for (local_int_t i = first; i < last; i++) {
+            SYMGSUpdateRow(
+                i, matrixValues, mtxIndL, nonzerosInRow, matrixDiagonal, rv, xv
+            );
+        }
+    }
+    //
+    return 0;
+}
+
+/*!
+    SELL-C-sigma variant of ComputeSYMGSMulticolorKernel. The slices of a
+    color only hold rows of that color, so all lanes of a slice are updated at
+    once from one vectorized slice product (see GetSellSliceDot). If
+    args.zeroGuess, the first color of the forward sweep is x = r / diag.
+
+    @see ComputeSYMGSMulticolorKernel
+    @see SetupSellMatrix
+*/
+inline int
+ComputeSYMGSSellKernel(
+    const Array<floatType>   &sellValues,
+    const Array<local_int_t> &sellColInds,
+    const Array<local_int_t> &sellSliceOffsets,
+    const Array<local_int_t> &sellRows,
+    const Array<floatType>   &AmatrixDiagonal,
+    const Array<floatType>   &r,
+    Array<floatType>         &x,
+    const ComputeSYMGSArgs   &args
+) {
+    // Make sure x contain space for halo values.
+    assert(x.length() == size_t(args.localNumberOfColumns));
+    //
+    const int nColors = args.nColors;
+    const int nThreads = args.numThreads > 0 ? args.numThreads : 1;
+    //
+    const floatType *const matrixDiagonal = AmatrixDiagonal.data();
+    assert(matrixDiagonal);
+    const floatType *const rv = r.data();
+    assert(rv);
+    floatType *const xv = x.data();
+    assert(xv);
+    //
+    const floatType *const values = sellValues.data();
+    const local_int_t *const colInds = sellColInds.data();
+    const local_int_t *const sliceOffsets = sellSliceOffsets.data();
+    const local_int_t *const rows = sellRows.data();
+    assert(values && colInds && sliceOffsets && rows);
+    const SellSliceDotFn sliceDot = GetSellSliceDot().fn;
+    //
+    auto sweepColor = [&](int c) {
+        const local_int_t first = args.colorSliceOffsets[c];
+        const local_int_t last  = args.colorSliceOffsets[c + 1];
+        #pragma omp parallel for num_threads(nThreads) schedule(static)
+        for (local_int_t sl = first; sl < last; ++sl) {
+            const local_int_t off = sliceOffsets[sl];
+            const local_int_t width = (sliceOffsets[sl + 1] - off)
+                                    / LGNCG_SELL_C;
+            floatType sums[LGNCG_SELL_C];
+            sliceDot(values + off, colInds + off, width, xv, sums);
+            //
+            const local_int_t *const sliceRows = rows + sl * LGNCG_SELL_C;
+            for (int l = 0; l < LGNCG_SELL_C; ++l) {
+                const local_int_t i = sliceRows[l];
+                if (i < 0) continue;
+                const floatType currentDiagonal = matrixDiagonal[i];
+                // Remove diagonal contribution from the slice product.
+                xv[i] = (rv[i] - sums[l] + xv[i] * currentDiagonal)
+                      / currentDiagonal;
+            }
+        }
+    };
+    for (int c = 0; c < nColors; ++c) {
+        if (args.zeroGuess && c == 0) {
+            SYMGSFirstColorZeroGuess(
+                args.colorOffsets[0], args.colorOffsets[1],
+                matrixDiagonal, rv, xv, nThreads
+            );
+            continue;
         }
-        // Remove diagonal contribution from previous loop.
-        sum += xv[i] * currentDiagonal;
-        xv[i] = sum / currentDiagonal;
+        sweepColor(c);
+    }
+    // Now the back sweep.
+    for (int c = nColors - 1; c >= 0; --c) sweepColor(c);
+    //
+    return 0;
+}
+
+/*!
+    Matrix-free variant of ComputeSYMGSMulticolorKernel (see
+    StencilOperator). Colors are swept in the same order. Within a color, the
+    interior rows (computed from the grid) and the boundary rows (explicit
+    columns) do not couple, so sweeping them one after the other gives the
+    same result as the row-major kernel. The HALO_ROWS_INTERIOR and
+    HALO_ROWS_BOUNDARY launches split the sweeps like that kernel does. If
+    args.zeroGuess, the first color (with the split, its interior rows) of
+    the forward sweep is x = r / diag.
+
+    @see ComputeSYMGSMulticolorKernel
+    @see SetupStencilOperator
+*/
+inline int
+ComputeSYMGSStencilKernel(
+    const Array<local_int_t> &boundaryColInds,
+    const Array<char>        &boundaryNnz,
+    const Array<floatType>   &AmatrixDiagonal,
+    const Array<floatType>   &r,
+    Array<floatType>         &x,
+    const Array<local_int_t> &haloSplitRows,
+    const ComputeSYMGSArgs   &args
+) {
+    // Make sure x contain space for halo values (or for the local values when
+    // only sweeping interior rows).
+    assert(x.length() == size_t(args.haloRows == HALO_ROWS_INTERIOR
+                                ? args.localNumberOfRows
+                                : args.localNumberOfColumns));
+    //
+    const int nColors = args.nColors;
+    const int nThreads = args.numThreads > 0 ? args.numThreads : 1;
+    //
+    const floatType *const matrixDiagonal = AmatrixDiagonal.data();
+    assert(matrixDiagonal);
+    const floatType *const rv = r.data();
+    assert(rv);
+    floatType *const xv = x.data();
+    assert(xv);
+    //
+    const local_int_t *const bcols = boundaryColInds.data();
+    const char *const bnnz = boundaryNnz.data();
+    const local_int_t *const rows = haloSplitRows.data();
+    assert(bcols && bnnz && rows);
+    //
+    const StencilGrid &g = args.grid;
+    const local_int_t *const io = args.interiorColorOffsets;
+    const local_int_t *const bo = args.boundaryColorOffsets;
+    // Boundary rows follow the interior ones.
+    const local_int_t nInterior = bo[0];
+    //
+    auto sweepInterior = [&](int c) {
+        #pragma omp parallel for num_threads(nThreads) schedule(static)
+        for (local_int_t k = io[c]; k < io[c + 1]; ++k) {
+            const local_int_t i = rows[k];
+            xv[i] = (rv[i] + StencilInteriorNeighborSum(g, c, i, xv))
+                  / matrixDiagonal[i];
+        }
+    };
+    auto sweepBoundary = [&](int c) {
+        #pragma omp parallel for num_threads(nThreads) schedule(static)
+        for (local_int_t k = bo[c]; k < bo[c + 1]; ++k) {
+            const local_int_t i = rows[k];
+            const local_int_t b = k - nInterior;
+            xv[i] = (rv[i] + StencilBoundaryNeighborSum(
+                                 i, bcols + b * HPCG_STENCIL, bnnz[b], xv
+                             ))
+                  / matrixDiagonal[i];
+        }
+    };
+    //
+    if (args.haloRows == HALO_ROWS_INTERIOR) {
+        for (int c = 0; c < nColors; ++c) {
+            if (args.zeroGuess && c == 0) {
+                // All neighbors of these rows are still zero.
+                #pragma omp parallel for num_threads(nThreads) schedule(static)
+                for (local_int_t k = io[0]; k < io[1]; ++k) {
+                    const local_int_t i = rows[k];
+                    xv[i] = rv[i] / matrixDiagonal[i];
+                }
+                continue;
+            }
+            sweepInterior(c);
+        }
+        return 0;
+    }
+    if (args.haloRows == HALO_ROWS_BOUNDARY) {
+        for (int c = 0; c < nColors; ++c) sweepBoundary(c);
+        // Now the back sweep.
+        for (int c = nColors - 1; c >= 0; --c) sweepBoundary(c);
+        for (int c = nColors - 1; c >= 0; --c) sweepInterior(c);
+        return 0;
+    }
+    for (int c = 0; c < nColors; ++c) {
+        if (args.zeroGuess && c == 0) {
+            SYMGSFirstColorZeroGuess(
+                args.colorOffsets[0], args.colorOffsets[1],
+                matrixDiagonal, rv, xv, nThreads
+            );
+            continue;
+        }
+        sweepInterior(c);
+        sweepBoundary(c);
+    }
+    // Now the back sweep.
+    for (int c = nColors - 1; c >= 0; --c) {
+        sweepBoundary(c);
+        sweepInterior(c);
     }
     //
     return 0;
 }
 
 /**
- *
+ * Runs the row-major SYMGS kernel selected by args on the given matrix values
+ * and diagonal (full or reduced precision).
  */
+template <typename VTYPE>
 inline int
-ComputeSYMGS(
+ComputeSYMGSRowMajor(
+    Array<VTYPE>             &matrixValues,
+    Array<local_int_t>       &mtxIndL,
+    const Array<char>        &nonzerosInRow,
+    const Array<VTYPE>       &matrixDiagonal,
+    const Array<floatType>   &r,
+    Array<floatType>         &x,
+    const Array<local_int_t> *naturalOrder,
+    const Array<local_int_t> *haloSplitRows,
+    const ComputeSYMGSArgs   &args
+) {
+    if (args.nColors > 0) {
+        return ComputeSYMGSMulticolorKernel(
+                   matrixValues,
+                   mtxIndL,
+                   nonzerosInRow,
+                   matrixDiagonal,
+                   r,
+                   x,
+                   args,
+                   haloSplitRows
+               );
+    }
+    return ComputeSYMGSKernel(
+               matrixValues,
+               mtxIndL,
+               nonzerosInRow,
+               matrixDiagonal,
+               r,
+               x,
+               naturalOrder,
+               args
+           );
+}
+
+/**
+ * Modeled work of the row updates done by args: both sweeps over all rows,
+ * unless split (the interior launch does the forward sweep of the interior
+ * rows, the boundary launch the rest). Every update reads the row's nonzeros
+ * and column indices (unless matrix-free), the diagonal, r, and x.
+ */
+inline KernelCost
+SYMGSCost(
+    SparseMatrix &A,
+    const ComputeSYMGSArgs &args
+) {
+    const SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    const double nrow = Asclrs->localNumberOfRows;
+    double rows = 2.0 * nrow;
+    if (args.haloRows == HALO_ROWS_INTERIOR) {
+        rows = A.nInteriorRows;
+    }
+    else if (args.haloRows == HALO_ROWS_BOUNDARY) {
+        rows = 2.0 * nrow - A.nInteriorRows;
+    }
+    const double nnz = double(Asclrs->localNumberOfNonzeros) * rows / nrow;
+    const double valueSize = args.mixedPrecision ? sizeof(mgFloatType)
+                                                 : sizeof(floatType);
+    double bytes = rows * (valueSize + 2.0 * sizeof(floatType));
+    if (!args.useStencil) {
+        bytes += nnz * (valueSize + sizeof(local_int_t));
+    }
+    // Products skipped by a forward sweep from a zero x: about half of them
+    // in the row-major kernel, those of the first color in the others. With
+    // the split, only the interior launch skips any.
+    double skipped = 0.0;
+    if (args.zeroGuess && args.nColors > 0
+        && args.haloRows != HALO_ROWS_BOUNDARY) {
+        const double nnzPerRow = Asclrs->localNumberOfNonzeros / nrow;
+        const bool interior = (args.haloRows == HALO_ROWS_INTERIOR);
+        const double firstColorRows = interior
+            ? args.interiorColorOffsets[1] - args.interiorColorOffsets[0]
+            : args.colorOffsets[1] - args.colorOffsets[0];
+        skipped = (args.useStencil || args.useSell)
+                ? nnzPerRow * firstColorRows
+                : 0.5 * nnzPerRow * (interior ? A.nInteriorRows : nrow);
+    }
+    return KernelCost {A.level, bytes, 2.0 * (nnz - skipped)};
+}
+
+/**
+ * Launches (or runs) the SYMGS kernel selected by args.
+ */
+inline int
+ComputeSYMGSLaunch(
     SparseMatrix &A,
     Array<floatType> &r,
     Array<floatType> &x,
+    ComputeSYMGSArgs args,
     Context ctx,
     Runtime *lrt
 ) {
-    ExchangeHalo(A, x, ctx, lrt);
-    //
-    const ComputeSYMGSArgs args = {
-        .localNumberOfColumns = A.sclrs->data()->localNumberOfColumns,
-        .localNumberOfRows    = A.sclrs->data()->localNumberOfRows,
-        .stencilSize          = A.geom->data()->stencilSize
-    };
-    //
+    const bool split = (args.haloRows != HALO_ROWS_ALL);
+    args.cost = SYMGSCost(A, args);
 #ifdef LGNCG_TASKING
     //
     TaskLauncher tl(
@@ -194,60 +707,285 @@ ComputeSYMGS(
         TaskArgument(&args, sizeof(args))
     );
     //
-    A.matrixValues->intent  (RO_E, tl, ctx, lrt);
-    A.mtxIndL->intent       (RO_E, tl, ctx, lrt);
-    A.nonzerosInRow->intent (RO_E, tl, ctx, lrt);
-    A.matrixDiagonal->intent(RO_E, tl, ctx, lrt);
+    if (args.useStencil) {
+        A.stencil->boundaryColInds->intent(RO_E, tl, ctx, lrt);
+        A.stencil->boundaryNnz->intent    (RO_E, tl, ctx, lrt);
+    }
+    else if (args.useSell) {
+        A.sell->values->intent      (RO_E, tl, ctx, lrt);
+        A.sell->colInds->intent     (RO_E, tl, ctx, lrt);
+        A.sell->sliceOffsets->intent(RO_E, tl, ctx, lrt);
+        A.sell->rows->intent        (RO_E, tl, ctx, lrt);
+    }
+    else {
+        if (args.mixedPrecision) {
+            A.mgMatrixValues->intent(RO_E, tl, ctx, lrt);
+        }
+        else {
+            A.matrixValues->intent(RO_E, tl, ctx, lrt);
+        }
+        A.mtxIndL->intent       (RO_E, tl, ctx, lrt);
+        A.nonzerosInRow->intent (RO_E, tl, ctx, lrt);
+    }
+    if (args.mixedPrecision) {
+        A.mgMatrixDiagonal->intent(RO_E, tl, ctx, lrt);
+    }
+    else {
+        A.matrixDiagonal->intent(RO_E, tl, ctx, lrt);
+    }
     //
     r.intent(RO_E, tl, ctx, lrt);
-    x.intent(RW_E, tl, ctx, lrt);
+    // The interior sweep only touches x's private entries.
+    if (args.haloRows == HALO_ROWS_INTERIOR) {
+        RegionRequirement xrr(
+            GetPrivateLogicalRegion(x, ctx, lrt), RW_E, x.logicalRegion
+        );
+        tl.add_region_requirement(xrr).add_field(x.fid);
+    }
+    else {
+        x.intent(RW_E, tl, ctx, lrt);
+    }
+    //
+    if (args.hasNaturalOrder) {
+        A.naturalOrder->intent(RO_E, tl, ctx, lrt);
+    }
+    if (split || args.useStencil) {
+        A.haloSplitRows->intent(RO_E, tl, ctx, lrt);
+    }
     //
     lrt->execute_task(ctx, tl);
     //
     return 0;
 #else
-    return ComputeSYMGSKernel(
+    KernelTimer timer(KP_SYMGS, args.cost, ctx, lrt);
+    if (args.useStencil) {
+        return ComputeSYMGSStencilKernel(
+                   *A.stencil->boundaryColInds,
+                   *A.stencil->boundaryNnz,
+                   *A.matrixDiagonal,
+                   r,
+                   x,
+                   *A.haloSplitRows,
+                   args
+               );
+    }
+    if (args.useSell) {
+        return ComputeSYMGSSellKernel(
+                   *A.sell->values,
+                   *A.sell->colInds,
+                   *A.sell->sliceOffsets,
+                   *A.sell->rows,
+                   *A.matrixDiagonal,
+                   r,
+                   x,
+                   args
+               );
+    }
+    const Array<local_int_t> *naturalOrder = args.hasNaturalOrder
+                                           ? A.naturalOrder : nullptr;
+    const Array<local_int_t> *haloSplitRows = split ? A.haloSplitRows
+                                                    : nullptr;
+    if (args.mixedPrecision) {
+        return ComputeSYMGSRowMajor(
+                   *A.mgMatrixValues,
+                   *A.mtxIndL,
+                   *A.nonzerosInRow,
+                   *A.mgMatrixDiagonal,
+                   r,
+                   x,
+                   naturalOrder,
+                   haloSplitRows,
+                   args
+               );
+    }
+    return ComputeSYMGSRowMajor(
                *A.matrixValues,
                *A.mtxIndL,
                *A.nonzerosInRow,
                *A.matrixDiagonal,
                r,
                x,
+               naturalOrder,
+               haloSplitRows,
                args
            );
 #endif
 }
 
 /**
- *
+ * If mixedPrecision and A has reduced-precision copies (SetupMixedPrecisionMG),
+ * the sweeps use those instead of matrixValues and matrixDiagonal. If
+ * zeroInitialGuess, x must have been zeroed by every shard (as ComputeMG does
+ * before the first pre-smoother step): the halo exchange is skipped.
  */
-void
-ComputeSYMGSTask(
-    const Task *task,
+inline int
+ComputeSYMGS(
+    SparseMatrix &A,
+    Array<floatType> &r,
+    Array<floatType> &x,
+    Context ctx,
+    Runtime *lrt,
+    bool mixedPrecision = false,
+    bool zeroInitialGuess = false
+) {
+    // A zeroed x (ZeroVector clears the ghosts too) already holds what the
+    // exchange would bring, since the neighbors' x are zeroed as well.
+    if (!zeroInitialGuess) ExchangeHalo(A, x, ctx, lrt);
+    //
+    const bool useStencil = A.isMatrixFree && A.stencil && A.isMgOptimized
+                         && A.stencil->grid.nColors == A.nColors;
+    // The matrix-free operator has no values to store in a lower precision,
+    // and the SELL slices only hold full-precision values.
+    mixedPrecision = mixedPrecision && A.mgMatrixValues && !useStencil;
+    ComputeSYMGSArgs args = {
+        .localNumberOfColumns = A.sclrs->data()->localNumberOfColumns,
+        .localNumberOfRows    = A.sclrs->data()->localNumberOfRows,
+        .stencilSize          = A.geom->data()->stencilSize,
+        .numThreads           = A.geom->data()->numThreads,
+        .nColors              = A.isMgOptimized ? A.nColors : 0,
+        .colorOffsets         = {0},
+        .hasNaturalOrder      = !A.isMgOptimized && A.naturalOrder != nullptr,
+        .useSell              = A.isMgOptimized && A.isSpmvOptimized
+                                && A.sell && A.sell->nColors == A.nColors
+                                && !mixedPrecision && !useStencil,
+        .mixedPrecision       = mixedPrecision,
+        .useStencil           = useStencil,
+        .grid                 = useStencil ? A.stencil->grid : StencilGrid(),
+        .colorSliceOffsets    = {0},
+        .haloRows             = HALO_ROWS_ALL,
+        .interiorColorOffsets = {0},
+        .boundaryColorOffsets = {0},
+        .zeroGuess            = zeroInitialGuess
+    };
+    for (int c = 0; c <= args.nColors; ++c) {
+        args.colorOffsets[c] = A.colorOffsets[c];
+        args.interiorColorOffsets[c] = A.interiorColorOffsets[c];
+        args.boundaryColorOffsets[c] = A.boundaryColorOffsets[c];
+        if (args.useSell) {
+            args.colorSliceOffsets[c] = A.sell->colorSliceOffsets[c];
+        }
+    }
+    // The interior part of the forward sweep does not wait for the halo
+    // copies issued above (multicolor row-major sweeps only). From a zero
+    // guess there are no copies to wait for, but the sweeps are still split:
+    // the pre- and post-smoothers of a V-cycle must visit the rows in the
+    // same order to keep the preconditioner symmetric.
+    if (args.nColors > 0 && !args.useSell && UseHaloSplit(A, x)) {
+        args.haloRows = HALO_ROWS_INTERIOR;
+        ComputeSYMGSLaunch(A, r, x, args, ctx, lrt);
+        //
+        args.haloRows = HALO_ROWS_BOUNDARY;
+    }
+    return ComputeSYMGSLaunch(A, r, x, args, ctx, lrt);
+}
+
+/**
+ * Unpacks the row-major regions (starting at rid) and runs
+ * ComputeSYMGSRowMajor.
+ */
+template <typename VTYPE>
+inline void
+ComputeSYMGSRowMajorTask(
     const std::vector<PhysicalRegion> &regions,
+    int rid,
+    const ComputeSYMGSArgs &args,
     Context ctx,
     Runtime *lrt
 ) {
-    const auto *const args = (ComputeSYMGSArgs *)task->args;
-    //
-    int rid = 0;
-    Array<floatType> matrixValues  (regions[rid++], ctx, lrt);
+    Array<VTYPE> matrixValues      (regions[rid++], ctx, lrt);
     Array<local_int_t> mtxIndL     (regions[rid++], ctx, lrt);
     Array<char> nonzerosInRow      (regions[rid++], ctx, lrt);
-    Array<floatType> matrixDiagonal(regions[rid++], ctx, lrt);
+    Array<VTYPE> matrixDiagonal    (regions[rid++], ctx, lrt);
     //
     Array<floatType> r(regions[rid++], ctx, lrt);
     Array<floatType> x(regions[rid++], ctx, lrt);
     //
-    ComputeSYMGSKernel(
+    Array<local_int_t> *naturalOrder = nullptr;
+    if (args.hasNaturalOrder) {
+        naturalOrder = new Array<local_int_t>(regions[rid++], ctx, lrt);
+    }
+    Array<local_int_t> *haloSplitRows = nullptr;
+    if (args.haloRows != HALO_ROWS_ALL) {
+        haloSplitRows = new Array<local_int_t>(regions[rid++], ctx, lrt);
+    }
+    ComputeSYMGSRowMajor(
         matrixValues,
         mtxIndL,
         nonzerosInRow,
         matrixDiagonal,
         r,
         x,
-        *args
+        naturalOrder,
+        haloSplitRows,
+        args
     );
+    delete naturalOrder;
+    delete haloSplitRows;
+}
+
+/**
+ *
+ */
+void
+ComputeSYMGSTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    Runtime *lrt
+) {
+    const auto *const args = (ComputeSYMGSArgs *)task->args;
+    KernelTimer timer(KP_SYMGS, args->cost, ctx, lrt);
+    //
+    int rid = 0;
+    if (args->useStencil) {
+        Array<local_int_t> boundaryColInds(regions[rid++], ctx, lrt);
+        Array<char> boundaryNnz           (regions[rid++], ctx, lrt);
+        Array<floatType> matrixDiagonal   (regions[rid++], ctx, lrt);
+        //
+        Array<floatType> r(regions[rid++], ctx, lrt);
+        Array<floatType> x(regions[rid++], ctx, lrt);
+        //
+        Array<local_int_t> haloSplitRows(regions[rid++], ctx, lrt);
+        //
+        ComputeSYMGSStencilKernel(
+            boundaryColInds,
+            boundaryNnz,
+            matrixDiagonal,
+            r,
+            x,
+            haloSplitRows,
+            *args
+        );
+        return;
+    }
+    if (args->useSell) {
+        Array<floatType> sellValues       (regions[rid++], ctx, lrt);
+        Array<local_int_t> sellColInds    (regions[rid++], ctx, lrt);
+        Array<local_int_t> sellSliceOffsets(regions[rid++], ctx, lrt);
+        Array<local_int_t> sellRows       (regions[rid++], ctx, lrt);
+        Array<floatType> matrixDiagonal   (regions[rid++], ctx, lrt);
+        //
+        Array<floatType> r(regions[rid++], ctx, lrt);
+        Array<floatType> x(regions[rid++], ctx, lrt);
+        //
+        ComputeSYMGSSellKernel(
+            sellValues,
+            sellColInds,
+            sellSliceOffsets,
+            sellRows,
+            matrixDiagonal,
+            r,
+            x,
+            *args
+        );
+        return;
+    }
+    if (args->mixedPrecision) {
+        ComputeSYMGSRowMajorTask<mgFloatType>(regions, rid, *args, ctx, lrt);
+    }
+    else {
+        ComputeSYMGSRowMajorTask<floatType>(regions, rid, *args, ctx, lrt);
+    }
 }
 
 /**
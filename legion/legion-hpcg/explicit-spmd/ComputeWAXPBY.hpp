@@ -49,6 +49,7 @@
 #pragma once
 
 #include "LegionArrays.hpp"
+#include "KernelProfile.hpp"
 
 #include <cassert>
 
@@ -62,8 +63,21 @@ struct ComputeWAXPBYArgs {
     bool xySame;
     bool xwSame;
     bool ywSame;
+    // If set, beta is the first future of the task.
+    bool betaFuture;
 };
 
+/**
+ * Modeled work of a WAXPBY of length n (x and y read, w written; CG vectors
+ * only, so level 0).
+ */
+inline KernelCost
+WAXPBYCost(
+    local_int_t n
+) {
+    return KernelCost {0, 3.0 * n * sizeof(floatType), 2.0 * n};
+}
+
 /*!
     Routine to compute the update of a vector with the sum of two
     scaled vectors where: w = alpha*x + beta*y
@@ -135,7 +149,8 @@ ComputeWAXPBY(
         .beta   = beta,
         .xySame = xySame,
         .xwSame = xwSame,
-        .ywSame = ywSame
+        .ywSame = ywSame,
+        .betaFuture = false
     };
     //
     TaskLauncher tl(
@@ -163,6 +178,70 @@ ComputeWAXPBY(
     lrt->execute_task(ctx, tl);
     return 0;
 #else
+    KernelTimer timer(KP_WAXPBY, WAXPBYCost(n), ctx, lrt);
+    return ComputeWAXPBYKernel(n, alpha, x, beta, y, w);
+#endif
+}
+
+/**
+ * Same as above, but beta is the result of a Future (e.g., from ComputeFuture)
+ * that is handed to the task, so the caller does not block on it.
+ */
+inline int
+ComputeWAXPBY(
+    const local_int_t n,
+    const floatType alpha,
+    Array<floatType> &x,
+    const Future &betaFuture,
+    Array<floatType> &y,
+    Array<floatType> &w,
+    Context ctx,
+    Runtime *lrt
+) {
+#ifdef LGNCG_TASKING
+    const bool xySame = (&x == &y);
+    const bool xwSame = (&x == &w);
+    const bool ywSame = (&y == &w);
+    //
+    ComputeWAXPBYArgs args {
+        .n = n,
+        .alpha  = alpha,
+        .beta   = 0.0,
+        .xySame = xySame,
+        .xwSame = xwSame,
+        .ywSame = ywSame,
+        .betaFuture = true
+    };
+    //
+    TaskLauncher tl(
+        WAXPBY_TID,
+        TaskArgument(&args, sizeof(args))
+    );
+    //
+    tl.add_future(betaFuture);
+    //
+    x.intent(
+        xwSame ? RW : RO,
+        EXCLUSIVE,
+        tl, ctx, lrt
+    );
+    //
+    if (!xySame) {
+        y.intent(
+            ywSame ? RW : RO,
+            EXCLUSIVE,
+            tl, ctx, lrt
+        );
+    }
+    if (!xwSame && !ywSame) {
+        w.intent(WO_E, tl, ctx, lrt);
+    }
+    //
+    lrt->execute_task(ctx, tl);
+    return 0;
+#else
+    const floatType beta = betaFuture.get_result<floatType>(silenceWarnings);
+    KernelTimer timer(KP_WAXPBY, WAXPBYCost(n), ctx, lrt);
     return ComputeWAXPBYKernel(n, alpha, x, beta, y, w);
 #endif
 }
@@ -178,6 +257,7 @@ ComputeWAXPBYTask(
     Runtime *lrt
 ) {
     const auto *const args = (ComputeWAXPBYArgs *)task->args;
+    KernelTimer timer(KP_WAXPBY, WAXPBYCost(args->n), ctx, lrt);
     //
     int xRID = 0;
     int yRID = 1;
@@ -192,7 +272,12 @@ ComputeWAXPBYTask(
     Array<floatType> y(regions[yRID], ctx, lrt);
     Array<floatType> w(regions[wRID], ctx, lrt);
     //
-    ComputeWAXPBYKernel(args->n, args->alpha, x, args->beta, y, w);
+    floatType beta = args->beta;
+    if (args->betaFuture) {
+        beta = task->futures[0].get_result<floatType>(silenceWarnings);
+    }
+    //
+    ComputeWAXPBYKernel(args->n, args->alpha, x, beta, y, w);
 }
 
 /**
@@ -46,7 +46,7 @@
 #include "LegionArrays.hpp"
 #include "VectorOps.hpp"
 #include "LegionMatrices.hpp"
-#include "RegionToRegionCopy.hpp"
+#include "KernelProfile.hpp"
 
 #include <cstdlib>
 
@@ -54,6 +54,98 @@
 #define LGNCG_DO_TASKY_EXCHANGE
 #endif
 
+/**
+ * Rows a kernel launch works on when it is split around the halo exchange
+ * (see ClassifyHaloRows).
+ */
+enum HaloRows {
+    HALO_ROWS_ALL = 0,
+    // Rows that only touch x's private entries: can run during the exchange.
+    HALO_ROWS_INTERIOR,
+    // Everything else: runs once the ghosts have landed.
+    HALO_ROWS_BOUNDARY
+};
+
+/**
+ * Whether kernels on A should overlap their interior rows with the halo
+ * exchange on x.
+ */
+inline bool
+UseHaloSplit(
+    SparseMatrix &A,
+    Array<floatType> &x
+) {
+    return A.haloSplitRows
+        && A.sclrs->data()->numberOfSendNeighbors > 0
+        && x.hasGhosts();
+}
+
+/**
+ * Modeled work of packing a halo exchange on A: every value sent is gathered
+ * (index and value read, unless packed from the grid boxes) and written once
+ * into a pull buffer. The ghost copies are done by the runtime and are not
+ * timed, so they are not counted either.
+ */
+inline KernelCost
+HaloExchangeCost(
+    SparseMatrix &A
+) {
+    const SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    const double nSend = Asclrs->totalToBeSent;
+    return KernelCost {
+        A.level,
+        nSend * (2.0 * sizeof(floatType)
+               + (A.structuredHalo ? 0.0 : sizeof(local_int_t))),
+        0.0
+    };
+}
+
+/**
+ * Issues the copies of the neighbors' pull buffers into x's ghosts as one
+ * copy operation. It waits for every neighbor to have filled its buffer and
+ * tells every neighbor once its buffer has been read.
+ */
+inline void
+IssueHaloCopies(
+    int nNeighbors,
+    const std::vector<LogicalRegion> &srclrs,
+    const std::vector<LogicalRegion> &dstlrs,
+    const std::vector<LogicalRegion> &dstParents,
+    Synchronizers *syncs,
+    Context ctx,
+    Runtime *lrt
+) {
+    // Only ever one field for all of our structures.
+    static const int fid = 0;
+    //
+    CopyLauncher cl;
+    for (int n = 0; n < nNeighbors; ++n) {
+        RegionRequirement srcrr(
+            srclrs[n], RO_E, srclrs[n]
+        );
+        srcrr.add_field(fid);
+        //
+        RegionRequirement dstrr(
+            dstlrs[n], WO_E, dstParents[n]
+        );
+        dstrr.add_field(fid);
+        //
+        cl.add_copy_requirements(srcrr, dstrr);
+        //
+        syncs->neighbors[n].ready = lrt->advance_phase_barrier(
+            ctx, syncs->neighbors[n].ready
+        );
+        cl.add_wait_barrier(syncs->neighbors[n].ready);
+        //
+        cl.add_arrival_barrier(syncs->neighbors[n].done);
+        syncs->neighbors[n].done = lrt->advance_phase_barrier(
+            ctx, syncs->neighbors[n].done
+        );
+    }
+    //
+    lrt->issue_copy_operation(ctx, cl);
+}
+
 #ifdef LGNCG_DO_TASKY_EXCHANGE
 /**
  *
@@ -61,6 +153,10 @@
 struct ExchangeHaloArgs {
     int nTxNeighbors;
     int nRxNeighbors;
+    KernelCost cost;
+    // Whether halo holds the send lists (see SetupStructuredHalo).
+    bool structured;
+    StructuredHalo halo;
 };
 
 /*
@@ -87,7 +183,6 @@ ExchangeHalo(
     const SparseMatrixScalars *const Asclrs = A.sclrs->data();
     const int nTxNeighbors = Asclrs->numberOfSendNeighbors;
     const int nRxNeighbors = Asclrs->numberOfRecvNeighbors;
-    const int *const neighbors = A.neighbors->data();
     // Nothing to do.
     if (nTxNeighbors == 0) return;
     // Make sure that x's ghosts are already setup.
@@ -96,30 +191,22 @@ ExchangeHalo(
     }
     ExchangeHaloArgs args {
         .nTxNeighbors = nTxNeighbors,
-        .nRxNeighbors = nRxNeighbors
+        .nRxNeighbors = nRxNeighbors,
+        .cost         = HaloExchangeCost(A),
+        .structured   = (A.structuredHalo != nullptr)
     };
+    if (args.structured) args.halo = *A.structuredHalo;
     TaskLauncher tl(
         EXCHANGE_HALO_TID,
         TaskArgument(&args, sizeof(args))
     );
-    LogicalRegion xPrivateLR;
-    {
-        auto xis = x.logicalRegion.get_index_space();
-        auto xip = lrt->get_index_partition(ctx, xis, 0 /* color */);
-        auto xlp = lrt->get_logical_partition(ctx, x.logicalRegion, xip);
-        xPrivateLR = lrt->get_logical_subregion_by_color(
-            ctx,
-            xlp,
-            DomainPoint::from_point<1>(0) // First is private.
-        );
-    }
+    LogicalRegion xPrivateLR = GetPrivateLogicalRegion(x, ctx, lrt);
     // x (private partition).
     RegionRequirement xrr(
         xPrivateLR, RO_E, x.logicalRegion
     );
     tl.add_region_requirement(xrr).add_field(x.fid);
     // Matrix pieces.
-    A.neighbors->intent(RO_E, tl, ctx, lrt);
     A.elementsToSend->intent(RO_E, tl, ctx, lrt);
     A.sendLength->intent(RO_E, tl, ctx, lrt);
     A.synchronizers->intent(RW_E, tl, ctx, lrt);
@@ -128,11 +215,9 @@ ExchangeHalo(
         A.pullBuffers[n]->intent(RW_E, tl, ctx, lrt);
     }
     // Pull regions in neighbor order.
+    assert(int(A.pullRegions.size()) == nRxNeighbors);
     for (int n = 0; n < nRxNeighbors; ++n) {
-        const int nid = neighbors[n];
-        auto srcIt = A.nidToPullRegion.find(nid);
-        assert(srcIt != A.nidToPullRegion.end());
-        auto srclr = srcIt->second.get_logical_region();
+        const LogicalRegion &srclr = A.pullRegions[n];
         //
         RegionRequirement srcrr(
             srclr, RO_E, srclr
@@ -173,10 +258,6 @@ ExchangeHaloTask(
     const floatType *const xv = x.data();
     assert(xv);
     // Matrix pieces.
-    Array<int> Aneighbors(regions[rid++], ctx, lrt);
-    const int *const neighbors = Aneighbors.data();
-    assert(neighbors);
-    //
     Array<local_int_t> AelementsToSend(regions[rid++], ctx, lrt);
     const local_int_t *const elementsToSend = AelementsToSend.data();
     assert(elementsToSend);
@@ -190,72 +271,41 @@ ExchangeHaloTask(
     assert(syncs);
     PhaseBarriers &myPBs = syncs->mine;
     //
-    std::vector<Array<floatType> *> ApullBuffers;
-    for (int n = 0; n < nTxNeighbors; ++n) {
-        auto *item = new Array<floatType>(regions[rid++], ctx, lrt);
-        assert(item->data());
-        ApullBuffers.push_back(item);
-    }
-    std::vector<LogicalRegion> srclrs;
-    for (int n = 0; n < nRxNeighbors; ++n) {
-        srclrs.push_back(regions[rid++].get_logical_region());
-    }
-    std::vector<LogicalRegion> dstlrs;
-    for (int n = 0; n < nRxNeighbors; ++n) {
-        dstlrs.push_back(regions[rid++].get_logical_region());
-    }
-    //
     myPBs.done.wait();
     myPBs.done = lrt->advance_phase_barrier(ctx, myPBs.done);
     // Fill up pull buffers (the buffers that neighboring task will pull from).
-    for (int n = 0, txidx = 0; n < nTxNeighbors; ++n) {
-        floatType *const pbd = ApullBuffers[n]->data();
-        //
-        for (int i = 0; i < sendLengthsd[n]; ++i) {
-            pbd[i] = xv[elementsToSend[txidx++]];
+    // Only the packing is timed: not the wait for the neighbors above, nor
+    // issuing the copies below.
+    {
+        KernelTimer timer(KP_HALO, args->cost, ctx, lrt);
+        for (int n = 0, txidx = 0; n < nTxNeighbors; ++n) {
+            Array<floatType> ApullBuffer(regions[rid++], ctx, lrt);
+            floatType *const pbd = ApullBuffer.data();
+            assert(pbd);
+            //
+            if (args->structured) {
+                PackStencilBox(args->halo.grid, args->halo.boxes[n], xv, pbd);
+                continue;
+            }
+            for (int i = 0; i < sendLengthsd[n]; ++i) {
+                pbd[i] = xv[elementsToSend[txidx++]];
+            }
         }
     }
     myPBs.ready.arrive(1);
     myPBs.ready = lrt->advance_phase_barrier(ctx, myPBs.ready);
-    lrt->unmap_all_regions(ctx);
     //
-    for (int n = 0; n < nTxNeighbors; ++n) {
-        static const int fid = 0;
-        // Source region requirement.
-        RegionRequirement srcrr(
-            srclrs[n], RO_E, srclrs[n]
-        );
-        srcrr.add_field(fid);
-        // Destination region requirement.
-        //
-        RegionRequirement dstrr(
-            dstlrs[n], WO_E, dstlrs[n]
-        );
-        dstrr.add_field(fid);
-        //
-        TaskLauncher tl(
-            REGION_TO_REGION_COPY_TID,
-            TaskArgument(NULL, 0)
-        );
-        tl.add_region_requirement(srcrr);
-        tl.add_region_requirement(dstrr);
-        //
-        syncs->neighbors[n].ready = lrt->advance_phase_barrier(
-            ctx, syncs->neighbors[n].ready
-        );
-        tl.add_wait_barrier(syncs->neighbors[n].ready);
-        //
-        tl.add_arrival_barrier(syncs->neighbors[n].done);
-        syncs->neighbors[n].done = lrt->advance_phase_barrier(
-            ctx, syncs->neighbors[n].done
-        );
-        //
-        lrt->execute_task(ctx, tl);
+    std::vector<LogicalRegion> srclrs;
+    for (int n = 0; n < nRxNeighbors; ++n) {
+        srclrs.push_back(regions[rid++].get_logical_region());
     }
-    // Cleanup
-    for (int n = 0; n < nTxNeighbors; ++n) {
-        delete ApullBuffers[n];
+    std::vector<LogicalRegion> dstlrs;
+    for (int n = 0; n < nRxNeighbors; ++n) {
+        dstlrs.push_back(regions[rid++].get_logical_region());
     }
+    lrt->unmap_all_regions(ctx);
+    // The ghosts are this task's own regions.
+    IssueHaloCopies(nTxNeighbors, srclrs, dstlrs, dstlrs, syncs, ctx, lrt);
 }
 #endif
 
@@ -293,7 +343,6 @@ ExchangeHalo(
     // Nothing to do.
     if (nNeighbors == 0) return;
     // Else we have neighbors and data to move around.
-    const int *const neighbors = A.neighbors->data();
     // Non-region memory populated during SetupHalo().
     const local_int_t *const elementsToSend = A.elementsToSend->data();
     assert(elementsToSend);
@@ -311,63 +360,37 @@ ExchangeHalo(
     myPBs.done.wait();
     myPBs.done = lrt->advance_phase_barrier(ctx, myPBs.done);
     // Fill up pull buffers (the buffers that neighboring task will pull from).
+    // Only the packing is timed (see ExchangeHaloTask).
     const local_int_t *const sendLengthsd = A.sendLength->data();
     assert(sendLengthsd);
-    //
-    for (int n = 0, txidx = 0; n < nNeighbors; ++n) {
-        floatType *const pbd = A.pullBuffers[n]->data();
-        assert(pbd);
-        //
-        for (int i = 0; i < sendLengthsd[n]; ++i) {
-            pbd[i] = xv[elementsToSend[txidx++]];
+    {
+        KernelTimer timer(KP_HALO, HaloExchangeCost(A), ctx, lrt);
+        for (int n = 0, txidx = 0; n < nNeighbors; ++n) {
+            floatType *const pbd = A.pullBuffers[n]->data();
+            assert(pbd);
+            //
+            if (const StructuredHalo *halo = A.structuredHalo) {
+                PackStencilBox(halo->grid, halo->boxes[n], xv, pbd);
+                continue;
+            }
+            for (int i = 0; i < sendLengthsd[n]; ++i) {
+                pbd[i] = xv[elementsToSend[txidx++]];
+            }
         }
     }
     myPBs.ready.arrive(1);
     myPBs.ready = lrt->advance_phase_barrier(ctx, myPBs.ready);
-    //
+    // Ghosts of x in neighbor order.
+    std::vector<LogicalRegion> dstlrs, dstParents;
     for (int n = 0; n < nNeighbors; ++n) {
-        //
-        const int nid = neighbors[n];
-        // Source
-        auto srcIt = A.nidToPullRegion.find(nid);
-        assert(srcIt != A.nidToPullRegion.end());
-        auto srclr = srcIt->second.get_logical_region();
-        //
-        RegionRequirement srcrr(
-            srclr, RO_E, srclr
-        );
-        // Only ever one field for all of our structures.
-        static const int srcFid = 0;
-        srcrr.add_field(srcFid);
-        // Destination.
         LogicalArray<floatType> *dstArray = x.ghosts[n];
         assert(dstArray->hasParentLogicalRegion());
-        //
-        RegionRequirement dstrr(
-            dstArray->logicalRegion,
-            WO_E,
-            dstArray->getParentLogicalRegion()
-        );
-        dstrr.add_field(dstArray->fid);
-        //
-        TaskLauncher tl(
-            REGION_TO_REGION_COPY_TID,
-            TaskArgument(NULL, 0)
-        );
-        tl.add_region_requirement(srcrr);
-        tl.add_region_requirement(dstrr);
-        //
-        syncs->neighbors[n].ready = lrt->advance_phase_barrier(
-            ctx, syncs->neighbors[n].ready
-        );
-        tl.add_wait_barrier(syncs->neighbors[n].ready);
-        //
-        tl.add_arrival_barrier(syncs->neighbors[n].done);
-        syncs->neighbors[n].done = lrt->advance_phase_barrier(
-            ctx, syncs->neighbors[n].done
-        );
-        //
-        lrt->execute_task(ctx, tl);
+        dstlrs.push_back(dstArray->logicalRegion);
+        dstParents.push_back(dstArray->getParentLogicalRegion());
     }
+    assert(int(A.pullRegions.size()) == nNeighbors);
+    IssueHaloCopies(
+        nNeighbors, A.pullRegions, dstlrs, dstParents, syncs, ctx, lrt
+    );
 }
 #endif
@@ -0,0 +1,156 @@
+/**
+ * Copyright (c)      2017 Los Alamos National Security, LLC
+ *                         All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LA-CC 10-123
+ */
+
+
+/*!
+    @file FlatMap.hpp
+
+    Sorted-vector map used in place of std::map during problem setup.
+ */
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cassert>
+#include <algorithm>
+
+/**
+ * Key/value map stored as two parallel arrays sorted by key. Entries are
+ * appended with insert() and become searchable after finalize(); appending
+ * keys in ascending order makes finalize() a no-op. Lookups are binary
+ * searches over contiguous keys, so a finalized map can be queried
+ * concurrently.
+ */
+template <typename K, typename V>
+class FlatMap {
+    std::vector<K> mKeys;
+    std::vector<V> mVals;
+    // Whether keys were appended in strictly ascending order.
+    bool mSorted = true;
+
+public:
+    /**
+     *
+     */
+    void
+    reserve(size_t n) {
+        mKeys.reserve(n);
+        mVals.reserve(n);
+    }
+
+    /**
+     *
+     */
+    void
+    clear(void) {
+        mKeys.clear();
+        mVals.clear();
+        mSorted = true;
+    }
+
+    /**
+     *
+     */
+    size_t
+    size(void) const {
+        return mKeys.size();
+    }
+
+    /**
+     * Appends (key, value). Duplicate keys keep the last inserted value.
+     */
+    void
+    insert(const K &key, const V &val) {
+        if (!mKeys.empty() && !(mKeys.back() < key)) mSorted = false;
+        mKeys.push_back(key);
+        mVals.push_back(val);
+    }
+
+    /**
+     * Sorts by key and drops duplicates. Must be called before lookups if
+     * keys were not appended in ascending order.
+     */
+    void
+    finalize(void) {
+        if (mSorted) return;
+        //
+        std::vector< std::pair<K, V> > kvs(mKeys.size());
+        for (size_t i = 0; i < kvs.size(); ++i) {
+            kvs[i] = std::make_pair(mKeys[i], mVals[i]);
+        }
+        std::stable_sort(
+            kvs.begin(), kvs.end(),
+            [](const std::pair<K, V> &a, const std::pair<K, V> &b) {
+                return a.first < b.first;
+            }
+        );
+        mKeys.clear();
+        mVals.clear();
+        for (size_t i = 0; i < kvs.size(); ++i) {
+            if (!mKeys.empty() && mKeys.back() == kvs[i].first) {
+                mVals.back() = kvs[i].second;
+            }
+            else {
+                mKeys.push_back(kvs[i].first);
+                mVals.push_back(kvs[i].second);
+            }
+        }
+        mSorted = true;
+    }
+
+    /**
+     * Returns a pointer to the value of key or nullptr if absent.
+     */
+    const V *
+    find(const K &key) const {
+        assert(mSorted);
+        auto it = std::lower_bound(mKeys.begin(), mKeys.end(), key);
+        if (it == mKeys.end() || *it != key) return nullptr;
+        return &mVals[it - mKeys.begin()];
+    }
+
+    /**
+     * Returns the value of key, which must be present.
+     */
+    const V &
+    at(const K &key) const {
+        const V *val = find(key);
+        assert(val);
+        return *val;
+    }
+
+    /**
+     * Values in key order; may be updated in place (e.g., renumbered).
+     */
+    std::vector<V> &
+    values(void) {
+        return mVals;
+    }
+};
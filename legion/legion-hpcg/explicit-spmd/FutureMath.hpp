@@ -34,10 +34,13 @@
 #pragma once
 
 #include "LegionStuff.hpp"
+#include "CollectiveOps.hpp"
 
 enum FutureMathOp {
     FMO_DIV,
-    FMO_SQRT
+    FMO_SQRT,
+    FMO_MUL,
+    FMO_SUB
 };
 
 /**
@@ -45,8 +48,23 @@ enum FutureMathOp {
  */
 struct ComputeFutureArgs {
     FutureMathOp op;
+    // Entry of a FloatSums operand, or -1 for a floatType operand.
+    int aIdx;
+    int bIdx;
 };
 
+/**
+ *
+ */
+inline floatType
+futureValue(
+    Future *f,
+    int idx
+) {
+    if (idx < 0) return f->get_result<floatType>(silenceWarnings);
+    return f->get_result<FloatSums>(silenceWarnings).v[idx];
+}
+
 /**
  *
  */
@@ -54,18 +72,22 @@ inline floatType
 ComputeFutureKernel(
     Future *a,
     FutureMathOp op,
-    Future *b
+    Future *b,
+    int aIdx = -1,
+    int bIdx = -1
 ) {
-    const floatType av = a->get_result<floatType>(silenceWarnings);
+    const floatType av = futureValue(a, aIdx);
     floatType bv = 0.0;
     //
     if (b) {
-        bv = b->get_result<floatType>(silenceWarnings);
+        bv = futureValue(b, bIdx);
     }
     //
     switch (op) {
         case FMO_DIV:  return  av / bv;
         case FMO_SQRT: return  sqrt(av);
+        case FMO_MUL:  return  av * bv;
+        case FMO_SUB:  return  av - bv;
         default: exit(1);
     }
     //
@@ -73,20 +95,25 @@ ComputeFutureKernel(
 }
 
 /**
- *
+ * Like ComputeFuture, but an operand with a non-negative index is taken from
+ * that entry of a FloatSums future (e.g., one returned by allReduceSums).
  */
 inline Future
 ComputeFuture(
     Future *a,
+    int aIdx,
     FutureMathOp op,
     Future *b,
+    int bIdx,
     Context ctx,
     Runtime *lrt
 ) {
 #ifdef LGNCG_TASKING
     //
     ComputeFutureArgs args {
-        .op = op
+        .op = op,
+        .aIdx = aIdx,
+        .bIdx = bIdx
     };
     //
     TaskLauncher tl(
@@ -99,11 +126,25 @@ ComputeFuture(
     //
     return lrt->execute_task(ctx, tl);
 #else
-    const floatType res = ComputeFutureKernel(a, op, b);
+    const floatType res = ComputeFutureKernel(a, op, b, aIdx, bIdx);
     return Future::from_value(lrt, res);
 #endif
 }
 
+/**
+ *
+ */
+inline Future
+ComputeFuture(
+    Future *a,
+    FutureMathOp op,
+    Future *b,
+    Context ctx,
+    Runtime *lrt
+) {
+    return ComputeFuture(a, -1, op, b, -1, ctx, lrt);
+}
+
 /**
  *
  */
@@ -124,7 +165,9 @@ ComputeFutureTask(
         bf = task->futures[1];
     }
     //
-    return ComputeFutureKernel(&af, args->op, nf == 2 ? &bf : NULL);
+    return ComputeFutureKernel(
+        &af, args->op, nf == 2 ? &bf : NULL, args->aIdx, args->bIdx
+    );
 }
 
 /**
@@ -91,32 +91,18 @@ GenerateCoarseProblemTopLevel(
     Context ctx,
     HighLevelRuntime *runtime
 ) {
-    // Make local copies of geometry information.  Use global_int_t since the
-    // RHS products in the calculations below may result in global range values.
-    global_int_t nxf, nyf, nzf;
-    //Coarse nx, ny, nz
-    local_int_t nxc, nyc, nzc;
-    //
-    getXYZFineAndCoarse(*Af.geom, nxf, nyf, nzf, nxc, nyc, nzc);
     // Construct the geometry and linear system
     Geometry *geomc = new Geometry();
-    GenerateGeometry(
-        Af.geom->size,
-        Af.geom->rank,
-        Af.geom->numThreads,
-        nxc,
-        nyc,
-        nzc,
-        Af.geom->stencilSize,
-        geomc
-    );
+    CoarsenGeometry(*Af.geom, geomc);
     //
     LogicalSparseMatrix *Ac = new LogicalSparseMatrix();
     //
     std::string name = "A-L" + std::to_string(level);
     Ac->allocate(name, *geomc, ctx, runtime);
-    //
-    Ac->partition(geomc->size, ctx, runtime);
+    // Every shard's box halves along each axis.
+    std::vector<local_int_t> shardRows(Af.shardRows);
+    for (auto &rows : shardRows) rows /= 8;
+    Ac->partition(shardRows, ctx, runtime);
     //
     Ac->geom = geomc;
     Af.Ac = Ac;
@@ -150,16 +136,7 @@ GenerateCoarseProblem(
     //
     getXYZFineAndCoarse(*AfGeom, nxf, nyf, nzf, nxc, nyc, nzc);
     // Construct the geometry and linear system
-    GenerateGeometry(
-        AfGeom->size,
-        AfGeom->rank,
-        AfGeom->numThreads,
-        nxc,
-        nyc,
-        nzc,
-        AfGeom->stencilSize,
-        Af.Ac->geom->data()
-    );
+    CoarsenGeometry(*AfGeom, Af.Ac->geom->data());
     //
     GenerateProblem(*Af.Ac, NULL, NULL, NULL, level, ctx, lrt);
     GetNeighborInfo(*Af.Ac);
@@ -25,6 +25,7 @@
 
 #include <cmath>
 #include <cstdlib>
+#include <vector>
 
 /*!
     Computes the factorization of the total number of processes into a
@@ -40,6 +41,8 @@
                 y, and z dimensions, respectively
     @param[out] geom data structure that will store the above parameters and the
     factoring of total number of processes into three dimensions
+    @param[in]  splits optional per-axis subdomain extents; when they match the
+                process grid they replace nx, ny, and nz
 */
 inline void
 GenerateGeometry(
@@ -50,7 +53,8 @@ GenerateGeometry(
     int ny,
     int nz,
     int stencilSize,
-    Geometry *geom
+    Geometry *geom,
+    const ShardSplits *splits = nullptr
 ) {
     using namespace std;
 
@@ -90,4 +94,164 @@ GenerateGeometry(
     geom->ipx = ipx;
     geom->ipy = ipy;
     geom->ipz = ipz;
+    geom->gnx = global_int_t(npx) * nx;
+    geom->gny = global_int_t(npy) * ny;
+    geom->gnz = global_int_t(npz) * nz;
+    geom->gix0 = global_int_t(ipx) * nx;
+    geom->giy0 = global_int_t(ipy) * ny;
+    geom->giz0 = global_int_t(ipz) * nz;
+    //
+    if (!splits || !IsUneven(*splits)) return;
+    if (splits->np[0] != npx || splits->np[1] != npy || splits->np[2] != npz) {
+        return;
+    }
+    const int ip[3] = {ipx, ipy, ipz};
+    int n[3];
+    global_int_t gn[3], gi0[3];
+    for (int d = 0; d < 3; ++d) {
+        n[d] = splits->widths[d][ip[d]];
+        gn[d] = 0;
+        gi0[d] = 0;
+        for (int i = 0; i < splits->np[d]; ++i) {
+            if (i < ip[d]) gi0[d] += splits->widths[d][i];
+            gn[d] += splits->widths[d][i];
+        }
+    }
+    geom->nx = n[0];
+    geom->ny = n[1];
+    geom->nz = n[2];
+    geom->gnx = gn[0];
+    geom->gny = gn[1];
+    geom->gnz = gn[2];
+    geom->gix0 = gi0[0];
+    geom->giy0 = gi0[1];
+    geom->giz0 = gi0[2];
+}
+
+/*!
+    Derives the geometry of the next coarser multigrid level by halving every
+    extent and offset of the fine geometry.
+
+    @param[in]  fine the fine grid geometry
+    @param[out] coarse the coarse grid geometry
+*/
+inline void
+CoarsenGeometry(
+    const Geometry &fine,
+    Geometry *coarse
+) {
+    *coarse = fine;
+    coarse->nx = fine.nx / 2;
+    coarse->ny = fine.ny / 2;
+    coarse->nz = fine.nz / 2;
+    coarse->gnx = fine.gnx / 2;
+    coarse->gny = fine.gny / 2;
+    coarse->gnz = fine.gnz / 2;
+    coarse->gix0 = fine.gix0 / 2;
+    coarse->giy0 = fine.giy0 / 2;
+    coarse->giz0 = fine.giz0 / 2;
+}
+
+/*!
+    Returns the number of rows owned by each process, in rank order.
+
+    @param[in] geom a geometry of the run (any rank)
+    @param[in] splits optional per-axis subdomain extents used to generate it
+
+    @return the number of rows of every process
+*/
+inline std::vector<local_int_t>
+ShardRowCounts(
+    const Geometry &geom,
+    const ShardSplits *splits
+) {
+    std::vector<local_int_t> counts(geom.size);
+    for (int r = 0; r < geom.size; ++r) {
+        Geometry g;
+        GenerateGeometry(
+            geom.size, r, geom.numThreads, geom.nx, geom.ny, geom.nz,
+            geom.stencilSize, &g, splits
+        );
+        counts[r] = local_int_t(g.nx) * g.ny * g.nz;
+    }
+    return counts;
+}
+
+/*!
+    Splits the global grid of an nx by ny by nz per-process problem over size
+    processes so that the extent of every process slab along an axis follows
+    the mean weight (relative speed) of the processes in that slab. Extents stay
+    multiples of unit and are at least 2 * unit.
+
+    @param[in]  size total number of processes
+    @param[in]  nx, ny, nz mean per-process extents
+    @param[in]  weights one weight per process, in rank order
+    @param[in]  unit granularity of the extents
+    @param[out] splits the resulting extents
+
+    @return Returns 0 on success and non-zero if the problem cannot be split.
+*/
+inline int
+ComputeWeightedSplits(
+    int size,
+    int nx,
+    int ny,
+    int nz,
+    const std::vector<double> &weights,
+    int unit,
+    ShardSplits &splits
+) {
+    int np[3];
+    ComputeOptimalShapeXYZ(size, np[0], np[1], np[2]);
+    const int n[3] = {nx, ny, nz};
+    //
+    splits.np[0] = splits.np[1] = splits.np[2] = 0;
+    if (int(weights.size()) != size) return 1;
+    for (int d = 0; d < 3; ++d) {
+        if (np[d] > HPCG_MAX_AXIS_SHARDS || n[d] % unit) return 1;
+    }
+    for (const double w : weights) {
+        if (!(w > 0.0)) return 1;
+    }
+    //
+    ShardSplits res;
+    for (int d = 0; d < 3; ++d) {
+        // Every slab along an axis holds equally many processes, so their
+        // total weights are proportional to their mean weights.
+        std::vector<double> slabWeight(np[d], 0.0);
+        for (int r = 0; r < size; ++r) {
+            const int ip[3] = {
+                r % np[0], (r / np[0]) % np[1], r / (np[0] * np[1])
+            };
+            slabWeight[ip[d]] += weights[r];
+        }
+        double totWeight = 0.0;
+        for (const double w : slabWeight) totWeight += w;
+        // Every slab gets two units; the rest are shared by weight using the
+        // largest remainder method.
+        const int nUnits = (n[d] / unit) * np[d];
+        const int nFree = nUnits - 2 * np[d];
+        if (nFree < 0) return 1;
+        std::vector<double> rem(np[d]);
+        int nGiven = 0;
+        for (int i = 0; i < np[d]; ++i) {
+            const double share = nFree * slabWeight[i] / totWeight;
+            const int units = int(share);
+            res.widths[d][i] = 2 + units;
+            rem[i] = share - units;
+            nGiven += units;
+        }
+        for (; nGiven < nFree; ++nGiven) {
+            int best = 0;
+            for (int i = 1; i < np[d]; ++i) {
+                if (rem[i] > rem[best]) best = i;
+            }
+            res.widths[d][best] += 1;
+            rem[best] = -1.0;
+        }
+        for (int i = 0; i < np[d]; ++i) res.widths[d][i] *= unit;
+        res.np[d] = np[d];
+    }
+    splits = res;
+    return 0;
 }
@@ -95,15 +95,12 @@ GenerateProblem(
     const global_int_t nx  = Ageom->nx;
     const global_int_t ny  = Ageom->ny;
     const global_int_t nz  = Ageom->nz;
-    const global_int_t npx = Ageom->npx;
-    const global_int_t npy = Ageom->npy;
-    const global_int_t npz = Ageom->npz;
-    const global_int_t ipx = Ageom->ipx;
-    const global_int_t ipy = Ageom->ipy;
-    const global_int_t ipz = Ageom->ipz;
-    const global_int_t gnx = nx * npx;
-    const global_int_t gny = ny * npy;
-    const global_int_t gnz = nz * npz;
+    const global_int_t gnx = Ageom->gnx;
+    const global_int_t gny = Ageom->gny;
+    const global_int_t gnz = Ageom->gnz;
+    const global_int_t gix0 = Ageom->gix0;
+    const global_int_t giy0 = Ageom->giy0;
+    const global_int_t giz0 = Ageom->giz0;
     // This is the size of our subblock.
     const local_int_t localNumberOfRows = nx * ny * nz;
     // If this assert fails, it most likely means that the local_int_t is set to
@@ -115,8 +112,7 @@ GenerateProblem(
     const local_int_t numberOfNonzerosPerRow = Ageom->stencilSize;
 
     // Total number of grid points in mesh
-    const global_int_t totalNumberOfRows = ((global_int_t)localNumberOfRows)
-                                         * ((global_int_t)Ageom->size);
+    const global_int_t totalNumberOfRows = gnx * gny * gnz;
     // If this assert fails, it most likely means that the global_int_t is set
     // to int and should be set to long long
     assert(totalNumberOfRows > 0);
@@ -185,60 +181,64 @@ GenerateProblem(
     }
     //
     global_int_t localNumberOfNonzeros = 0;
-    //
-    for (local_int_t iz = 0; iz < nz; iz++) {
-        global_int_t giz = ipz * nz + iz;
-        for (local_int_t iy = 0; iy < ny; iy++) {
-            global_int_t giy = ipy * ny + iy;
-            for (local_int_t ix =0; ix < nx; ix++) {
-                global_int_t gix = ipx * nx + ix;
-                local_int_t currentLocalRow = iz * nx * ny + iy * nx + ix;
-                global_int_t currentGlobalRow = giz * gnx * gny + giy * gnx + gix;
-                localToGlobalMap[currentLocalRow] = currentGlobalRow;
-                char numberOfNonzerosInRow = 0;
-                // Current index in current row.
-                global_int_t currentIndexG = 0;
-                local_int_t currentNonZeroElemIndex = 0;
-                for (int sz = -1; sz <= 1; sz++) {
-                    if (giz + sz > -1 && giz + sz < gnz) {
-                        for (int sy = -1; sy <= 1; sy++) {
-                            if (giy + sy > -1 && giy + sy < gny) {
-                                for (int sx = -1; sx <= 1; sx++) {
-                                    if (gix + sx > -1 && gix + sx < gnx) {
-                                        global_int_t curcol = currentGlobalRow
-                                                            + sz*gnx*gny
-                                                            + sy*gnx+sx;
-                                        if (curcol == currentGlobalRow) {
-                                            matrixDiagonal[currentLocalRow] = 26.0;
-                                            matrixValues(currentLocalRow, currentNonZeroElemIndex) = 26.0;
-                                            mid2rc[currentLocalRow] = make_pair(currentLocalRow, currentNonZeroElemIndex);
-                                        } else {
-                                            matrixValues(currentLocalRow, currentNonZeroElemIndex) = -1.0;
-                                        }
-                                        currentNonZeroElemIndex++;
-                                        mtxIndG(currentLocalRow, currentIndexG++) = curcol;
-                                        numberOfNonzerosInRow++;
-                                    } // end x bounds test
-                                } // end sx loop
-                            } // end y bounds test
-                        } // end sy loop
-                    } // end z bounds test
-                } // end sz loop
-                nonzerosInRow[currentLocalRow] = numberOfNonzerosInRow;
-                localNumberOfNonzeros += numberOfNonzerosInRow;
-                if (b != 0) {
-                    bv[currentLocalRow] = 26.0
-                                        - ((double)(numberOfNonzerosInRow - 1));
-                }
-                if (x != 0) {
-                    xv[currentLocalRow] = 0.0;
-                }
-                if (xexact != 0) {
-                    xexactv[currentLocalRow] = 1.0;
-                }
-            } // end ix loop
-        } // end iy loop
-    } // end iz loop
+    // Rows are independent, so they are generated by the shard's threads. This
+    // only shortens setup: CGMapper decides which NUMA memory holds the
+    // instances, and OptimizeProblem reorders the rows afterwards.
+    const int nThreads = Ageom->numThreads > 0 ? Ageom->numThreads : 1;
+    #pragma omp parallel for num_threads(nThreads) schedule(static) \
+                             reduction(+:localNumberOfNonzeros)
+    for (local_int_t currentLocalRow = 0;
+         currentLocalRow < localNumberOfRows; currentLocalRow++) {
+        const local_int_t iz = currentLocalRow / (nx * ny);
+        const local_int_t iy = (currentLocalRow / nx) % ny;
+        const local_int_t ix = currentLocalRow % nx;
+        global_int_t giz = giz0 + iz;
+        global_int_t giy = giy0 + iy;
+        global_int_t gix = gix0 + ix;
+        global_int_t currentGlobalRow = giz * gnx * gny + giy * gnx + gix;
+        localToGlobalMap[currentLocalRow] = currentGlobalRow;
+        char numberOfNonzerosInRow = 0;
+        // Current index in current row.
+        global_int_t currentIndexG = 0;
+        local_int_t currentNonZeroElemIndex = 0;
+        for (int sz = -1; sz <= 1; sz++) {
+            if (giz + sz > -1 && giz + sz < gnz) {
+                for (int sy = -1; sy <= 1; sy++) {
+                    if (giy + sy > -1 && giy + sy < gny) {
+                        for (int sx = -1; sx <= 1; sx++) {
+                            if (gix + sx > -1 && gix + sx < gnx) {
+                                global_int_t curcol = currentGlobalRow
+                                                    + sz*gnx*gny
+                                                    + sy*gnx+sx;
+                                if (curcol == currentGlobalRow) {
+                                    matrixDiagonal[currentLocalRow] = 26.0;
+                                    matrixValues(currentLocalRow, currentNonZeroElemIndex) = 26.0;
+                                    mid2rc[currentLocalRow] = make_pair(currentLocalRow, currentNonZeroElemIndex);
+                                } else {
+                                    matrixValues(currentLocalRow, currentNonZeroElemIndex) = -1.0;
+                                }
+                                currentNonZeroElemIndex++;
+                                mtxIndG(currentLocalRow, currentIndexG++) = curcol;
+                                numberOfNonzerosInRow++;
+                            } // end x bounds test
+                        } // end sx loop
+                    } // end y bounds test
+                } // end sy loop
+            } // end z bounds test
+        } // end sz loop
+        nonzerosInRow[currentLocalRow] = numberOfNonzerosInRow;
+        localNumberOfNonzeros += numberOfNonzerosInRow;
+        if (b != 0) {
+            bv[currentLocalRow] = 26.0
+                                - ((double)(numberOfNonzerosInRow - 1));
+        }
+        if (x != 0) {
+            xv[currentLocalRow] = 0.0;
+        }
+        if (xexact != 0) {
+            xexactv[currentLocalRow] = 1.0;
+        }
+    } // end row loop
     //
     SparseMatrixScalars *Asclrs   = A.sclrs->data();
     Asclrs->totalNumberOfRows     = totalNumberOfRows;
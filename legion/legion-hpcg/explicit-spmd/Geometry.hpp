@@ -69,13 +69,45 @@ struct Geometry_STRUCT {
     int ipx;  //!< Current rank's x location in the npx by npy by npz processor grid
     int ipy;  //!< Current rank's y location in the npx by npy by npz processor grid
     int ipz;  //!< Current rank's z location in the npx by npy by npz processor grid
+    global_int_t gnx;  //!< Global number of x-direction grid points
+    global_int_t gny;  //!< Global number of y-direction grid points
+    global_int_t gnz;  //!< Global number of z-direction grid points
+    global_int_t gix0; //!< Global x index of this subdomain's first grid point
+    global_int_t giy0; //!< Global y index of this subdomain's first grid point
+    global_int_t giz0; //!< Global z index of this subdomain's first grid point
 };
 typedef struct Geometry_STRUCT Geometry;
 
+//! Largest processor grid extent along one axis that can be split unevenly.
+#define HPCG_MAX_AXIS_SHARDS 64
+
+/*!
+  Per-axis subdomain extents for uneven decompositions. Subdomain (ipx, ipy,
+  ipz) is widths[0][ipx] by widths[1][ipy] by widths[2][ipz]. An np of zero
+  along every axis selects the even split.
+*/
+struct ShardSplits {
+    int np[3];
+    int widths[3][HPCG_MAX_AXIS_SHARDS];
+};
+
+/*!
+  Returns true if splits describes an uneven decomposition.
+*/
+inline bool
+IsUneven(
+    const ShardSplits &splits
+) {
+    return splits.np[0] > 0 && splits.np[1] > 0 && splits.np[2] > 0;
+}
+
 /*!
   Returns the rank of the MPI process that is assigned the global row index
   given as the input argument.
 
+  Subdomains may differ in size, so the row must lie within this subdomain or
+  its one-point halo, as is the case for every column of the stencil.
+
   @param[in] geom  The description of the problem's geometry.
   @param[in] index The global row index
 
@@ -86,15 +118,16 @@ ComputeRankOfMatrixRow(
     const Geometry &geom,
     global_int_t index
 ) {
-    global_int_t gnx = geom.nx*geom.npx;
-    global_int_t gny = geom.ny*geom.npy;
+    const global_int_t gnx = geom.gnx;
+    const global_int_t gny = geom.gny;
 
     global_int_t iz = index/(gny*gnx);
     global_int_t iy = (index-iz*gny*gnx)/gnx;
     global_int_t ix = index%gnx;
-    global_int_t ipz = iz/geom.nz;
-    global_int_t ipy = iy/geom.ny;
-    global_int_t ipx = ix/geom.nx;
+    int ipx = geom.ipx, ipy = geom.ipy, ipz = geom.ipz;
+    if (ix < geom.gix0) --ipx; else if (ix >= geom.gix0 + geom.nx) ++ipx;
+    if (iy < geom.giy0) --ipy; else if (iy >= geom.giy0 + geom.ny) ++ipy;
+    if (iz < geom.giz0) --ipz; else if (iz >= geom.giz0 + geom.nz) ++ipz;
     int rank = ipx+ipy*geom.npx+ipz*geom.npy*geom.npx;
     //
     return rank;
@@ -107,9 +140,7 @@ inline global_int_t
 getGlobalXYZ(
     const Geometry &geom
 ) {
-    global_int_t res = global_int_t(geom.npx * geom.nx) *
-                       global_int_t(geom.npy * geom.ny) *
-                       global_int_t(geom.npz * geom.nz);
+    global_int_t res = geom.gnx * geom.gny * geom.gnz;
 
     return res;
 }
@@ -133,4 +164,10 @@ emit(const Geometry &geom) {
     cout << "ipx: "        << geom.ipx << endl;
     cout << "ipy: "        << geom.ipy << endl;
     cout << "ipz: "        << geom.ipz << endl;
+    cout << "gnx: "        << geom.gnx << endl;
+    cout << "gny: "        << geom.gny << endl;
+    cout << "gnz: "        << geom.gnz << endl;
+    cout << "gix0: "       << geom.gix0 << endl;
+    cout << "giy0: "       << geom.giy0 << endl;
+    cout << "giz0: "       << geom.giz0 << endl;
 }
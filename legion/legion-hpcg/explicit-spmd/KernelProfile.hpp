@@ -0,0 +1,216 @@
+/**
+ * Copyright (c)      2017 Los Alamos National Security, LLC
+ *                         All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LA-CC 10-123
+ */
+
+
+/*!
+    @file KernelProfile.hpp
+
+    Execution time, bytes moved, and flops of the leaf kernels, per kernel and
+    per MG level.
+ */
+
+#pragma once
+
+#include "hpcg.hpp"
+#include "LegionStuff.hpp"
+#include "mytimer.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+/**
+ * Kernels that record their executions.
+ */
+enum ProfiledKernel {
+    KP_SPMV = 0,
+    KP_SYMGS,
+    KP_HALO,
+    KP_RESTRICTION,
+    KP_PROLONGATION,
+    KP_DDOT,
+    KP_WAXPBY,
+    // ComputeXRUpdate and ComputePUpdate.
+    KP_FUSED_UPDATE,
+    // AgglomeratedSolveKernel.
+    KP_COARSE_SOLVE,
+    KP_NUM_KERNELS
+};
+
+static const char *const profiledKernelNames[KP_NUM_KERNELS] = {
+    "SpMV",
+    "SYMGS",
+    "Halo pack",
+    "Restriction",
+    "Prolongation",
+    "DDOT",
+    "WAXPBY",
+    "Fused CG update",
+    "Agglomerated coarse solve"
+};
+
+/**
+ * Modeled work of one kernel execution. Launchers fill it in (they know the
+ * matrix) and pass it to the task with the other arguments.
+ */
+struct KernelCost {
+    // MG level of the data (0 is the finest; vectors of CG are on level 0).
+    int level;
+    double bytes;
+    double flops;
+};
+
+/**
+ * Totals over the executions of one kernel on one level.
+ */
+struct KernelStats {
+    double time;
+    double bytes;
+    double flops;
+    double calls;
+};
+
+/**
+ *
+ */
+struct KernelProfile {
+    KernelStats stats[KP_NUM_KERNELS][NUM_MG_LEVELS];
+
+    /**
+     *
+     */
+    KernelProfile(void) {
+        clear();
+    }
+
+    /**
+     *
+     */
+    void
+    clear(void) {
+        memset(stats, 0, sizeof(stats));
+    }
+
+    /**
+     * Total execution time of a kernel over all levels.
+     */
+    double
+    time(ProfiledKernel kernel) const {
+        double t = 0.0;
+        for (int l = 0; l < NUM_MG_LEVELS; ++l) {
+            t += stats[kernel][l].time;
+        }
+        return t;
+    }
+};
+
+/**
+ * Profiles of the processors of this address space. Every shard runs its
+ * kernels (inline or as leaf tasks) on its own processor, so a processor's
+ * profile is that of its shard.
+ */
+class KernelProfiler {
+    //
+    static std::mutex &
+    mutex(void) {
+        static std::mutex m;
+        return m;
+    }
+    //
+    static std::map<unsigned long long, KernelProfile> &
+    profiles(void) {
+        static std::map<unsigned long long, KernelProfile> p;
+        return p;
+    }
+
+public:
+    /**
+     *
+     */
+    static void
+    record(
+        Processor proc,
+        ProfiledKernel kernel,
+        const KernelCost &cost,
+        double time
+    ) {
+        assert(cost.level >= 0 && cost.level < NUM_MG_LEVELS);
+        std::lock_guard<std::mutex> guard(mutex());
+        KernelStats &s = profiles()[proc.id].stats[kernel][cost.level];
+        s.time  += time;
+        s.bytes += cost.bytes;
+        s.flops += cost.flops;
+        s.calls += 1.0;
+    }
+
+    /**
+     * Returns the profile of proc and starts a new one.
+     */
+    static KernelProfile
+    take(Processor proc) {
+        std::lock_guard<std::mutex> guard(mutex());
+        KernelProfile &p = profiles()[proc.id];
+        KernelProfile result = p;
+        p.clear();
+        return result;
+    }
+};
+
+/**
+ * Records the execution time of its scope (and cost) on the executing
+ * processor.
+ */
+class KernelTimer {
+    Processor mProc;
+    ProfiledKernel mKernel;
+    KernelCost mCost;
+    double mStart;
+
+public:
+    /**
+     *
+     */
+    KernelTimer(
+        ProfiledKernel kernel,
+        const KernelCost &cost,
+        Context ctx,
+        Runtime *lrt
+    ) : mProc(lrt->get_executing_processor(ctx))
+      , mKernel(kernel)
+      , mCost(cost)
+      , mStart(mytimer()) { }
+
+    /**
+     *
+     */
+    ~KernelTimer(void) {
+        KernelProfiler::record(mProc, mKernel, mCost, mytimer() - mStart);
+    }
+};
@@ -32,6 +32,7 @@
 
 #include <cassert>
 #include <deque>
+#include <vector>
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -104,6 +105,16 @@ public:
         Legion::HighLevelRuntime *lrt
     ) { /* Nothing to do. */ }
 
+    /**
+     *
+     */
+    virtual void
+    partition(
+        const std::vector<local_int_t> &partLens,
+        Legion::Context ctx,
+        Legion::HighLevelRuntime *lrt
+    ) { /* Nothing to do. */ }
+
     /**
      *
      */
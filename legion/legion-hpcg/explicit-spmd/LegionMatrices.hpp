@@ -45,12 +45,19 @@
 #include "LegionArrays.hpp"
 #include "LegionMGData.hpp"
 #include "CollectiveOps.hpp"
+#include "SellMatrix.hpp"
+#include "StencilOperator.hpp"
+#include "FlatMap.hpp"
+#include "SolverTraces.hpp"
 
 #include "hpcg.hpp"
 #include "Geometry.hpp"
 
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -94,6 +101,9 @@ struct Synchronizers {
     // this way for convenience. At most a task will have HPCG_STENCIL -1
     // neighbors.
     PhaseBarriers neighbors[HPCG_STENCIL - 1];
+    // Number of populated neighbors entries, as wired by
+    // wireSynchronizersTask.
+    int nNeighbors = 0;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -123,6 +133,9 @@ struct LogicalSparseMatrix : public LogicalMultiBase {
     LogicalArray< DynColl<floatType> > dcAllRedSumFT;
     LogicalArray< DynColl<floatType> > dcAllRedMinFT;
     LogicalArray< DynColl<floatType> > dcAllRedMaxFT;
+    LogicalArray< DynColl<FloatSums> > dcAllRedSumFS;
+    LogicalArray< DynColl<CoarseVector> > dcAllGatherCV;
+    LogicalArray< DynColl<GramSums> > dcAllRedSumGS;
     // Neighboring processes.
     LogicalArray<int> neighbors;
     // Number of items that will be sent on a per neighbor basis.
@@ -148,10 +161,15 @@ struct LogicalSparseMatrix : public LogicalMultiBase {
     LogicalSparseMatrix *Ac = nullptr;
     // Geometry for top-level setup.
     Geometry *geom = nullptr;
+    // Number of rows owned by each shard.
+    std::vector<local_int_t> shardRows;
 
 protected:
     // Number of shards used for SparseMatrix decomposition.
     int mSize = 0;
+    // Global number of rows and stencil size, set at allocation.
+    global_int_t mGlobalXYZ = 0;
+    int mStencilSize = 0;
     //
     bool mSharedRegionsPopulated = false;
 
@@ -172,6 +190,9 @@ protected:
                          &dcAllRedSumFT,
                          &dcAllRedMinFT,
                          &dcAllRedMaxFT,
+                         &dcAllRedSumFS,
+                         &dcAllGatherCV,
+                         &dcAllRedSumGS,
                          &neighbors,
                          &sendLength,
                          &recvLength,
@@ -370,6 +391,8 @@ public:
         mSize = geom.size;
         const auto globalXYZ   = getGlobalXYZ(geom);
         const auto stencilSize = geom.stencilSize;
+        mGlobalXYZ  = globalXYZ;
+        mStencilSize = stencilSize;
 
         aalloca(geoms, mSize, ctx, lrt);
         aalloca(sclrs, mSize, ctx, lrt);
@@ -390,6 +413,9 @@ public:
         aalloca(dcAllRedSumFT, mSize, ctx, lrt);
         aalloca(dcAllRedMinFT, mSize, ctx, lrt);
         aalloca(dcAllRedMaxFT, mSize, ctx, lrt);
+        aalloca(dcAllRedSumFS, mSize, ctx, lrt);
+        aalloca(dcAllGatherCV, mSize, ctx, lrt);
+        aalloca(dcAllRedSumGS, mSize, ctx, lrt);
         //
         const int maxNumNeighbors = geom.stencilSize - 1;
         // Each task will have at most 26 neighbors.
@@ -406,7 +432,7 @@ public:
 
 
     /**
-     *
+     * Partitions evenly among nParts shards.
      */
     void
     partition(
@@ -414,8 +440,38 @@ public:
         LegionRuntime::HighLevel::Context ctx,
         LegionRuntime::HighLevel::HighLevelRuntime *lrt
     ) {
+        const local_int_t nRows = local_int_t(mGlobalXYZ / nParts);
+        partition(std::vector<local_int_t>(nParts, nRows), ctx, lrt);
+    }
+
+    /**
+     * Partitions among shards that own rows[shard] rows each.
+     */
+    void
+    partition(
+        const std::vector<local_int_t> &rows,
+        LegionRuntime::HighLevel::Context ctx,
+        LegionRuntime::HighLevel::HighLevelRuntime *lrt
+    ) {
+        const int64_t nParts = rows.size();
+        shardRows = rows;
+        // Per-row items follow the rows, per-entry items follow the rows times
+        // the stencil size, and the rest hold the same amount per shard.
+        std::vector<local_int_t> entries(nParts);
+        for (int64_t i = 0; i < nParts; ++i) {
+            entries[i] = rows[i] * mStencilSize;
+        }
         for (auto *i : mLogicalItems) {
-            i->partition(nParts, ctx, lrt);
+            if (i == &nonzerosInRow    || i == &matrixDiagonal
+             || i == &localToGlobalMap || i == &matdIdxToMatRowCol) {
+                i->partition(rows, ctx, lrt);
+            }
+            else if (i == &mtxIndG || i == &mtxIndL || i == &matrixValues) {
+                i->partition(entries, ctx, lrt);
+            }
+            else {
+                i->partition(nParts, ctx, lrt);
+            }
         }
         // For the DynamicCollectives we need partition info before population.
         const auto nArrivals = nParts; // Expecting an arrival from each task.
@@ -430,6 +486,17 @@ public:
         //
         DynColl<floatType> dynColMaxFT(FLOAT_REDUCE_MAX_TID, nArrivals);
         mPopulateDynamicCollectives(dcAllRedMaxFT, dynColMaxFT, ctx, lrt);
+        //
+        DynColl<FloatSums> dynColSumFS(FLOAT_SUMS_REDUCE_SUM_TID, nArrivals);
+        mPopulateDynamicCollectives(dcAllRedSumFS, dynColSumFS, ctx, lrt);
+        //
+        DynColl<CoarseVector> dynColGatherCV(
+            COARSE_VECTOR_REDUCE_SUM_TID, nArrivals
+        );
+        mPopulateDynamicCollectives(dcAllGatherCV, dynColGatherCV, ctx, lrt);
+        //
+        DynColl<GramSums> dynColSumGS(GRAM_SUMS_REDUCE_SUM_TID, nArrivals);
+        mPopulateDynamicCollectives(dcAllRedSumGS, dynColSumGS, ctx, lrt);
         // Just pick a structure that has a representative launch domain.
         launchDomain = geoms.launchDomain;
     }
@@ -466,17 +533,61 @@ private:
         //
         DynColl<TYPE> *dcsd = dcs.data();
         assert(dcsd);
+        // When shards share nodes (and there is more than one node), reduce
+        // within each node first, so only one arrival per node crosses the
+        // network.
+        const auto spaces = getShardAddressSpaces(dynCol.nArrivals);
+        std::map<unsigned, int64_t> leaders;
+        for (int64_t i = 0; i < dynCol.nArrivals; ++i) {
+            leaders.insert(std::make_pair(spaces[i], i));
+        }
+        const int64_t nNodes = leaders.size();
+        const bool hierarchical = nNodes > 1 && nNodes < dynCol.nArrivals;
         //
         dynCol.dc = lrt->create_dynamic_collective(
             ctx,
-            dynCol.nArrivals /* Number of arrivals. */,
+            (hierarchical ? nNodes : dynCol.nArrivals) /* Number of arrivals. */,
             dynCol.tid,
             &dynCol.localBuffer,
             sizeof(dynCol.localBuffer)
         );
+        // Node-level collectives are created on their node.
+        std::map<unsigned, Future> nodeDCs;
+        if (hierarchical) {
+            for (const auto &leader : leaders) {
+                CreateNodeCollectiveArgs args;
+                args.redop = dynCol.tid;
+                args.nArrivals = std::count(
+                    spaces.begin(), spaces.end(), leader.first
+                );
+                static_assert(
+                    sizeof(dynCol.localBuffer) <= sizeof(args.init),
+                    "Collective buffer too large."
+                );
+                args.initSize = sizeof(dynCol.localBuffer);
+                memcpy(args.init, &dynCol.localBuffer, args.initSize);
+                //
+                TaskLauncher tl(
+                    CREATE_NODE_COLLECTIVE_TID,
+                    TaskArgument(
+                        &args,
+                        offsetof(CreateNodeCollectiveArgs, init) + args.initSize
+                    )
+                );
+                // CGMapper runs it on the leader's processor.
+                tl.tag = MappingTagID(leader.second);
+                nodeDCs[leader.first] = lrt->execute_task(ctx, tl);
+            }
+        }
         // Replicate
         for (int64_t i = 0; i < dynCol.nArrivals; ++i) {
             dcsd[i] = dynCol;
+            if (!hierarchical) continue;
+            dcsd[i].hasNodeLevel = true;
+            dcsd[i].isNodeLeader = (leaders[spaces[i]] == i);
+            dcsd[i].nodeDC = nodeDCs[spaces[i]].template get_result<
+                DynamicCollective
+            >(silenceWarnings);
         }
         // Done, so unmap.
         targetLogicalArray.unmapRegion(ctx, lrt);
@@ -513,6 +624,12 @@ struct SparseMatrix : public PhysicalMultiBase {
     //
     Item< DynColl<floatType> > *dcAllRedMaxFT = nullptr;
     //
+    Item< DynColl<FloatSums> > *dcAllRedSumFS = nullptr;
+    //
+    Item< DynColl<CoarseVector> > *dcAllGatherCV = nullptr;
+    //
+    Item< DynColl<GramSums> > *dcAllRedSumGS = nullptr;
+    //
     Array<int> *neighbors = nullptr;
     //
     Array<local_int_t> *sendLength = nullptr;
@@ -527,23 +644,83 @@ struct SparseMatrix : public PhysicalMultiBase {
     ////////////////////////////////////////////////////////////////////////////
     // Pointer to coarse grid matrix.
     SparseMatrix *Ac = nullptr;
+    // MG level of this matrix (0 is the finest).
+    int level = 0;
     // Pointer to the coarse level data for this fine matrix.
     MGData *mgData = nullptr;
     // Global to local mapping. NOTE: only valid after a call to
     // PopulateGlobalToLocalMap.
-    std::map< global_int_t, local_int_t > globalToLocalMap;
+    FlatMap< global_int_t, local_int_t > globalToLocalMap;
     // Only valid after a call to SetupHalo.
     LogicalArray<local_int_t> lElementsToSend;
     Array<local_int_t> *elementsToSend = nullptr;
-    // A mapping between neighbor IDs and their regions.
-    std::map<int, PhysicalRegion> nidToPullRegion;
+    // Rows without halo columns (interior) followed by the remaining
+    // (boundary) rows, each group in storage order. NOTE: only valid after a
+    // call to SetupHalo (and updated by OptimizeProblem).
+    local_int_t nInteriorRows = 0;
+    LogicalArray<local_int_t> lHaloSplitRows;
+    Array<local_int_t> *haloSplitRows = nullptr;
+    // Multicolor ordering only: interior (boundary) rows of color c are
+    // haloSplitRows[interiorColorOffsets[c] .. interiorColorOffsets[c + 1])
+    // (likewise for boundaryColorOffsets).
+    local_int_t interiorColorOffsets[HPCG_STENCIL + 1];
+    local_int_t boundaryColorOffsets[HPCG_STENCIL + 1];
+    // Neighbor regions that I pull from, in neighbor order, as the halo
+    // exchange launches them.
+    std::vector<LogicalRegion> pullRegions;
     // Pull regions that I populate for consumption by other tasks.
     std::vector< Array<floatType> *> pullBuffers;
+    // Multicolor ordering. NOTE: only valid after a call to OptimizeProblem.
+    // Rows of color c are stored in [colorOffsets[c], colorOffsets[c + 1]).
+    int nColors = 0;
+    local_int_t colorOffsets[HPCG_STENCIL + 1];
+    // Storage row of each row in natural (generated) order.
+    LogicalArray<local_int_t> lNaturalOrder;
+    Array<local_int_t> *naturalOrder = nullptr;
+    // SELL-C-sigma copy of the matrix. NOTE: only valid after a call to
+    // SetupSellMatrix.
+    SellMatrix *sell = nullptr;
+    // Matrix-free form of the operator. NOTE: only valid after a call to
+    // SetupStencilOperator.
+    StencilOperator *stencil = nullptr;
+    // Send lists as grid boxes, which ExchangeHalo packs without the index
+    // list. NOTE: only valid after a call to SetupStructuredHalo.
+    StructuredHalo *structuredHalo = nullptr;
+    // Reduced-precision copies of matrixValues and matrixDiagonal used by the
+    // MG kernels. NOTE: only valid after a call to SetupMixedPrecisionMG.
+    LogicalArray<mgFloatType> lMgMatrixValues;
+    Array<mgFloatType> *mgMatrixValues = nullptr;
+    LogicalArray<mgFloatType> lMgMatrixDiagonal;
+    Array<mgFloatType> *mgMatrixDiagonal = nullptr;
     // No optimization here.
     const bool isDotProductOptimized = false;
-    const bool isSpmvOptimized = false;
-    const bool isMgOptimized = false;
+    // Set by SetupSellMatrix. Selects the SELL-C-sigma SpMV kernel.
+    bool isSpmvOptimized = false;
+    // Set by OptimizeProblem. Selects the multicolor SYMGS kernel.
+    bool isMgOptimized = false;
     const bool isWaxpbyOptimized = false;
+    // Set by SetupStencilOperator. Selects the matrix-free SpMV and SYMGS
+    // kernels (over the SELL-C-sigma and row-major ones).
+    bool isMatrixFree = false;
+    // Set by SetMixedPrecisionMG. Selects the reduced-precision copies in the
+    // SYMGS and SpMV calls made by ComputeMG.
+    bool isMgMixedPrecision = false;
+    // If set, CG and ComputeMG wrap their launches in runtime traces (see
+    // BeginSolverTrace). Only consulted on the finest level.
+    bool isTraced = false;
+    // Set by SetupAgglomeration. If set, ComputeMG gathers this level's
+    // problem on every shard and solves it there (ComputeAgglomeratedMG)
+    // instead of cycling through this level and the ones below.
+    bool isAgglomerated = false;
+    // Symmetric sweeps of the agglomerated solve.
+    int agglomeratedSweeps = 0;
+    // The agglomerated level's global matrix: HPCG_STENCIL values per global
+    // row in stencil order, zero outside the grid. NOTE: only valid after a
+    // call to SetupAgglomeration.
+    LogicalArray<floatType> lAgglomeratedValues;
+    Array<floatType> *agglomeratedValues = nullptr;
+    // Trace IDs of this shard's solver traces.
+    SolverTraceRegistry traces;
 
     /**
      *
@@ -592,6 +769,9 @@ struct SparseMatrix : public PhysicalMultiBase {
         delete dcAllRedSumFT;
         delete dcAllRedMinFT;
         delete dcAllRedMaxFT;
+        delete dcAllRedSumFS;
+        delete dcAllGatherCV;
+        delete dcAllRedSumGS;
         delete neighbors;
         delete sendLength;
         delete recvLength;
@@ -604,6 +784,14 @@ struct SparseMatrix : public PhysicalMultiBase {
             //elementsToSend->deallocate
             delete elementsToSend;
         }
+        delete haloSplitRows;
+        delete naturalOrder;
+        delete sell;
+        delete stencil;
+        delete structuredHalo;
+        delete mgMatrixValues;
+        delete mgMatrixDiagonal;
+        delete agglomeratedValues;
         for (auto *i : pullBuffers) delete i;
         if (Ac) delete Ac;
         if (mgData) delete mgData;
@@ -676,6 +864,17 @@ protected:
         dcAllRedMaxFT = new Item< DynColl<floatType> >(regions[cid++], ctx, rt);
         assert(dcAllRedMaxFT->data());
         //
+        dcAllRedSumFS = new Item< DynColl<FloatSums> >(regions[cid++], ctx, rt);
+        assert(dcAllRedSumFS->data());
+        //
+        dcAllGatherCV = new Item< DynColl<CoarseVector> >(
+            regions[cid++], ctx, rt
+        );
+        assert(dcAllGatherCV->data());
+        //
+        dcAllRedSumGS = new Item< DynColl<GramSums> >(regions[cid++], ctx, rt);
+        assert(dcAllRedSumGS->data());
+        //
         neighbors = new Array<int>(regions[cid++], ctx, rt);
         assert(neighbors->data());
         //
@@ -708,7 +907,6 @@ protected:
         Context ctx,
         HighLevelRuntime *runtime
     ) {
-        const int *const nd = neighbors->data();
         const SparseMatrixScalars *const sclrsd = sclrs->data();
         // Number of regions consumed.
         int cid = baseRID;
@@ -720,8 +918,7 @@ protected:
         }
         // Get neighbor regions that I will pull from.
         for (int n = 0; n < sclrsd->numberOfRecvNeighbors; ++n) {
-            const int nid = nd[n];
-            nidToPullRegion[nid] = regions[cid++];
+            pullRegions.push_back(regions[cid++].get_logical_region());
         }
         // Return number of regions that we have consumed.
         return cid - baseRID;
@@ -743,28 +940,26 @@ PopulateGlobalToLocalMap(
     const global_int_t nx  = Ageom->nx;
     const global_int_t ny  = Ageom->ny;
     const global_int_t nz  = Ageom->nz;
-    const global_int_t npx = Ageom->npx;
-    const global_int_t npy = Ageom->npy;
-    const global_int_t ipx = Ageom->ipx;
-    const global_int_t ipy = Ageom->ipy;
-    const global_int_t ipz = Ageom->ipz;
-    const global_int_t gnx = nx * npx;
-    const global_int_t gny = ny * npy;
+    const global_int_t gnx = Ageom->gnx;
+    const global_int_t gny = Ageom->gny;
     //!< global-to-local mapping
     auto &globalToLocalMap = A.globalToLocalMap;
-    //
+    globalToLocalMap.clear();
+    globalToLocalMap.reserve(nx * ny * nz);
+    // Rows are visited in ascending global order, so no sort is needed.
     for (local_int_t iz = 0; iz < nz; iz++) {
-        global_int_t giz = ipz*nz+iz;
+        global_int_t giz = Ageom->giz0+iz;
         for (local_int_t iy = 0; iy < ny; iy++) {
-            global_int_t giy = ipy*ny+iy;
+            global_int_t giy = Ageom->giy0+iy;
             for (local_int_t ix = 0; ix < nx; ix++) {
-                global_int_t gix = ipx*nx+ix;
+                global_int_t gix = Ageom->gix0+ix;
                 local_int_t currentLocalRow = iz*nx*ny+iy*nx+ix;
                 global_int_t currentGlobalRow = giz*gnx*gny+giy*gnx+gix;
-                globalToLocalMap[currentGlobalRow] = currentLocalRow;
+                globalToLocalMap.insert(currentGlobalRow, currentLocalRow);
             }
         }
     }
+    globalToLocalMap.finalize();
 }
 
 /**
@@ -801,6 +996,82 @@ SetupGhostArrays(
     }
 }
 
+/**
+ * Kernel selection of A that changes the launches issued by the solvers. Part
+ * of every trace key, so that toggling optimizations never replays a trace
+ * recorded for different kernels.
+ */
+inline int
+SolverTraceConfig(
+    const SparseMatrix &A
+) {
+    return (A.isMgOptimized      ? 1 : 0)
+         | (A.isSpmvOptimized    ? 2 : 0)
+         | (A.isMatrixFree       ? 4 : 0)
+         | (A.isMgMixedPrecision ? 8 : 0);
+}
+
+/**
+ * Begins the runtime trace of the given kind over vectors a and b if A is
+ * traced, so the runtime can memoize the dependence analysis of the launches
+ * that follow. Returns the TraceID to pass to EndSolverTrace, or 0 if no trace
+ * was started. Traces cannot nest.
+ */
+inline Legion::TraceID
+BeginSolverTrace(
+    SparseMatrix &A,
+    SolverTraceKind kind,
+    const Array<floatType> &a,
+    const Array<floatType> &b,
+    LegionRuntime::HighLevel::Context ctx,
+    LegionRuntime::HighLevel::HighLevelRuntime *lrt
+) {
+#ifdef LGNCG_TASKING
+    if (!A.isTraced) return 0;
+    //
+    const Legion::TraceID tid = A.traces.getID(
+        kind, SolverTraceConfig(A), a.logicalRegion, b.logicalRegion
+    );
+    lrt->begin_trace(ctx, tid);
+    return tid;
+#else
+    // Kernels run inline, so there is little to memoize.
+    return 0;
+#endif
+}
+
+/**
+ *
+ */
+inline void
+EndSolverTrace(
+    Legion::TraceID tid,
+    LegionRuntime::HighLevel::Context ctx,
+    LegionRuntime::HighLevel::HighLevelRuntime *lrt
+) {
+    if (tid) lrt->end_trace(ctx, tid);
+}
+
+/**
+ * Returns the private (first) subregion of a vector set up by Partition, i.e.,
+ * its first localNumberOfRows entries.
+ */
+inline LogicalRegion
+GetPrivateLogicalRegion(
+    Array<floatType> &x,
+    LegionRuntime::HighLevel::Context ctx,
+    LegionRuntime::HighLevel::HighLevelRuntime *lrt
+) {
+    auto xis = x.logicalRegion.get_index_space();
+    auto xip = lrt->get_index_partition(ctx, xis, 0 /* color */);
+    auto xlp = lrt->get_logical_partition(ctx, x.logicalRegion, xip);
+    return lrt->get_logical_subregion_by_color(
+        ctx,
+        xlp,
+        DomainPoint::from_point<1>(0) // First is private.
+    );
+}
+
 /*!
     Copy values from matrix diagonal into user-provided vector.
 
@@ -868,6 +1139,28 @@ ReplaceMatrixDiagonal(
         const local_int_t mcol = mid2rc[i].second;
         matrixValues(mrow, mcol) = dv[i];
     }
+    // Keep the reduced-precision copies in sync.
+    if (A.mgMatrixValues) {
+        mgFloatType *const mgDiagA = A.mgMatrixDiagonal->data();
+        assert(mgDiagA);
+        Array2D<mgFloatType> mgMatrixValues(
+            nrow, nnpr, A.mgMatrixValues->data()
+        );
+        for (local_int_t i = 0; i < nrow; ++i) {
+            mgDiagA[i] = mgFloatType(dv[i]);
+            mgMatrixValues(mid2rc[i].first, mid2rc[i].second)
+                = mgFloatType(dv[i]);
+        }
+    }
+    // And the SELL-C-sigma slices, which hold the diagonal too.
+    if (A.sell) {
+        floatType *const sellValues = A.sell->values->data();
+        assert(sellValues);
+        for (local_int_t i = 0; i < nrow; ++i) {
+            assert(A.sell->diagEntries[i] >= 0);
+            sellValues[A.sell->diagEntries[i]] = dv[i];
+        }
+    }
 }
 
 /**
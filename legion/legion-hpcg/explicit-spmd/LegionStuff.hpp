@@ -33,6 +33,7 @@
 
 #include "TaskTIDs.hpp"
 #include "Types.hpp"
+#include "CGMapper.hpp"
 
 #include "legion.h"
 
@@ -84,13 +85,6 @@ startBenchmarkTask(
     Context ctx, HighLevelRuntime *runtime
 );
 
-void
-regionToRegionCopyTask(
-    const Task *task,
-    const std::vector<PhysicalRegion> &regions,
-    Context ctx, HighLevelRuntime *runtime
-);
-
 void
 registerCollectiveOpsTasks(void);
 
@@ -124,6 +118,18 @@ registerComputeResidualTasks(void);
 void
 registerExchangeHaloTasks(void);
 
+void
+registerFusedCGTasks(void);
+
+void
+registerSetupHaloTasks(void);
+
+void
+registerAgglomeratedMGTasks(void);
+
+void
+registerSStepCGTasks(void);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Task Registration
 ////////////////////////////////////////////////////////////////////////////////
@@ -153,15 +159,6 @@ registerTasks(void)
         TaskConfigOptions(false /* leaf task */),
         "startBenchmarkTask"
     );
-    HighLevelRuntime::register_legion_task<regionToRegionCopyTask>(
-        REGION_TO_REGION_COPY_TID /* task id */,
-        Processor::LOC_PROC /* proc kind  */,
-        true /* single */,
-        true /* index */,
-        AUTO_GENERATE_ID,
-        TaskConfigOptions(true /* leaf task */),
-        "regionToRegionCopyTask"
-    );
     //
     registerCollectiveOpsTasks();
     //
@@ -184,6 +181,14 @@ registerTasks(void)
     registerComputeResidualTasks();
     //
     registerExchangeHaloTasks();
+    //
+    registerFusedCGTasks();
+    //
+    registerSetupHaloTasks();
+    //
+    registerAgglomeratedMGTasks();
+    //
+    registerSStepCGTasks();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -193,11 +198,11 @@ updateMappers(
     HighLevelRuntime *runtime,
     const std::set<Processor> &local_procs
 ) {
-#if 0 // Disable for now.
     for (const auto &p : local_procs) {
-        runtime->replace_default_mapper(new CGMapper(machine, runtime, p), p);
+        runtime->replace_default_mapper(
+            new CGMapper(runtime->get_mapper_runtime(), machine, p), p
+        );
     }
-#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////
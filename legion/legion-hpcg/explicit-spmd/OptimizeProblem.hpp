@@ -41,21 +41,169 @@
 //@HEADER
 
 /*!
-    @file OptimizeProblem.cpp
+    @file OptimizeProblem.hpp
 
     HPCG routine
  */
 
 #pragma once
 
+#include "LegionStuff.hpp"
 #include "LegionArrays.hpp"
 #include "LegionMatrices.hpp"
 #include "LegionCGData.hpp"
+#include "LegionMGData.hpp"
+#include "SetupHalo.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+
+/**
+ * Moves row i of the row-major array data (rowLen entries per row) to row
+ * newRow[i].
+ */
+template <typename TYPE>
+inline void
+PermuteRows(
+    TYPE *data,
+    local_int_t rowLen,
+    const std::vector<local_int_t> &newRow
+) {
+    assert(data);
+    const local_int_t nrow = newRow.size();
+    const std::vector<TYPE> tmp(data, data + size_t(nrow) * rowLen);
+    //
+    for (local_int_t i = 0; i < nrow; ++i) {
+        std::copy(
+            tmp.begin() + size_t(i) * rowLen,
+            tmp.begin() + size_t(i + 1) * rowLen,
+            data + size_t(newRow[i]) * rowLen
+        );
+    }
+}
+
+/*!
+    Colors the local rows of A such that no two rows of the same color are
+    coupled through a local column, then permutes A so that the rows of each
+    color are stored contiguously. The coloring is greedy (first-fit) in
+    natural order, which yields the eight (ix%2, iy%2, iz%2) parity colors for
+    the 27-point stencil. External (halo) columns do not constrain the
+    coloring since their values are not updated during a sweep.
+
+    @param[inout] A      The matrix to reorder.
+
+    @param[out]   newRow Storage row of each natural row (old to new).
+
+    @return returns 0 upon success and non-zero otherwise.
+*/
+inline int
+ColorAndPermuteMatrix(
+    SparseMatrix &A,
+    std::vector<local_int_t> &newRow,
+    Context ctx,
+    Runtime *lrt
+) {
+    const SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    const Geometry *const Ageom = A.geom->data();
+    //
+    const local_int_t nrow = Asclrs->localNumberOfRows;
+    const int nnpr = Ageom->stencilSize;
+    //
+    const char *const nonzerosInRow = A.nonzerosInRow->data();
+    assert(nonzerosInRow);
+    // Interpreted as 2D array
+    Array2D<local_int_t> mtxIndL(
+        nrow, nnpr, A.mtxIndL->data()
+    );
+    // Greedy first-fit coloring. A row has at most HPCG_STENCIL - 1
+    // neighbors, so HPCG_STENCIL colors always suffice.
+    std::vector<int> colors(nrow, -1);
+    int nColors = 0;
+    for (local_int_t i = 0; i < nrow; ++i) {
+        uint32_t used = 0;
+        const local_int_t *const cols = mtxIndL(i);
+        for (int j = 0; j < nonzerosInRow[i]; ++j) {
+            const local_int_t col = cols[j];
+            if (col < nrow && col != i && colors[col] >= 0) {
+                used |= (uint32_t(1) << colors[col]);
+            }
+        }
+        int c = 0;
+        while (used & (uint32_t(1) << c)) ++c;
+        colors[i] = c;
+        nColors = std::max(nColors, c + 1);
+    }
+    if (nColors > HPCG_STENCIL) return 1;
+    // Counting sort by color.
+    A.nColors = nColors;
+    std::fill(A.colorOffsets, A.colorOffsets + HPCG_STENCIL + 1, 0);
+    for (local_int_t i = 0; i < nrow; ++i) {
+        A.colorOffsets[colors[i] + 1]++;
+    }
+    for (int c = 0; c < nColors; ++c) {
+        A.colorOffsets[c + 1] += A.colorOffsets[c];
+    }
+    std::vector<local_int_t> next(A.colorOffsets, A.colorOffsets + nColors);
+    newRow.resize(nrow);
+    for (local_int_t i = 0; i < nrow; ++i) {
+        newRow[i] = next[colors[i]]++;
+    }
+    // Permute all row-indexed matrix structures.
+    PermuteRows(A.nonzerosInRow->data(),      1,    newRow);
+    PermuteRows(A.mtxIndG->data(),            nnpr, newRow);
+    PermuteRows(A.mtxIndL->data(),            nnpr, newRow);
+    PermuteRows(A.matrixValues->data(),       nnpr, newRow);
+    PermuteRows(A.matrixDiagonal->data(),     1,    newRow);
+    PermuteRows(A.localToGlobalMap->data(),   1,    newRow);
+    PermuteRows(A.matdIdxToMatRowCol->data(), 1,    newRow);
+    // Renumber local column indices. Halo columns keep their numbering.
+    for (local_int_t i = 0; i < nrow; ++i) {
+        local_int_t *const cols = mtxIndL(i);
+        for (int j = 0; j < nonzerosInRow[i]; ++j) {
+            if (cols[j] < nrow) cols[j] = newRow[cols[j]];
+        }
+    }
+    rcpType *const mid2rc = A.matdIdxToMatRowCol->data();
+    for (local_int_t i = 0; i < nrow; ++i) {
+        mid2rc[i].first = newRow[mid2rc[i].first];
+    }
+    for (auto &localRow : A.globalToLocalMap.values()) {
+        localRow = newRow[localRow];
+    }
+    if (A.elementsToSend) {
+        local_int_t *const elementsToSend = A.elementsToSend->data();
+        const local_int_t totalToBeSent = Asclrs->totalToBeSent;
+        for (local_int_t i = 0; i < totalToBeSent; ++i) {
+            elementsToSend[i] = newRow[elementsToSend[i]];
+        }
+    }
+    // Keep the natural ordering around for the reference SYMGS sweeps.
+    A.lNaturalOrder.allocate("naturalOrder", nrow, ctx, lrt);
+    A.naturalOrder = new Array<local_int_t>(
+        A.lNaturalOrder.mapRegion(RW_E, ctx, lrt), ctx, lrt
+    );
+    local_int_t *const naturalOrder = A.naturalOrder->data();
+    assert(naturalOrder);
+    std::copy(newRow.begin(), newRow.end(), naturalOrder);
+    // Interior/boundary split of the new row order (grouped by color).
+    ClassifyHaloRows(A, ctx, lrt);
+    //
+    A.isMgOptimized = true;
+    //
+    return 0;
+}
 
 /*!
     Optimizes the data structures used for CG iteration to increase the
     performance of the benchmark version of the preconditioned CG algorithm.
 
+    Every level of the MG hierarchy is multicolor reordered (see
+    ColorAndPermuteMatrix) so that ComputeSYMGS can update the rows of each
+    color in parallel. The vectors and the restriction operators are permuted
+    accordingly. Must be called after SetupHalo and f2cOperatorPopulate.
+
     @param[inout] A      The known system matrix, also contains the MG hierarchy
                          in attributes Ac and mgData.
 
@@ -76,23 +224,509 @@
 */
 inline int
 OptimizeProblem(
-    SparseMatrix &,
+    SparseMatrix &A,
     CGData &,
-    Array<floatType> &,
-    Array<floatType> &,
-    Array<floatType> &
+    Array<floatType> &b,
+    Array<floatType> &x,
+    Array<floatType> &xexact,
+    Context ctx,
+    Runtime *lrt
+) {
+    using namespace std;
+    // Old to new row numbering for each level.
+    vector< vector<local_int_t> > newRows;
+    //
+    for (SparseMatrix *curLevelMatrix = &A; curLevelMatrix;
+         curLevelMatrix = curLevelMatrix->Ac) {
+        newRows.push_back(vector<local_int_t>());
+        int ierr = ColorAndPermuteMatrix(
+            *curLevelMatrix, newRows.back(), ctx, lrt
+        );
+        if (ierr) return ierr;
+    }
+    // The vectors live on the finest level.
+    PermuteRows(b.data(),      1, newRows[0]);
+    PermuteRows(x.data(),      1, newRows[0]);
+    PermuteRows(xexact.data(), 1, newRows[0]);
+    // Renumber both sides of the fine-to-coarse injection operators.
+    int level = 0;
+    for (SparseMatrix *curLevelMatrix = &A; curLevelMatrix->Ac;
+         curLevelMatrix = curLevelMatrix->Ac, ++level) {
+        const vector<local_int_t> &newFine   = newRows[level];
+        const vector<local_int_t> &newCoarse = newRows[level + 1];
+        //
+        local_int_t *const f2cOperator =
+            curLevelMatrix->mgData->f2cOperator->data();
+        assert(f2cOperator);
+        //
+        const vector<local_int_t> f2c(
+            f2cOperator, f2cOperator + newCoarse.size()
+        );
+        for (size_t i = 0; i < f2c.size(); ++i) {
+            f2cOperator[newCoarse[i]] = newFine[f2c[i]];
+        }
+    }
+    //
+    return 0;
+}
+
+/*!
+    Builds a SELL-C-sigma copy of A (see SellMatrix) for the vectorized SpMV
+    and SYMGS kernels. Must be called after SetupHalo and, if used, after
+    OptimizeProblem, since the slices follow the final row and column
+    numbering. Slices of a multicolor-ordered matrix never straddle colors.
+
+    @param[inout] A     The matrix; on exit A.sell is populated.
+
+    @param[in]    sigma Sorting window size in rows (at least 1).
+
+    @return returns 0 upon success and non-zero otherwise.
+*/
+inline int
+SetupSellMatrix(
+    SparseMatrix &A,
+    int sigma,
+    Context ctx,
+    Runtime *lrt
 ) {
-    // This function can be used to completely transform any part of the data
-    // structures.  Right now it does nothing.
+    using namespace std;
+    //
+    if (sigma < 1) return 1;
+    const local_int_t C = LGNCG_SELL_C;
+    //
+    const SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    const Geometry *const Ageom = A.geom->data();
+    const local_int_t nrow = Asclrs->localNumberOfRows;
+    const int nnpr = Ageom->stencilSize;
+    //
+    const char *const nonzerosInRow = A.nonzerosInRow->data();
+    assert(nonzerosInRow);
+    Array2D<floatType> matrixValues(nrow, nnpr, A.matrixValues->data());
+    Array2D<local_int_t> mtxIndL(nrow, nnpr, A.mtxIndL->data());
+    // Row segments that slices may not straddle: one per color, or just one.
+    vector<local_int_t> segments;
+    if (A.nColors > 0) {
+        segments.assign(A.colorOffsets, A.colorOffsets + A.nColors + 1);
+    }
+    else {
+        segments = {0, nrow};
+    }
+    const int nSegments = segments.size() - 1;
+    //
+    SellMatrix *sell = new SellMatrix();
+    sell->sigma = sigma;
+    sell->nColors = A.nColors;
+    // Slice lanes in order; -1 pads the last slice of a segment.
+    vector<local_int_t> laneRows;
+    vector<local_int_t> sliceWidths;
+    for (int s = 0; s < nSegments; ++s) {
+        sell->colorSliceOffsets[s] = sliceWidths.size();
+        for (local_int_t w0 = segments[s]; w0 < segments[s + 1]; w0 += sigma) {
+            const local_int_t w1 = min(w0 + sigma, segments[s + 1]);
+            // Sort the window by decreasing row length.
+            vector<local_int_t> window(w1 - w0);
+            for (local_int_t i = w0; i < w1; ++i) window[i - w0] = i;
+            stable_sort(window.begin(), window.end(),
+                [&](local_int_t a, local_int_t b) {
+                    return nonzerosInRow[a] > nonzerosInRow[b];
+                }
+            );
+            for (size_t k = 0; k < window.size(); k += C) {
+                local_int_t width = 0;
+                for (local_int_t l = 0; l < C; ++l) {
+                    if (k + l < window.size()) {
+                        const local_int_t row = window[k + l];
+                        laneRows.push_back(row);
+                        width = max(width, local_int_t(nonzerosInRow[row]));
+                    }
+                    else {
+                        laneRows.push_back(-1);
+                    }
+                }
+                sliceWidths.push_back(width);
+            }
+        }
+    }
+    sell->colorSliceOffsets[nSegments] = sliceWidths.size();
+    sell->nSlices = sliceWidths.size();
+    sell->nEntries = 0;
+    for (local_int_t w : sliceWidths) sell->nEntries += w * C;
+    // Allocate and map the task-local regions.
+    sell->lValues.allocate("sellValues", max(sell->nEntries, C), ctx, lrt);
+    sell->lColInds.allocate("sellColInds", max(sell->nEntries, C), ctx, lrt);
+    sell->lSliceOffsets.allocate("sellSliceOffsets", sell->nSlices + 1, ctx, lrt);
+    sell->lRows.allocate("sellRows", max(sell->nSlices * C, C), ctx, lrt);
+    //
+    sell->values = new Array<floatType>(
+        sell->lValues.mapRegion(RW_E, ctx, lrt), ctx, lrt
+    );
+    sell->colInds = new Array<local_int_t>(
+        sell->lColInds.mapRegion(RW_E, ctx, lrt), ctx, lrt
+    );
+    sell->sliceOffsets = new Array<local_int_t>(
+        sell->lSliceOffsets.mapRegion(RW_E, ctx, lrt), ctx, lrt
+    );
+    sell->rows = new Array<local_int_t>(
+        sell->lRows.mapRegion(RW_E, ctx, lrt), ctx, lrt
+    );
+    floatType *const values = sell->values->data();
+    local_int_t *const colInds = sell->colInds->data();
+    local_int_t *const sliceOffsets = sell->sliceOffsets->data();
+    local_int_t *const rows = sell->rows->data();
+    assert(values && colInds && sliceOffsets && rows);
+    // Fill the slices.
+    sell->diagEntries.assign(nrow, -1);
+    local_int_t off = 0;
+    for (local_int_t sl = 0; sl < sell->nSlices; ++sl) {
+        sliceOffsets[sl] = off;
+        // A valid column for padding (any row of this slice).
+        const local_int_t padCol = laneRows[sl * C];
+        for (local_int_t l = 0; l < C; ++l) {
+            const local_int_t row = laneRows[sl * C + l];
+            rows[sl * C + l] = row;
+            const local_int_t nnz = row >= 0 ? nonzerosInRow[row] : 0;
+            for (local_int_t j = 0; j < sliceWidths[sl]; ++j) {
+                const local_int_t e = off + j * C + l;
+                if (j < nnz) {
+                    values[e]  = matrixValues(row, j);
+                    colInds[e] = mtxIndL(row, j);
+                    if (colInds[e] == row) sell->diagEntries[row] = e;
+                }
+                else {
+                    values[e]  = 0.0;
+                    colInds[e] = row >= 0 ? row : padCol;
+                }
+            }
+        }
+        off += sliceWidths[sl] * C;
+    }
+    sliceOffsets[sell->nSlices] = off;
+    //
+    delete A.sell;
+    A.sell = sell;
+    A.isSpmvOptimized = true;
+    //
+    return 0;
+}
+
+/*!
+    Sets up the matrix-free form of A (see StencilOperator). Must be called
+    after SetupHalo and, if used, after OptimizeProblem. A is checked against
+    the operator described by its grid first: every interior row must hold
+    exactly its grid neighbors (in the parity-colored numbering, if
+    reordered), and all off-diagonal values must be -1.
+
+    @param[inout] A The matrix; on exit A.stencil is populated.
+
+    @return returns 0 upon success and non-zero otherwise (A is left as is).
+*/
+inline int
+SetupStencilOperator(
+    SparseMatrix &A,
+    Context ctx,
+    HighLevelRuntime *lrt
+) {
+    using namespace std;
+    //
+    const SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    const Geometry *const Ageom = A.geom->data();
+    assert(Asclrs && Ageom);
+    //
+    const local_int_t nrow = Asclrs->localNumberOfRows;
+    const int nnpr = Ageom->stencilSize;
+    if (!A.haloSplitRows || nnpr != HPCG_STENCIL) return 1;
+    //
+    StencilGrid grid;
+    grid.nx = Ageom->nx;
+    grid.ny = Ageom->ny;
+    grid.nz = Ageom->nz;
+    grid.colored = (A.nColors > 0);
+    grid.nColors = A.nColors;
+    copy(A.colorOffsets, A.colorOffsets + HPCG_STENCIL + 1, grid.colorOffsets);
+    if (grid.colored && grid.nColors > 8) return 1;
+    //
+    const char *const nonzerosInRow = A.nonzerosInRow->data();
+    const floatType *const matrixDiagonal = A.matrixDiagonal->data();
+    const local_int_t *const rows = A.haloSplitRows->data();
+    assert(nonzerosInRow && matrixDiagonal && rows);
+    Array2D<floatType> matrixValues(nrow, nnpr, A.matrixValues->data());
+    Array2D<local_int_t> mtxIndL(nrow, nnpr, A.mtxIndL->data());
+    // Off-diagonal values must be -1 everywhere.
+    for (local_int_t i = 0; i < nrow; ++i) {
+        for (int j = 0; j < nonzerosInRow[i]; ++j) {
+            if (mtxIndL(i, j) != i && matrixValues(i, j) != -1.0) return 1;
+        }
+    }
+    // Interior rows must match the grid.
+    vector<local_int_t> expected, actual;
+    for (local_int_t k = 0; k < A.nInteriorRows; ++k) {
+        const local_int_t i = rows[k];
+        const int c = grid.colored
+                    ? int(upper_bound(grid.colorOffsets,
+                                      grid.colorOffsets + grid.nColors + 1, i)
+                          - grid.colorOffsets) - 1
+                    : 0;
+        local_int_t ix, iy, iz;
+        StencilGridPoint(grid, c, i, ix, iy, iz);
+        if (ix >= grid.nx || iy >= grid.ny || iz >= grid.nz) return 1;
+        //
+        expected.clear();
+        for (int sz = -1; sz <= 1; ++sz) {
+            for (int sy = -1; sy <= 1; ++sy) {
+                for (int sx = -1; sx <= 1; ++sx) {
+                    const local_int_t jx = ix + sx;
+                    const local_int_t jy = iy + sy;
+                    const local_int_t jz = iz + sz;
+                    if (jx < 0 || jx >= grid.nx) continue;
+                    if (jy < 0 || jy >= grid.ny) continue;
+                    if (jz < 0 || jz >= grid.nz) continue;
+                    expected.push_back(StencilStorageRow(grid, jx, jy, jz));
+                }
+            }
+        }
+        actual.assign(mtxIndL(i), mtxIndL(i) + nonzerosInRow[i]);
+        sort(expected.begin(), expected.end());
+        sort(actual.begin(), actual.end());
+        if (expected != actual) return 1;
+    }
+    // Boundary rows keep their columns.
+    StencilOperator *stencil = new StencilOperator();
+    stencil->grid = grid;
+    stencil->nBoundaryRows = nrow - A.nInteriorRows;
+    const local_int_t nb = stencil->nBoundaryRows;
+    //
+    stencil->lBoundaryColInds.allocate(
+        "stencilBoundaryColInds", max(nb, 1) * HPCG_STENCIL, ctx, lrt
+    );
+    stencil->lBoundaryNnz.allocate(
+        "stencilBoundaryNnz", max(nb, 1), ctx, lrt
+    );
+    stencil->boundaryColInds = new Array<local_int_t>(
+        stencil->lBoundaryColInds.mapRegion(RW_E, ctx, lrt), ctx, lrt
+    );
+    stencil->boundaryNnz = new Array<char>(
+        stencil->lBoundaryNnz.mapRegion(RW_E, ctx, lrt), ctx, lrt
+    );
+    local_int_t *const bcols = stencil->boundaryColInds->data();
+    char *const bnnz = stencil->boundaryNnz->data();
+    assert(bcols && bnnz);
+    //
+    for (local_int_t b = 0; b < nb; ++b) {
+        const local_int_t i = rows[A.nInteriorRows + b];
+        bnnz[b] = nonzerosInRow[i];
+        copy(mtxIndL(i), mtxIndL(i) + nonzerosInRow[i],
+             bcols + b * HPCG_STENCIL);
+    }
+    //
+    delete A.stencil;
+    A.stencil = stencil;
+    A.isMatrixFree = true;
+    //
+    return 0;
+}
+
+/*!
+    Sets up the structured form of the send lists of A (see StructuredHalo).
+    Must be called after SetupHalo and, if used, after OptimizeProblem. The
+    values sent to every neighbor must be exactly the points of one box of the
+    local grid in natural order, as they are for the 27-point problem of
+    GenerateProblem; otherwise ExchangeHalo keeps packing through
+    elementsToSend.
+
+    @param[inout] A The matrix; on exit A.structuredHalo is populated.
+
+    @return returns 0 upon success and non-zero otherwise (A is left as is).
+*/
+inline int
+SetupStructuredHalo(
+    SparseMatrix &A
+) {
+    using namespace std;
+    //
+    const SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    const Geometry *const Ageom = A.geom->data();
+    assert(Asclrs && Ageom);
+    //
+    const int nNeighbors = Asclrs->numberOfSendNeighbors;
+    if (!A.elementsToSend || nNeighbors > HPCG_STENCIL - 1) return 1;
+    //
+    StructuredHalo halo;
+    StencilGrid &grid = halo.grid;
+    grid.nx = Ageom->nx;
+    grid.ny = Ageom->ny;
+    grid.nz = Ageom->nz;
+    grid.colored = (A.nColors > 0);
+    grid.nColors = A.nColors;
+    copy(A.colorOffsets, A.colorOffsets + HPCG_STENCIL + 1, grid.colorOffsets);
+    if (grid.colored && grid.nColors > 8) return 1;
+    if (grid.nx * grid.ny * grid.nz != Asclrs->localNumberOfRows) return 1;
+    halo.nNeighbors = nNeighbors;
+    //
+    const local_int_t *const elementsToSend = A.elementsToSend->data();
+    const local_int_t *const sendLength = A.sendLength->data();
+    assert(elementsToSend && sendLength);
+    //
+    local_int_t off = 0;
+    for (int n = 0; n < nNeighbors; ++n) {
+        const local_int_t *const ids = elementsToSend + off;
+        const local_int_t len = sendLength[n];
+        off += len;
+        if (len == 0) return 1;
+        // Bounding box of the points sent.
+        StencilBox &box = halo.boxes[n];
+        box.lo[0] = grid.nx; box.lo[1] = grid.ny; box.lo[2] = grid.nz;
+        box.hi[0] = box.hi[1] = box.hi[2] = 0;
+        for (local_int_t k = 0; k < len; ++k) {
+            const int c = grid.colored
+                        ? int(upper_bound(grid.colorOffsets,
+                                          grid.colorOffsets + grid.nColors + 1,
+                                          ids[k])
+                              - grid.colorOffsets) - 1
+                        : 0;
+            local_int_t p[3];
+            StencilGridPoint(grid, c, ids[k], p[0], p[1], p[2]);
+            for (int d = 0; d < 3; ++d) {
+                box.lo[d] = min(box.lo[d], p[d]);
+                box.hi[d] = max(box.hi[d], p[d] + 1);
+            }
+        }
+        // The list must be that box in natural order.
+        local_int_t k = 0;
+        for (local_int_t iz = box.lo[2]; iz < box.hi[2]; ++iz) {
+            for (local_int_t iy = box.lo[1]; iy < box.hi[1]; ++iy) {
+                for (local_int_t ix = box.lo[0]; ix < box.hi[0]; ++ix) {
+                    if (k == len) return 1;
+                    if (ids[k++] != StencilStorageRow(grid, ix, iy, iz)) {
+                        return 1;
+                    }
+                }
+            }
+        }
+        if (k != len) return 1;
+    }
+    //
+    delete A.structuredHalo;
+    A.structuredHalo = new StructuredHalo(halo);
+    //
     return 0;
 }
 
 /**
- *
+ * Builds reduced-precision (mgFloatType) copies of the matrix values and
+ * diagonal of A for the mixed-precision MG preconditioner. They are not used
+ * until selected by SetMixedPrecisionMG. Must be called while the structures
+ * of A are mapped.
+ */
+inline int
+SetupMixedPrecisionMG(
+    SparseMatrix &A,
+    Context ctx,
+    HighLevelRuntime *lrt
+) {
+    const SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    assert(Asclrs);
+    const local_int_t nrow = Asclrs->localNumberOfRows;
+    const local_int_t nnpr = A.geom->data()->stencilSize;
+    //
+    const floatType *const matrixValues = A.matrixValues->data();
+    const floatType *const matrixDiagonal = A.matrixDiagonal->data();
+    assert(matrixValues && matrixDiagonal);
+    //
+    A.lMgMatrixValues.allocate("mgMatrixValues", nrow * nnpr, ctx, lrt);
+    A.lMgMatrixDiagonal.allocate("mgMatrixDiagonal", nrow, ctx, lrt);
+    //
+    delete A.mgMatrixValues;
+    A.mgMatrixValues = new Array<mgFloatType>(
+        A.lMgMatrixValues.mapRegion(RW_E, ctx, lrt), ctx, lrt
+    );
+    delete A.mgMatrixDiagonal;
+    A.mgMatrixDiagonal = new Array<mgFloatType>(
+        A.lMgMatrixDiagonal.mapRegion(RW_E, ctx, lrt), ctx, lrt
+    );
+    mgFloatType *const mgValues = A.mgMatrixValues->data();
+    mgFloatType *const mgDiagonal = A.mgMatrixDiagonal->data();
+    assert(mgValues && mgDiagonal);
+    //
+    for (local_int_t i = 0; i < nrow * nnpr; ++i) {
+        mgValues[i] = mgFloatType(matrixValues[i]);
+    }
+    for (local_int_t i = 0; i < nrow; ++i) {
+        mgDiagonal[i] = mgFloatType(matrixDiagonal[i]);
+    }
+    //
+    return 0;
+}
+
+/**
+ * Selects between the reduced-precision (SetupMixedPrecisionMG) and the
+ * full-precision matrices in ComputeMG on all levels of A. CG itself always
+ * uses the full-precision matrix.
+ */
+inline void
+SetMixedPrecisionMG(
+    SparseMatrix &A,
+    bool mixed
+) {
+    for (SparseMatrix *curLevelMatrix = &A; curLevelMatrix;
+         curLevelMatrix = curLevelMatrix->Ac) {
+        curLevelMatrix->isMgMixedPrecision = mixed
+                                           && curLevelMatrix->mgMatrixValues;
+    }
+}
+
+/**
+ * Selects between the optimized kernels (multicolor SYMGS, SELL-C-sigma SpMV,
+ * matrix-free operator) and the reference ones on all levels of A. A kernel is
+ * only selected if its data structures were set up.
+ */
+inline void
+SetOptimizedKernels(
+    SparseMatrix &A,
+    bool optimized
+) {
+    for (SparseMatrix *curLevelMatrix = &A; curLevelMatrix;
+         curLevelMatrix = curLevelMatrix->Ac) {
+        curLevelMatrix->isMgOptimized = optimized
+                                      && curLevelMatrix->nColors > 0;
+        curLevelMatrix->isSpmvOptimized = optimized
+                                        && curLevelMatrix->sell != nullptr;
+        curLevelMatrix->isMatrixFree = optimized
+                                     && curLevelMatrix->stencil != nullptr;
+    }
+}
+
+/**
+ * Returns the global number of bytes allocated by OptimizeProblem.
  */
 inline double
 OptimizeProblemMemoryUse(
-    SparseMatrix &
+    SparseMatrix &A
 ) {
-    return 0.0;
+    double nbytes = 0.0;
+    for (SparseMatrix *curLevelMatrix = &A; curLevelMatrix;
+         curLevelMatrix = curLevelMatrix->Ac) {
+        const SparseMatrixScalars *const Asclrs = curLevelMatrix->sclrs->data();
+        if (curLevelMatrix->naturalOrder) {
+            nbytes += double(Asclrs->totalNumberOfRows) * sizeof(local_int_t);
+        }
+        // Estimate of the global size using the value from this shard.
+        if (const SellMatrix *sell = curLevelMatrix->sell) {
+            const double size = curLevelMatrix->geom->data()->size;
+            nbytes += size * sell->nEntries
+                    * (sizeof(floatType) + sizeof(local_int_t));
+            nbytes += size * sell->nSlices
+                    * (LGNCG_SELL_C + 1) * sizeof(local_int_t);
+        }
+        if (const StencilOperator *stencil = curLevelMatrix->stencil) {
+            const double size = curLevelMatrix->geom->data()->size;
+            nbytes += size * stencil->nBoundaryRows
+                    * (HPCG_STENCIL * sizeof(local_int_t) + sizeof(char));
+        }
+        if (curLevelMatrix->mgMatrixValues) {
+            nbytes += double(Asclrs->totalNumberOfRows)
+                    * (curLevelMatrix->geom->data()->stencilSize + 1)
+                    * sizeof(mgFloatType);
+        }
+    }
+    return nbytes;
 }
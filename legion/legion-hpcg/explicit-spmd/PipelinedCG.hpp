@@ -0,0 +1,319 @@
+/**
+ * Copyright (c)      2017 Los Alamos National Security, LLC
+ *                         All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LA-CC 10-123
+ */
+
+/*!
+    @file PipelinedCG.hpp
+
+    Pipelined preconditioned CG (Ghysels and Vanroose). The recurrences are
+    rearranged so that the reductions of an iteration are not needed until
+    after that iteration's preconditioner apply and SpMV have been issued.
+ */
+
+#pragma once
+
+#include "hpcg.hpp"
+#include "mytimer.hpp"
+
+#include "LegionArrays.hpp"
+#include "LegionMatrices.hpp"
+#include "LegionCGData.hpp"
+#include "VectorOps.hpp"
+
+#include "CG.hpp"
+#include "ComputeFusedCG.hpp"
+
+#include <cmath>
+
+/**
+ * Vectors used by PipelinedCG in addition to the ones in CGData. u and m are
+ * preconditioner outputs and SpMV inputs, so they carry ghosts.
+ */
+struct PipelinedCGData {
+    LogicalArray<floatType> lu, lm, lw, lq, ls;
+    //
+    Array<floatType> *u = nullptr; // M * r
+    Array<floatType> *m = nullptr; // M * w
+    Array<floatType> *w = nullptr; // A * u
+    Array<floatType> *q = nullptr; // Recurrence for M * s.
+    Array<floatType> *s = nullptr; // Recurrence for A * p.
+
+    /**
+     *
+     */
+    void
+    allocate(
+        SparseMatrix &A,
+        Context ctx,
+        Runtime *lrt
+    ) {
+        const local_int_t nrow = A.sclrs->data()->localNumberOfRows;
+        const local_int_t ncol = A.sclrs->data()->localNumberOfColumns;
+        //
+        lu.allocate("pcg-u", ncol, ctx, lrt);
+        lm.allocate("pcg-m", ncol, ctx, lrt);
+        lw.allocate("pcg-w", nrow, ctx, lrt);
+        lq.allocate("pcg-q", nrow, ctx, lrt);
+        ls.allocate("pcg-s", nrow, ctx, lrt);
+        //
+        Partition(A, lu, ctx, lrt);
+        Partition(A, lm, ctx, lrt);
+        //
+        u = new Array<floatType>(lu.mapRegion(RW_E, ctx, lrt), ctx, lrt);
+        m = new Array<floatType>(lm.mapRegion(RW_E, ctx, lrt), ctx, lrt);
+        w = new Array<floatType>(lw.mapRegion(RW_E, ctx, lrt), ctx, lrt);
+        q = new Array<floatType>(lq.mapRegion(RW_E, ctx, lrt), ctx, lrt);
+        s = new Array<floatType>(ls.mapRegion(RW_E, ctx, lrt), ctx, lrt);
+        //
+        SetupGhostArrays(A, *u, ctx, lrt);
+        SetupGhostArrays(A, *m, ctx, lrt);
+    }
+
+    /**
+     *
+     */
+    void
+    deallocate(
+        Context ctx,
+        Runtime *lrt
+    ) {
+        LogicalArray<floatType> *las[] = {&lu, &lm, &lw, &lq, &ls};
+        for (auto *la : las) {
+            la->unmapRegion(ctx, lrt);
+            la->deallocate(ctx, lrt);
+        }
+        //
+        delete u; u = nullptr;
+        delete m; m = nullptr;
+        delete w; w = nullptr;
+        delete q; q = nullptr;
+        delete s; s = nullptr;
+    }
+};
+
+/*!
+    Pipelined preconditioned CG. Same interface and stopping criterion as
+    CG(), but each iteration only depends on the global r' * u and w' * u of
+    the same iteration after M * w and A * M * w have been launched, so the
+    reductions overlap with the preconditioner and the SpMV. Both dot products
+    and r' * r for the (one iteration late) convergence check are computed in
+    one pass and reduced in one collective round. This costs
+    four extra vector recurrences (fused into a single pass) and slightly
+    different rounding behavior than CG().
+
+    @param[inout] pdata The additional vectors used by the pipelined
+                  recurrences (see PipelinedCGData).
+
+    @see CG()
+*/
+inline int
+PipelinedCG(
+    SparseMatrix     &A,
+    CGData           &data,
+    PipelinedCGData  &pdata,
+    Array<floatType> &b,
+    Array<floatType> &x,
+    const int        maxIter,
+    const floatType  tolerance,
+    int              &niters,
+    floatType        &normr,
+    floatType        &normr0,
+    double           *times,
+    bool             doPreconditioning,
+    Context          ctx,
+    Runtime          *lrt,
+    int              checkFreq = 1
+) {
+    using namespace std;
+    // Start timing right away.
+    double t_begin = mytimer();
+    //
+    const int print_freq = 10;
+    const int rank = A.geom->data()->rank;
+    const local_int_t nrow = A.sclrs->data()->localNumberOfRows;
+    //
+    Future normrFuture, alphaFuture, betaFuture;
+    // gamma = r' * u, delta = w' * u and r' * r, reduced together
+    // (entries 0, 1 and 2).
+    Future sumsFuture, oldSumsFuture;
+    const int GAMMA = 0, DELTA = 1, RR = 2;
+    double t0 = 0.0, t1 = 0.0, t2 = 0.0, t3 = 0.0, t4 = 0.0, t5 = 0.0, t6 = 0.0;
+    //
+    normr = 0.0;
+    niters = 0;
+    //
+    Array<floatType> &r  = *(data.r);
+    Array<floatType> &z  = *(data.z); // Recurrence for A * q.
+    Array<floatType> &p  = *(data.p);
+    Array<floatType> &n  = *(data.Ap);// Holds A * m.
+    Array<floatType> &u  = *(pdata.u);
+    Array<floatType> &m  = *(pdata.m);
+    Array<floatType> &w  = *(pdata.w);
+    Array<floatType> &q  = *(pdata.q);
+    Array<floatType> &s  = *(pdata.s);
+    //
+    Item< DynColl<floatType> > &dcarsFT = *A.dcAllRedSumFT;
+    Item< DynColl<FloatSums> > &dcarsFS = *A.dcAllRedSumFS;
+    //
+    Array<floatType> *dotsX[] = {&r, &w, &r};
+    Array<floatType> *dotsY[] = {&u, &u, &r};
+    // Last iteration whose residual norm is in normr.
+    int normrIter = 0;
+    //
+    if (!doPreconditioning && rank == 0) {
+        cout << "WARNING: PERFORMING UNPRECONDITIONED ITERATIONS" << endl;
+    }
+    // p is of length ncols, copy x to p for sparse MV operation
+    CopyVector(x, p, ctx, lrt);
+    //
+    TICK(); // n = A*p
+    ComputeSPMV(A, p, n, ctx, lrt);
+    TOCK(t3);
+    //
+    TICK(); // r = b - Ax (x stored in p)
+    ComputeWAXPBY(nrow, 1.0, b, -1.0, n, r, ctx, lrt);
+    TOCK(t2);
+    //
+    TICK();
+    ComputeDotProduct(nrow, r, r, normrFuture, t4, dcarsFT, ctx, lrt);
+    TOCK(t1);
+    //
+    TICK(); // u = M * r
+    if (doPreconditioning) ComputeMG(A, r, u, ctx, lrt);
+    else CopyVector(r, u, ctx, lrt);
+    TOCK(t5);
+    //
+    TICK(); // w = A * u
+    ComputeSPMV(A, u, w, ctx, lrt);
+    TOCK(t3);
+    //
+    normr = ComputeFuture(
+                &normrFuture, FMO_SQRT, NULL, ctx, lrt
+            ).get_result<floatType>(silenceWarnings);
+    //
+    if (rank == 0) std::cout << "Initial Residual = "<< normr << std::endl;
+    // Record initial residual for convergence testing.
+    normr0 = normr;
+    // Start iterations.
+    for (int k = 1; k <= maxIter && normr / normr0 > tolerance; k++ ) {
+        oldSumsFuture = sumsFuture;
+        // One reduction round that is only consumed after M * w and A * m are
+        // issued.
+        TICK(); // gamma = r' * u, delta = w' * u, r' * r
+        ComputeDotProducts(
+            nrow, 3, dotsX, dotsY, sumsFuture, t4, dcarsFS, ctx, lrt
+        );
+        TOCK(t1);
+        // r' * r is the residual of the previous iteration, so its check lags
+        // by one iteration but needs no reduction of its own. Only block on
+        // it when it is needed.
+        if (k > 1 && (k - 1) % checkFreq == 0) {
+            normr = ComputeFuture(
+                        &sumsFuture, RR, FMO_SQRT, NULL, -1, ctx, lrt
+                    ).get_result<floatType>(silenceWarnings);
+            normrIter = k - 1;
+            //
+            if (rank == 0 && normrIter % print_freq == 0) {
+                cout << "Iteration = "<< normrIter << "   Scaled Residual = "
+                     << normr / normr0 << std::endl;
+            }
+            if (normr / normr0 <= tolerance) break;
+        }
+        //
+        TICK(); // m = M * w
+        if (doPreconditioning) ComputeMG(A, w, m, ctx, lrt);
+        else CopyVector(w, m, ctx, lrt);
+        TOCK(t5);
+        //
+        TICK(); // n = A * m
+        ComputeSPMV(A, m, n, ctx, lrt);
+        TOCK(t3);
+        //
+        if (k == 1) {
+            betaFuture = Future::from_value(lrt, floatType(0.0));
+            // alpha = gamma / delta
+            alphaFuture = ComputeFuture(
+                              &sumsFuture, GAMMA, FMO_DIV,
+                              &sumsFuture, DELTA, ctx, lrt
+                          );
+        }
+        else {
+            // beta = gamma / gamma_old
+            betaFuture = ComputeFuture(
+                             &sumsFuture, GAMMA, FMO_DIV,
+                             &oldSumsFuture, GAMMA, ctx, lrt
+                         );
+            // alpha = gamma / (delta - beta * gamma / alpha_old)
+            Future tf = ComputeFuture(
+                            &sumsFuture, GAMMA, FMO_DIV,
+                            &alphaFuture, -1, ctx, lrt
+                        );
+            tf = ComputeFuture(&betaFuture, FMO_MUL, &tf, ctx, lrt);
+            tf = ComputeFuture(
+                     &sumsFuture, DELTA, FMO_SUB, &tf, -1, ctx, lrt
+                 );
+            alphaFuture = ComputeFuture(
+                              &sumsFuture, GAMMA, FMO_DIV, &tf, -1, ctx, lrt
+                          );
+        }
+        //
+        TICK(); // All eight vector recurrences in one pass.
+        ComputePipelinedCGUpdate(
+            nrow, alphaFuture, betaFuture,
+            n, m, z, q, s, p, x, r, u, w, ctx, lrt
+        );
+        TOCK(t2);
+        //
+        niters = k;
+    }
+    // The last iteration ran out of maxIter before its lagged check.
+    if (normrIter != niters) {
+        TICK();
+        ComputeDotProduct(nrow, r, r, normrFuture, t4, dcarsFT, ctx, lrt);
+        TOCK(t1);
+        //
+        normr = ComputeFuture(
+                    &normrFuture, FMO_SQRT, NULL, ctx, lrt
+                ).get_result<floatType>(silenceWarnings);
+        //
+        if (rank == 0) {
+            cout << "Iteration = "<< niters << "   Scaled Residual = "
+                 << normr / normr0 << std::endl;
+        }
+    }
+    // Store times.
+    times[1] += t1; // Dot product time.
+    times[2] += t2; // WAXPBY time.
+    times[3] += t3; // SPMV time.
+    times[4] += t4; // AllReduce time.
+    times[5] += t5; // Preconditioner apply time.
+    times[6] += t6; // Exchange halo time.
+    times[0] += mytimer() - t_begin;  // Total time. All done...
+    //
+    return 0;
+}
@@ -41,7 +41,7 @@
 //@HEADER
 
 /*!
-    @file ReportResults.cpp
+    @file ReportResults.hpp
 
     HPCG routine
  */
@@ -53,8 +53,14 @@
 #include "YAML_Element.hpp"
 #include "YAML_Doc.hpp"
 #include "OptimizeProblem.hpp"
+#include "CollectiveOps.hpp"
+#include "KernelProfile.hpp"
+#include "TestCG.hpp"
+#include "TestSymmetry.hpp"
+#include "TestNorms.hpp"
 
 #include <fstream>
+#include <string>
 #include <vector>
 
 /*!
@@ -75,6 +81,9 @@
     @param[in] times  Vector of cumulative timings for each of the phases of a
                       preconditioned CG iteration.
 
+    @param[in] kernelProfile This shard's kernel executions during the timed
+                             phase.
+
     @param[in] testcg_data    The data structure with the results of the
                               CG-correctness test including pass/fail
                               information.
@@ -98,6 +107,7 @@ ReportResults(
     int refMaxIters,
     int optMaxIters,
     double times[],
+    const KernelProfile &kernelProfile,
     const TestCGData &testcg_data,
     const TestSymmetryData &testsymmetry_data,
     const TestNormsData &testnorms_data,
@@ -116,10 +126,50 @@ ReportResults(
     double t4max = 0.0;
     double t4avg = 0.0;
     //
-    t4min = allReduce(t4, *A.dcAllRedMinFT, ctx, lrt);
-    t4max = allReduce(t4, *A.dcAllRedMaxFT, ctx, lrt);
-    t4avg = allReduce(t4, *A.dcAllRedSumFT, ctx, lrt);
+    Future t4f = Future::from_value(lrt, t4);
+    t4min = allReduce(
+                t4f, *A.dcAllRedMinFT, ctx, lrt
+            ).get_result<floatType>(silenceWarnings);
+    t4max = allReduce(
+                t4f, *A.dcAllRedMaxFT, ctx, lrt
+            ).get_result<floatType>(silenceWarnings);
+    t4avg = allReduce(
+                t4f, *A.dcAllRedSumFT, ctx, lrt
+            ).get_result<floatType>(silenceWarnings);
     t4avg = t4avg / ((double)Ageom->size);
+    // Kernel profile summed over shards, and the time of the slowest shard.
+    KernelProfile profileSum, profileMax;
+    {
+        std::vector<Future> sumFutures, maxFutures;
+        for (int k = 0; k < KP_NUM_KERNELS; ++k) {
+            for (int l = 0; l < NUM_MG_LEVELS; ++l) {
+                const KernelStats &ks = kernelProfile.stats[k][l];
+                const FloatSums local = {
+                    {ks.time, ks.bytes, ks.flops, ks.calls}
+                };
+                sumFutures.push_back(allReduceSums(
+                    Future::from_value(lrt, local), *A.dcAllRedSumFS, ctx, lrt
+                ));
+                maxFutures.push_back(allReduce(
+                    Future::from_value(lrt, ks.time), *A.dcAllRedMaxFT, ctx, lrt
+                ));
+            }
+        }
+        for (int k = 0, i = 0; k < KP_NUM_KERNELS; ++k) {
+            for (int l = 0; l < NUM_MG_LEVELS; ++l, ++i) {
+                const FloatSums sum = sumFutures[i].get_result<FloatSums>(
+                                          silenceWarnings
+                                      );
+                KernelStats &ks = profileSum.stats[k][l];
+                ks.time  = sum.v[0];
+                ks.bytes = sum.v[1];
+                ks.flops = sum.v[2];
+                ks.calls = sum.v[3];
+                profileMax.stats[k][l].time =
+                    maxFutures[i].get_result<floatType>(silenceWarnings);
+            }
+        }
+    }
 
     // initialize YAML doc
 
@@ -140,8 +190,9 @@ ReportResults(
         double fnops_sparsemv = (fniters + fNumberOfCgSets) * 2.0 * fnnz; // 1 SpMV with nnz adds and nnz mults
         // Op counts from the multigrid preconditioners
         double fnops_precond = 0.0;
+        // An agglomerated level ends the V-cycle (see ComputeAgglomeratedMG).
         const SparseMatrix *Af = &A;
-        for (int i = 1; i < numberOfMgLevels; ++i) {
+        for (int i = 1; i < numberOfMgLevels && !Af->isAgglomerated; ++i) {
             const auto *const Afsclrs = Af->sclrs->data();
             double fnnz_Af = Afsclrs->totalNumberOfNonzeros;
             double fnumberOfPresmootherSteps = Af->mgData->numberOfPresmootherSteps;
@@ -152,7 +203,10 @@ ReportResults(
             Af = Af->Ac; // Go to next coarse level
         }
 
-        fnops_precond += fniters * 4.0 * ((double) Af->sclrs->data()->totalNumberOfNonzeros); // One symmetric GS sweep at the coarsest level
+        // One symmetric GS sweep at the coarsest level, or the agglomerated
+        // solve's sweeps (counted once, not once per shard that repeats it)
+        double fnumberOfCoarseSweeps = Af->isAgglomerated ? Af->agglomeratedSweeps : 1.0;
+        fnops_precond += fnumberOfCoarseSweeps * fniters * 4.0 * ((double) Af->sclrs->data()->totalNumberOfNonzeros);
         double fnops = fnops_ddot + fnops_waxpby + fnops_sparsemv + fnops_precond;
         double frefnops = fnops * ((double) refMaxIters) / ((double) optMaxIters);
 
@@ -170,7 +224,7 @@ ReportResults(
         double fnreads_precond = 0.0;
         double fnwrites_precond = 0.0;
         Af = &A;
-        for (int i = 1; i < numberOfMgLevels; ++i) {
+        for (int i = 1; i < numberOfMgLevels && !Af->isAgglomerated; ++i) {
             const auto *const Afsclrs = Af->sclrs->data();
             double fnnz_Af = Afsclrs->totalNumberOfNonzeros;
             double fnrow_Af = Afsclrs->totalNumberOfRows;
@@ -187,8 +241,8 @@ ReportResults(
 
         double fnnz_Af = Af->sclrs->data()->totalNumberOfNonzeros;
         double fnrow_Af = Af->sclrs->data()->totalNumberOfRows;
-        fnreads_precond += fniters * (2.0 * fnnz_Af * (sizeof(double) + sizeof(local_int_t)) + fnrow_Af * sizeof(double));; // One symmetric GS sweep at the coarsest level
-        fnwrites_precond += fniters * fnrow_Af * sizeof(double); // One symmetric GS sweep at the coarsest level
+        fnreads_precond += fnumberOfCoarseSweeps * fniters * (2.0 * fnnz_Af * (sizeof(double) + sizeof(local_int_t)) + fnrow_Af * sizeof(double));; // One symmetric GS sweep at the coarsest level
+        fnwrites_precond += fnumberOfCoarseSweeps * fniters * fnrow_Af * sizeof(double); // One symmetric GS sweep at the coarsest level
         double fnreads = fnreads_ddot + fnreads_waxpby + fnreads_sparsemv + fnreads_precond;
         double fnwrites = fnwrites_ddot + fnwrites_waxpby + fnwrites_sparsemv + fnwrites_precond;
         double frefnreads = fnreads * ((double) refMaxIters) / ((double) optMaxIters);
@@ -279,9 +333,9 @@ ReportResults(
         doc.get("Machine Summary")->add("Threads per processes", Ageom->numThreads);
 
         doc.add("Global Problem Dimensions", "");
-        doc.get("Global Problem Dimensions")->add("Global nx", Ageom->npx * Ageom->nx);
-        doc.get("Global Problem Dimensions")->add("Global ny", Ageom->npy * Ageom->ny);
-        doc.get("Global Problem Dimensions")->add("Global nz", Ageom->npz * Ageom->nz);
+        doc.get("Global Problem Dimensions")->add("Global nx", (long long)Ageom->gnx);
+        doc.get("Global Problem Dimensions")->add("Global ny", (long long)Ageom->gny);
+        doc.get("Global Problem Dimensions")->add("Global nz", (long long)Ageom->gnz);
 
         doc.add("Processor Dimensions", "");
         doc.get("Processor Dimensions")->add("npx", Ageom->npx);
@@ -426,8 +480,33 @@ ReportResults(
         doc.get("DDOT Timing Variations")->add("Max DDOT MPI_Allreduce time", t4max);
         doc.get("DDOT Timing Variations")->add("Avg DDOT MPI_Allreduce time", t4avg);
 
-        //doc.get("Sparse Operations Overheads")->add("Halo exchange time (sec)", (times[6]));
-        //doc.get("Sparse Operations Overheads")->add("Halo exchange as percentage of SpMV time", (times[6])/totalSparseMVTime*100.0);
+        doc.add("Sparse Operations Overheads", "");
+        doc.get("Sparse Operations Overheads")->add("Halo exchange time (sec)", (times[6]));
+        doc.get("Sparse Operations Overheads")->add("Halo exchange as percentage of total time", (times[6]) / times[0] * 100.0);
+
+        // Execution (not launch) times of the kernel tasks; rates use the
+        // slowest shard's time.
+        const char KernelProfileKey[] = "Kernel Profile (timed phase)";
+        doc.add(KernelProfileKey, "");
+        const double fsize = Ageom->size;
+        for (int k = 0; k < KP_NUM_KERNELS; ++k) {
+            for (int l = 0; l < NUM_MG_LEVELS; ++l) {
+                const KernelStats &ks = profileSum.stats[k][l];
+                if (ks.calls == 0.0) continue;
+                const double tmax = profileMax.stats[k][l].time;
+                YAML_Element *kernel = doc.get(KernelProfileKey)->get(profiledKernelNames[k]);
+                if (!kernel) kernel = doc.get(KernelProfileKey)->add(profiledKernelNames[k], "");
+                YAML_Element *level = kernel->add("Level " + std::to_string(l), "");
+                level->add("Executions per shard", ks.calls / fsize);
+                level->add("Avg time per shard (sec)", ks.time / fsize);
+                level->add("Max time per shard (sec)", tmax);
+                if (tmax > 0.0) {
+                    level->add("GB/s", ks.bytes / tmax / 1.0E9);
+                    if (ks.flops > 0.0) level->add("GFLOP/s", ks.flops / tmax / 1.0E9);
+                }
+            }
+        }
+
         doc.add("__________ Final Summary __________", "");
         bool isValidRun = (testcg_data.count_fail == 0) && (testsymmetry_data.count_fail == 0) && (testnorms_data.pass) && (!global_failure);
         if (isValidRun) {
@@ -471,9 +550,7 @@ ReportResults(
         }
 
         std::string yaml = doc.generateYAML();
-#ifdef HPCG_DEBUG
-        HPCG_fout << yaml;
-#endif
+        std::cout << std::endl << yaml << std::endl;
     }
     return;
 }
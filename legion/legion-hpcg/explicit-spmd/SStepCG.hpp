@@ -0,0 +1,718 @@
+/**
+ * Copyright (c)      2017 Los Alamos National Security, LLC
+ *                         All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LA-CC 10-123
+ */
+
+/*!
+    @file SStepCG.hpp
+
+    Reduction-only s-step preconditioned CG: one block Gram reduction per s
+    iterations, with the usual per-SpMV halo exchanges.
+ */
+
+#pragma once
+
+#include "hpcg.hpp"
+#include "mytimer.hpp"
+
+#include "LegionArrays.hpp"
+#include "LegionMatrices.hpp"
+#include "LegionCGData.hpp"
+#include "CollectiveOps.hpp"
+#include "KernelProfile.hpp"
+#include "VectorOps.hpp"
+
+#include "CG.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+/**
+ * Index of entry (i, j) of a packed, symmetric m x m Gram matrix.
+ */
+inline int
+SStepGramIndex(
+    int i,
+    int j,
+    int m
+) {
+    if (i > j) std::swap(i, j);
+    return i * (2 * m - i + 1) / 2 + (j - i);
+}
+
+/**
+ * Basis vectors of an s-step CG block. With T = M^-1 * A, Y holds T^k * p
+ * (columns 0 to s - 1, p the last direction of the previous block) followed by
+ * T^k * z (columns s to 2s - 1, z = M^-1 * r), and AY holds A times each
+ * column. Y columns are SpMV inputs and preconditioner outputs, so they carry
+ * ghosts. Allocated once for the largest s used; a smaller s uses the leading
+ * 2s columns.
+ */
+struct SStepCGData {
+    LogicalArray<floatType> lY[2 * LGNCG_MAX_SSTEP];
+    LogicalArray<floatType> lAY[2 * LGNCG_MAX_SSTEP];
+    LogicalArray<floatType> lpn;
+    //
+    int maxS = 0;
+    //
+    Array<floatType> *Y[2 * LGNCG_MAX_SSTEP] = {};
+    Array<floatType> *AY[2 * LGNCG_MAX_SSTEP] = {};
+    // The direction that starts the next block. Swapped with Y[0].
+    Array<floatType> *pn = nullptr;
+
+    /**
+     *
+     */
+    void
+    allocate(
+        SparseMatrix &A,
+        int s,
+        Context ctx,
+        Runtime *lrt
+    ) {
+        assert(s >= 1 && s <= LGNCG_MAX_SSTEP);
+        maxS = s;
+        //
+        const local_int_t nrow = A.sclrs->data()->localNumberOfRows;
+        const local_int_t ncol = A.sclrs->data()->localNumberOfColumns;
+        //
+        for (int k = 0; k < 2 * maxS; ++k) {
+            lY[k].allocate("scg-y", ncol, ctx, lrt);
+            lAY[k].allocate("scg-ay", nrow, ctx, lrt);
+            Partition(A, lY[k], ctx, lrt);
+            //
+            Y[k] = new Array<floatType>(
+                lY[k].mapRegion(RW_E, ctx, lrt), ctx, lrt
+            );
+            AY[k] = new Array<floatType>(
+                lAY[k].mapRegion(RW_E, ctx, lrt), ctx, lrt
+            );
+            SetupGhostArrays(A, *Y[k], ctx, lrt);
+        }
+        //
+        lpn.allocate("scg-pn", ncol, ctx, lrt);
+        Partition(A, lpn, ctx, lrt);
+        pn = new Array<floatType>(lpn.mapRegion(RW_E, ctx, lrt), ctx, lrt);
+        SetupGhostArrays(A, *pn, ctx, lrt);
+    }
+
+    /**
+     *
+     */
+    void
+    deallocate(
+        Context ctx,
+        Runtime *lrt
+    ) {
+        for (int k = 0; k < 2 * maxS; ++k) {
+            lY[k].deallocate(ctx, lrt);
+            lY[k].unmapRegion(ctx, lrt);
+            lAY[k].deallocate(ctx, lrt);
+            lAY[k].unmapRegion(ctx, lrt);
+            //
+            delete Y[k];  Y[k] = nullptr;
+            delete AY[k]; AY[k] = nullptr;
+        }
+        lpn.deallocate(ctx, lrt);
+        lpn.unmapRegion(ctx, lrt);
+        delete pn; pn = nullptr;
+        //
+        maxS = 0;
+    }
+};
+
+/**
+ *
+ */
+struct SStepGramArgs {
+    local_int_t n;
+    int s;
+};
+
+/**
+ * Modeled work of ComputeSStepGram: 4s + 1 vectors read, two packed 2s x 2s
+ * Gram matrices and r' * r accumulated.
+ */
+inline KernelCost
+SStepGramCost(
+    local_int_t n,
+    int s
+) {
+    const double m = 2.0 * s;
+    return KernelCost {
+        0,
+        (2.0 * m + 1.0) * n * sizeof(floatType),
+        (2.0 * m * (m + 1.0) + 2.0) * n
+    };
+}
+
+/*!
+    Routine to compute the local part of the block Gram matrices of an s-step
+    CG block. With m = 2s and MY the preconditioned counterpart of Y
+    (M * T^k * v = A * T^(k-1) * v and M * z = r):
+    result.v[0] = r' * r,
+    result.v[1 + SStepGramIndex(i, j, m)] = Y_i' * AY_j,
+    result.v[1 + m * (m + 1) / 2 + SStepGramIndex(i, j, m)] = MY_i' * Y_j.
+    M * Y_0 is not known; its row is zero and never used.
+
+    @param[in]  args  the number of vector elements and the block size.
+    @param[in]  Y, AY the 2s basis vectors and their products with A.
+    @param[in]  r     the residual vector.
+    @param[out] result the local partial sums.
+
+    @return returns 0 upon success and non-zero otherwise
+*/
+inline int
+ComputeSStepGramKernel(
+    const SStepGramArgs &args,
+    Array<floatType> *const *Y,
+    Array<floatType> *const *AY,
+    const Array<floatType> &r,
+    GramSums &result
+) {
+    const int s = args.s;
+    const int m = 2 * s;
+    const int nTri = m * (m + 1) / 2;
+    assert(s >= 1 && s <= LGNCG_MAX_SSTEP);
+    //
+    const floatType *yv[2 * LGNCG_MAX_SSTEP];
+    const floatType *ayv[2 * LGNCG_MAX_SSTEP];
+    const floatType *myv[2 * LGNCG_MAX_SSTEP];
+    for (int k = 0; k < m; ++k) {
+        assert(Y[k]->length()  >= size_t(args.n));
+        assert(AY[k]->length() >= size_t(args.n));
+        yv[k] = Y[k]->data();
+        assert(yv[k]);
+        ayv[k] = AY[k]->data();
+        assert(ayv[k]);
+    }
+    assert(r.length() >= size_t(args.n));
+    //
+    myv[0] = nullptr;
+    myv[s] = r.data();
+    assert(myv[s]);
+    for (int k = 1; k < s; ++k) {
+        myv[k]     = ayv[k - 1];
+        myv[s + k] = ayv[s + k - 1];
+    }
+    //
+    floatType rr = 0.0;
+    floatType gay[LGNCG_MAX_GRAM_SUMS / 2] = {0.0};
+    floatType gmy[LGNCG_MAX_GRAM_SUMS / 2] = {0.0};
+    //
+    const local_int_t n = args.n;
+    for (local_int_t i = 0; i < n; i++) {
+        floatType y[2 * LGNCG_MAX_SSTEP];
+        floatType ay[2 * LGNCG_MAX_SSTEP];
+        floatType my[2 * LGNCG_MAX_SSTEP];
+        for (int k = 0; k < m; ++k) {
+            y[k]  = yv[k][i];
+            ay[k] = ayv[k][i];
+            my[k] = myv[k] ? myv[k][i] : 0.0;
+        }
+        rr += my[s] * my[s];
+        //
+        int t = 0;
+        for (int a = 0; a < m; ++a) {
+            for (int b = a; b < m; ++b, ++t) {
+                gay[t] += y[a] * ay[b];
+                gmy[t] += my[a] * y[b];
+            }
+        }
+    }
+    //
+    for (int e = 0; e < LGNCG_MAX_GRAM_SUMS; ++e) result.v[e] = 0.0;
+    result.v[0] = rr;
+    for (int t = 0; t < nTri; ++t) {
+        result.v[1 + t]        = gay[t];
+        result.v[1 + nTri + t] = gmy[t];
+    }
+    //
+    return 0;
+}
+
+/**
+ * Computes the block Gram matrices of an s-step CG block with one task and
+ * reduces them with one dynamic collective round. resultFuture holds the
+ * global GramSums.
+ */
+inline int
+ComputeSStepGram(
+    local_int_t n,
+    int s,
+    Array<floatType> *const *Y,
+    Array<floatType> *const *AY,
+    Array<floatType> &r,
+    Future &resultFuture,
+    double &timeAllreduce,
+    Item< DynColl<GramSums> > &dcReduceGram,
+    Context ctx,
+    Runtime *lrt
+) {
+    SStepGramArgs args = {
+        .n = n,
+        .s = s
+    };
+    //
+    Future localFuture;
+    //
+    int rc = 0;
+#ifdef LGNCG_TASKING
+    //
+    TaskLauncher tl(
+        SSTEP_GRAM_TID,
+        TaskArgument(&args, sizeof(args))
+    );
+    //
+    for (int k = 0; k < 2 * s; ++k) Y[k]->intent(RO_E, tl, ctx, lrt);
+    for (int k = 0; k < 2 * s; ++k) AY[k]->intent(RO_E, tl, ctx, lrt);
+    r.intent(RO_E, tl, ctx, lrt);
+    //
+    localFuture = lrt->execute_task(ctx, tl);
+#else
+    GramSums localResult;
+    {
+        KernelTimer timer(KP_DDOT, SStepGramCost(n, s), ctx, lrt);
+        rc = ComputeSStepGramKernel(args, Y, AY, r, localResult);
+    }
+    localFuture = Future::from_value(lrt, localResult);
+#endif
+    double t0 = mytimer();
+    resultFuture = allReduceGram(localFuture, dcReduceGram, ctx, lrt);
+    timeAllreduce += mytimer() - t0;
+    //
+    return rc;
+}
+
+/**
+ *
+ */
+GramSums
+ComputeSStepGramTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    Runtime *lrt
+) {
+    const auto *const args = (SStepGramArgs *)task->args;
+    KernelTimer timer(KP_DDOT, SStepGramCost(args->n, args->s), ctx, lrt);
+    //
+    const int m = 2 * args->s;
+    Array<floatType> *Y[2 * LGNCG_MAX_SSTEP];
+    Array<floatType> *AY[2 * LGNCG_MAX_SSTEP];
+    for (int k = 0; k < m; ++k) {
+        Y[k]  = new Array<floatType>(regions[k], ctx, lrt);
+        AY[k] = new Array<floatType>(regions[m + k], ctx, lrt);
+    }
+    Array<floatType> r(regions[2 * m], ctx, lrt);
+    //
+    GramSums localResult;
+    ComputeSStepGramKernel(*args, Y, AY, r, localResult);
+    //
+    for (int k = 0; k < m; ++k) {
+        delete Y[k];
+        delete AY[k];
+    }
+    //
+    return localResult;
+}
+
+/**
+ *
+ */
+struct SStepCombineArgs {
+    local_int_t n;
+    int nVecs;
+    int accumulate;
+    floatType coefs[2 * LGNCG_MAX_SSTEP];
+};
+
+/**
+ * Modeled work of ComputeSStepCombine: nVecs vectors read, w written (and read
+ * if accumulating).
+ */
+inline KernelCost
+SStepCombineCost(
+    const SStepCombineArgs &args
+) {
+    return KernelCost {
+        0,
+        double(args.nVecs + 1 + args.accumulate) * args.n * sizeof(floatType),
+        2.0 * args.nVecs * args.n
+    };
+}
+
+/*!
+    Routine to compute a linear combination of basis vectors where:
+    w = w + sum_k coefs[k] * V[k] if args.accumulate, and
+    w = sum_k coefs[k] * V[k] otherwise.
+
+    @param[in]    args the number of vector elements, vectors, and coefficients.
+    @param[in]    V    the input vectors (w must not be one of them).
+    @param[inout] w    the output vector.
+
+    @return returns 0 upon success and non-zero otherwise
+*/
+inline int
+ComputeSStepCombineKernel(
+    const SStepCombineArgs &args,
+    Array<floatType> *const *V,
+    Array<floatType> &w
+) {
+    const int nVecs = args.nVecs;
+    assert(nVecs > 0 && nVecs <= 2 * LGNCG_MAX_SSTEP);
+    //
+    const floatType *vv[2 * LGNCG_MAX_SSTEP];
+    for (int k = 0; k < nVecs; ++k) {
+        assert(V[k]->length() >= size_t(args.n));
+        vv[k] = V[k]->data();
+        assert(vv[k]);
+    }
+    assert(w.length() >= size_t(args.n));
+    floatType *const wv = w.data();
+    assert(wv);
+    //
+    const local_int_t n = args.n;
+    for (local_int_t i = 0; i < n; i++) {
+        floatType wi = args.accumulate ? wv[i] : 0.0;
+        for (int k = 0; k < nVecs; ++k) {
+            wi += args.coefs[k] * vv[k][i];
+        }
+        wv[i] = wi;
+    }
+    //
+    return 0;
+}
+
+/**
+ * Recovers a vector of an s-step CG block from its basis coordinates.
+ */
+inline int
+ComputeSStepCombine(
+    local_int_t n,
+    int nVecs,
+    const floatType *coefs,
+    Array<floatType> *const *V,
+    Array<floatType> &w,
+    bool accumulate,
+    Context ctx,
+    Runtime *lrt
+) {
+    SStepCombineArgs args;
+    args.n = n;
+    args.nVecs = nVecs;
+    args.accumulate = accumulate ? 1 : 0;
+    for (int k = 0; k < nVecs; ++k) args.coefs[k] = coefs[k];
+    //
+    int rc = 0;
+#ifdef LGNCG_TASKING
+    //
+    TaskLauncher tl(
+        SSTEP_COMBINE_TID,
+        TaskArgument(&args, sizeof(args))
+    );
+    //
+    for (int k = 0; k < nVecs; ++k) V[k]->intent(RO_E, tl, ctx, lrt);
+    w.intent(RW_E, tl, ctx, lrt);
+    //
+    (void)lrt->execute_task(ctx, tl);
+#else
+    KernelTimer timer(KP_WAXPBY, SStepCombineCost(args), ctx, lrt);
+    rc = ComputeSStepCombineKernel(args, V, w);
+#endif
+    return rc;
+}
+
+/**
+ *
+ */
+void
+ComputeSStepCombineTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    Runtime *lrt
+) {
+    const auto *const args = (SStepCombineArgs *)task->args;
+    KernelTimer timer(KP_WAXPBY, SStepCombineCost(*args), ctx, lrt);
+    //
+    Array<floatType> *V[2 * LGNCG_MAX_SSTEP];
+    for (int k = 0; k < args->nVecs; ++k) {
+        V[k] = new Array<floatType>(regions[k], ctx, lrt);
+    }
+    Array<floatType> w(regions[args->nVecs], ctx, lrt);
+    //
+    ComputeSStepCombineKernel(*args, V, w);
+    //
+    for (int k = 0; k < args->nVecs; ++k) delete V[k];
+}
+
+/*!
+    Reduction-only s-step preconditioned CG. Same interface and stopping
+    criterion as CG(), but iterations are done in blocks of s: the
+    block builds the basis of SStepCGData with 2s SpMVs and 2s - 1
+    preconditioner applications, reduces the r' * r and the two block Gram
+    matrices in one collective round, and then runs the s CG recurrences on
+    the basis coordinates without communication. x, r, and the next direction
+    are recovered from the coordinates once per block. This replaces the 2s
+    reductions (and waits) of s CG iterations by one, at the cost of twice the
+    SpMVs and of the usual instability of the monomial basis for larger s.
+    There is no depth-s ghost layer (matrix-powers kernel): every SpMV and
+    preconditioner application of the basis still exchanges its own halo.
+
+    The residual norm is only known at the start of a block, so convergence
+    (and maxIter) are checked once per block.
+
+    @param[inout] sdata The basis vectors (see SStepCGData), allocated for at
+                  least s.
+
+    @param[in]    s     The block size (1 <= s <= sdata.maxS).
+
+    @return Returns zero on success and a non-zero value if the recurrences
+            broke down (a non-positive r' * z or p' * A * p); x then holds the
+            approximate solution of the last complete block.
+
+    @see CG()
+*/
+inline int
+SStepCG(
+    SparseMatrix     &A,
+    CGData           &data,
+    SStepCGData      &sdata,
+    const int        s,
+    Array<floatType> &b,
+    Array<floatType> &x,
+    const int        maxIter,
+    const floatType  tolerance,
+    int              &niters,
+    floatType        &normr,
+    floatType        &normr0,
+    double           *times,
+    bool             doPreconditioning,
+    Context          ctx,
+    Runtime          *lrt
+) {
+    using namespace std;
+    // Start timing right away.
+    double t_begin = mytimer();
+    //
+    assert(s >= 1 && s <= sdata.maxS);
+    const int print_freq = 10;
+    const int rank = A.geom->data()->rank;
+    const local_int_t nrow = A.sclrs->data()->localNumberOfRows;
+    //
+    const int m = 2 * s;
+    const int nTri = m * (m + 1) / 2;
+    //
+    Future normrFuture, gramFuture;
+    double t0 = 0.0, t1 = 0.0, t2 = 0.0, t3 = 0.0, t4 = 0.0, t5 = 0.0, t6 = 0.0;
+    //
+    normr = 0.0;
+    niters = 0;
+    //
+    Array<floatType> &r  = *(data.r);
+    Array<floatType> &p  = *(data.p);
+    Array<floatType> &Ap = *(data.Ap);
+    // P_k = T^k * p is Y[k], Z_k = T^k * z is Y[s + k].
+    Array<floatType> **Y  = sdata.Y;
+    Array<floatType> **AY = sdata.AY;
+    //
+    Item< DynColl<floatType> > &dcarsFT = *A.dcAllRedSumFT;
+    Item< DynColl<GramSums> > &dcarsGS = *A.dcAllRedSumGS;
+    //
+    if (!doPreconditioning && rank == 0) {
+        cout << "WARNING: PERFORMING UNPRECONDITIONED ITERATIONS" << endl;
+    }
+    // p is of length ncols, copy x to p for sparse MV operation
+    CopyVector(x, p, ctx, lrt);
+    //
+    TICK(); // Ap = A*p
+    ComputeSPMV(A, p, Ap, ctx, lrt);
+    TOCK(t3);
+    //
+    TICK(); // r = b - Ax (x stored in p)
+    ComputeWAXPBY(nrow, 1.0, b, -1.0, Ap, r, ctx, lrt);
+    TOCK(t2);
+    // The first block has no previous direction.
+    bool hasPrev = false;
+    floatType rzPrev = 0.0;
+    int ierr = 0;
+    // Offsets of the packed Gram matrices in a GramSums.
+    const int AYB = 1, MYB = 1 + nTri;
+    // Coordinates in Y of z_j, p_j, and of the accumulated x update.
+    floatType c[2 * LGNCG_MAX_SSTEP], a[2 * LGNCG_MAX_SSTEP];
+    floatType d[2 * LGNCG_MAX_SSTEP], nd[2 * LGNCG_MAX_SSTEP];
+    //
+    while (ierr == 0) {
+        if (niters > 0 && niters >= maxIter) {
+            TICK();
+            ComputeDotProduct(nrow, r, r, normrFuture, t4, dcarsFT, ctx, lrt);
+            TOCK(t1);
+            normr = ComputeFuture(
+                        &normrFuture, FMO_SQRT, NULL, ctx, lrt
+                    ).get_result<floatType>(silenceWarnings);
+            break;
+        }
+        // The P columns are unused in the first block. Keep their Gram
+        // entries finite.
+        if (!hasPrev) {
+            for (int k = 0; k < s; ++k) {
+                ZeroVector(*Y[k], ctx, lrt);
+                ZeroVector(*AY[k], ctx, lrt);
+            }
+        }
+        //
+        TICK(); // Z_0 = z = M * r
+        if (doPreconditioning) ComputeMG(A, r, *Y[s], ctx, lrt);
+        else CopyVector(r, *Y[s], ctx, lrt);
+        TOCK(t5);
+        // Both chains of the basis, column offset 0 for P and s for Z.
+        for (int k = 0; k < s; ++k) {
+            for (int o = hasPrev ? 0 : s; o < m; o += s) {
+                TICK(); // AY_(o+k) = A * Y_(o+k)
+                ComputeSPMV(A, *Y[o + k], *AY[o + k], ctx, lrt);
+                TOCK(t3);
+                if (k + 1 == s) continue;
+                //
+                TICK(); // Y_(o+k+1) = M * AY_(o+k)
+                if (doPreconditioning) {
+                    ComputeMG(A, *AY[o + k], *Y[o + k + 1], ctx, lrt);
+                }
+                else CopyVector(*AY[o + k], *Y[o + k + 1], ctx, lrt);
+                TOCK(t5);
+            }
+        }
+        // The only reduction of the block.
+        TICK();
+        ComputeSStepGram(
+            nrow, s, Y, AY, r, gramFuture, t4, dcarsGS, ctx, lrt
+        );
+        TOCK(t1);
+        const GramSums g = gramFuture.get_result<GramSums>(silenceWarnings);
+        //
+        normr = sqrt(g.v[0]);
+        if (niters == 0) {
+            if (rank == 0) cout << "Initial Residual = "<< normr << endl;
+            // Record initial residual for convergence testing.
+            normr0 = normr;
+        }
+        else if (rank == 0 && niters % print_freq < s) {
+            cout << "Iteration = "<< niters << "   Scaled Residual = "
+                 << normr / normr0 << std::endl;
+        }
+        if (normr / normr0 <= tolerance) break;
+        // v' * G * v of a packed Gram matrix at offset base.
+        auto quadForm = [&](int base, const floatType *v) {
+            floatType q = 0.0;
+            for (int i = 0; i < m; ++i) {
+                if (v[i] == 0.0) continue;
+                for (int j = 0; j < m; ++j) {
+                    q += v[i] * v[j] * g.v[base + SStepGramIndex(i, j, m)];
+                }
+            }
+            return q;
+        };
+        // CG recurrences on the coordinates. r_j = MY * c_j, so
+        // r_j' * z_j = c_j' * (MY' * Y) * c_j; c_j never has a Y_0 component.
+        const int sb = std::min(s, maxIter - niters);
+        for (int k = 0; k < m; ++k) c[k] = d[k] = 0.0;
+        c[s] = 1.0;
+        floatType rz = quadForm(MYB, c);
+        const floatType beta0 = hasPrev ? rz / rzPrev : 0.0;
+        for (int k = 0; k < m; ++k) a[k] = c[k];
+        a[0] += beta0;
+        //
+        for (int j = 0; j < sb; ++j) {
+            const floatType pAp = quadForm(AYB, a);
+            if (!(rz > 0.0) || !(pAp > 0.0)) {
+                ierr = 1;
+                break;
+            }
+            const floatType alpha = rz / pAp;
+            for (int k = 0; k < m; ++k) d[k] += alpha * a[k];
+            if (j + 1 == sb) break;
+            // z_(j+1) = z_j - alpha * T * p_j; T shifts both chains by one.
+            for (int k = s - 1; k > 0; --k) {
+                c[k]     -= alpha * a[k - 1];
+                c[s + k] -= alpha * a[s + k - 1];
+            }
+            const floatType rzNew = quadForm(MYB, c);
+            const floatType beta = rzNew / rz;
+            rz = rzNew;
+            for (int k = 0; k < m; ++k) a[k] = c[k] + beta * a[k];
+        }
+        if (ierr) break;
+        //
+        TICK(); // x += Y * d, r -= AY * d, next p = Y * a
+        for (int k = 0; k < m; ++k) nd[k] = -d[k];
+        ComputeSStepCombine(nrow, m, d, Y, x, true, ctx, lrt);
+        ComputeSStepCombine(nrow, m, nd, AY, r, true, ctx, lrt);
+        ComputeSStepCombine(nrow, m, a, Y, *sdata.pn, false, ctx, lrt);
+        TOCK(t2);
+        std::swap(sdata.Y[0], sdata.pn);
+        //
+        rzPrev = rz;
+        hasPrev = true;
+        niters += sb;
+    }
+    // Store times.
+    times[1] += t1; // Dot product time.
+    times[2] += t2; // WAXPBY time.
+    times[3] += t3; // SPMV time.
+    times[4] += t4; // AllReduce time.
+    times[5] += t5; // Preconditioner apply time.
+    times[6] += t6; // Exchange halo time.
+    times[0] += mytimer() - t_begin;  // Total time. All done...
+    //
+    return ierr;
+}
+
+inline void
+registerSStepCGTasks(void)
+{
+#ifdef LGNCG_TASKING
+    HighLevelRuntime::register_legion_task<GramSums, ComputeSStepGramTask>(
+        SSTEP_GRAM_TID /* task id */,
+        Processor::LOC_PROC /* proc kind  */,
+        true /* single */,
+        false /* index */,
+        AUTO_GENERATE_ID,
+        TaskConfigOptions(true /* leaf task */),
+        "ComputeSStepGramTask"
+    );
+    HighLevelRuntime::register_legion_task<ComputeSStepCombineTask>(
+        SSTEP_COMBINE_TID /* task id */,
+        Processor::LOC_PROC /* proc kind  */,
+        true /* single */,
+        false /* index */,
+        AUTO_GENERATE_ID,
+        TaskConfigOptions(true /* leaf task */),
+        "ComputeSStepCombineTask"
+    );
+#endif
+}
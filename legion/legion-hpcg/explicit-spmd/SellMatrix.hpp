@@ -0,0 +1,222 @@
+/**
+ * Copyright (c)      2017 Los Alamos National Security, LLC
+ *                         All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LA-CC 10-123
+ */
+
+/*!
+    @file SellMatrix.hpp
+
+    Sliced ELLPACK (SELL-C-sigma) copy of a SparseMatrix.
+ */
+
+#pragma once
+
+#include "hpcg.hpp"
+#include "LegionStuff.hpp"
+#include "LegionArrays.hpp"
+
+#include <vector>
+
+// The AVX2 and AVX-512 slice kernels are built with per-function target
+// attributes and picked at run time, so the binary needs no -march flags.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LGNCG_SELL_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+// Slice height (rows per slice). One AVX-512 vector, or two AVX2 vectors, of
+// doubles.
+#define LGNCG_SELL_C 8
+
+/**
+ * SELL-C-sigma storage. Rows are grouped into slices of LGNCG_SELL_C rows
+ * that are stored column-major, so entry j of the rows of a slice is
+ * contiguous and can be processed with one SIMD operation. Within windows of
+ * sigma rows, rows are sorted by decreasing length to reduce padding. Padded
+ * entries have a zero value and point at a valid column.
+ */
+struct SellMatrix {
+    // Sorting window size.
+    int sigma = 0;
+    // Number of slices.
+    local_int_t nSlices = 0;
+    // Number of stored entries (including padding).
+    local_int_t nEntries = 0;
+    // If the matrix is multicolor ordered, slices never straddle colors and
+    // the slices of color c are [colorSliceOffsets[c],
+    // colorSliceOffsets[c + 1]).
+    int nColors = 0;
+    local_int_t colorSliceOffsets[HPCG_STENCIL + 1];
+    // Slice values, column-major within a slice.
+    LogicalArray<floatType> lValues;
+    Array<floatType> *values = nullptr;
+    // Slice column indices, column-major within a slice.
+    LogicalArray<local_int_t> lColInds;
+    Array<local_int_t> *colInds = nullptr;
+    // Offset of each slice into values/colInds (nSlices + 1 entries).
+    LogicalArray<local_int_t> lSliceOffsets;
+    Array<local_int_t> *sliceOffsets = nullptr;
+    // Matrix row of each slice lane (-1 for padding lanes).
+    LogicalArray<local_int_t> lRows;
+    Array<local_int_t> *rows = nullptr;
+    // Entry of values that holds the diagonal of each matrix row. Only used
+    // by the owning shard, to keep the slices in sync with
+    // ReplaceMatrixDiagonal.
+    std::vector<local_int_t> diagEntries;
+
+    /**
+     *
+     */
+    ~SellMatrix(void) {
+        delete values;
+        delete colInds;
+        delete sliceOffsets;
+        delete rows;
+    }
+};
+
+/**
+ * Computes sums[l] = sum_j values[j][l] * x[colInds[j][l]] for the
+ * LGNCG_SELL_C lanes of one slice of the given width.
+ */
+typedef void (*SellSliceDotFn)(
+    const floatType *const values,
+    const local_int_t *const colInds,
+    local_int_t width,
+    const floatType *const xv,
+    floatType *const sums
+);
+
+/**
+ * Portable SellSliceDotFn.
+ */
+inline void
+SellSliceDotScalar(
+    const floatType *const values,
+    const local_int_t *const colInds,
+    local_int_t width,
+    const floatType *const xv,
+    floatType *const sums
+) {
+    for (int l = 0; l < LGNCG_SELL_C; ++l) sums[l] = 0.0;
+    for (local_int_t j = 0; j < width; ++j) {
+        const local_int_t *const ci = colInds + j * LGNCG_SELL_C;
+        const floatType *const vi = values + j * LGNCG_SELL_C;
+        for (int l = 0; l < LGNCG_SELL_C; ++l) {
+            sums[l] += vi[l] * xv[ci[l]];
+        }
+    }
+}
+
+#ifdef LGNCG_SELL_X86_DISPATCH
+/**
+ * AVX2 SellSliceDotFn: two 4-wide gathers per slice column.
+ */
+__attribute__((target("avx2,fma"))) inline void
+SellSliceDotAVX2(
+    const floatType *const values,
+    const local_int_t *const colInds,
+    local_int_t width,
+    const floatType *const xv,
+    floatType *const sums
+) {
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    for (local_int_t j = 0; j < width; ++j) {
+        const local_int_t *const ci = colInds + j * LGNCG_SELL_C;
+        const floatType *const vi = values + j * LGNCG_SELL_C;
+        const __m128i idx0 = _mm_loadu_si128((const __m128i *)(ci));
+        const __m128i idx1 = _mm_loadu_si128((const __m128i *)(ci + 4));
+        const __m256d xg0 = _mm256_i32gather_pd(xv, idx0, sizeof(floatType));
+        const __m256d xg1 = _mm256_i32gather_pd(xv, idx1, sizeof(floatType));
+        sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(vi), xg0, sum0);
+        sum1 = _mm256_fmadd_pd(_mm256_loadu_pd(vi + 4), xg1, sum1);
+    }
+    _mm256_storeu_pd(sums, sum0);
+    _mm256_storeu_pd(sums + 4, sum1);
+}
+
+/**
+ * AVX-512 SellSliceDotFn: one 8-wide gather per slice column.
+ */
+__attribute__((target("avx512f"))) inline void
+SellSliceDotAVX512(
+    const floatType *const values,
+    const local_int_t *const colInds,
+    local_int_t width,
+    const floatType *const xv,
+    floatType *const sums
+) {
+    __m512d sum = _mm512_setzero_pd();
+    for (local_int_t j = 0; j < width; ++j) {
+        const __m256i idx = _mm256_loadu_si256(
+            (const __m256i *)(colInds + j * LGNCG_SELL_C)
+        );
+        const __m512d v = _mm512_loadu_pd(values + j * LGNCG_SELL_C);
+        const __m512d xg = _mm512_i32gather_pd(idx, xv, sizeof(floatType));
+        sum = _mm512_fmadd_pd(v, xg, sum);
+    }
+    _mm512_storeu_pd(sums, sum);
+}
+#endif
+
+/**
+ * A SellSliceDotFn and its name (for reporting).
+ */
+struct SellSliceDotKernel {
+    SellSliceDotFn fn;
+    const char *name;
+};
+
+/**
+ * Returns the widest slice kernel this CPU supports.
+ */
+inline SellSliceDotKernel
+SelectSellSliceDot(void)
+{
+#ifdef LGNCG_SELL_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SellSliceDotKernel {SellSliceDotAVX512, "AVX-512"};
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SellSliceDotKernel {SellSliceDotAVX2, "AVX2"};
+    }
+#endif
+    return SellSliceDotKernel {SellSliceDotScalar, "scalar"};
+}
+
+/**
+ * The slice kernel of this process. Selected once, on first use, and then
+ * shared by every SELL-C-sigma SpMV and SYMGS.
+ */
+inline const SellSliceDotKernel &
+GetSellSliceDot(void)
+{
+    static const SellSliceDotKernel kernel = SelectSellSliceDot();
+    return kernel;
+}
@@ -49,37 +49,86 @@
 #include "LegionArrays.hpp"
 #include "LegionMatrices.hpp"
 
+#include "FlatMap.hpp"
+#include "ComputeOptimalShapeXYZ.hpp"
+
 #include <map>
-#include <set>
 #include <vector>
+#include <utility>
 #include <cassert>
+#include <algorithm>
+
+/**
+ * Per-neighbor halo lists of a shard in flat form. Entries for neighbor
+ * neighbors[n] are [offsets[n], offsets[n + 1]) of the ID arrays, sorted by
+ * global ID.
+ */
+struct HaloLists {
+    // Neighbor ranks in ascending order.
+    std::vector<int> neighbors;
+    // Global IDs of my rows that neighbors read.
+    std::vector<local_int_t> sendOffsets;
+    std::vector<global_int_t> sendIDs;
+    // Global IDs of neighbor rows that I read.
+    std::vector<local_int_t> recvOffsets;
+    std::vector<global_int_t> recvIDs;
+};
 
+/**
+ * Sorts (rank, global ID) pairs, drops duplicates and splits the result into
+ * per-rank ranges.
+ */
 inline void
-GetNeighborInfo(
-    SparseMatrix &A
+CompressHaloPairs(
+    std::vector< std::pair<int, global_int_t> > &pairs,
+    std::vector<int> &ranks,
+    std::vector<local_int_t> &offsets,
+    std::vector<global_int_t> &ids
+) {
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    //
+    ranks.clear();
+    offsets.clear();
+    ids.clear();
+    ids.reserve(pairs.size());
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (ranks.empty() || ranks.back() != pairs[i].first) {
+            ranks.push_back(pairs[i].first);
+            offsets.push_back(local_int_t(i));
+        }
+        ids.push_back(pairs[i].second);
+    }
+    offsets.push_back(local_int_t(pairs.size()));
+}
+
+/**
+ * Builds the send and receive lists of A from its global column indices.
+ */
+inline void
+BuildHaloLists(
+    SparseMatrix &A,
+    HaloLists &lists
 ) {
     using namespace std;
     // Extract Matrix pieces
-    SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    const SparseMatrixScalars *const Asclrs = A.sclrs->data();
     const Geometry *const Ageom = A.geom->data();
     //
     const local_int_t numberOfNonzerosPerRow = Ageom->stencilSize;
     //
     const local_int_t localNumberOfRows = Asclrs->localNumberOfRows;
     //
-    char *nonzerosInRow = A.nonzerosInRow->data();
+    const char *const nonzerosInRow = A.nonzerosInRow->data();
     // Interpreted as 2D array
     Array2D<global_int_t> mtxIndG(
         localNumberOfRows, numberOfNonzerosPerRow, A.mtxIndG->data()
     );
     //
-    global_int_t *AlocalToGlobalMap = A.localToGlobalMap->data();
-
-    std::map< int, std::set< global_int_t> > sendList, receiveList;
-    typedef std::map< int, std::set< global_int_t> >::iterator map_iter;
-    typedef std::set<global_int_t>::iterator set_iter;
-    std::map< local_int_t, local_int_t > externalToLocalMap;
-
+    const global_int_t *const AlocalToGlobalMap = A.localToGlobalMap->data();
+    // (neighbor rank, global ID) pairs.
+    vector< pair<int, global_int_t> > sendPairs, recvPairs;
+    //
     for (local_int_t i = 0; i < localNumberOfRows; i++) {
         global_int_t currentGlobalRow = AlocalToGlobalMap[i];
         for (int j = 0; j < nonzerosInRow[i]; j++) {
@@ -88,63 +137,125 @@ GetNeighborInfo(
             // If column index is not a row index, then it comes from another
             // processor
             if (Ageom->rank != rankIdOfColumnEntry) {
-                receiveList[rankIdOfColumnEntry].insert(curIndex);
+                recvPairs.push_back(make_pair(rankIdOfColumnEntry, curIndex));
                 // Matrix symmetry means we know the neighbor process wants my
                 // value
-                sendList[rankIdOfColumnEntry].insert(currentGlobalRow);
+                sendPairs.push_back(
+                    make_pair(rankIdOfColumnEntry, currentGlobalRow)
+                );
             }
         }
     }
-    // Count number of matrix entries to send and receive.
-    local_int_t totalToBeSent = 0;
-    for (map_iter curNeighbor = sendList.begin();
-         curNeighbor != sendList.end(); ++curNeighbor) {
-        totalToBeSent += (curNeighbor->second).size();
-    }
-    // Build the arrays and lists needed by the ExchangeHalo function.
-    local_int_t *elementsToSend = new local_int_t[totalToBeSent];
-    int *neighbors = new int[sendList.size()];
-    local_int_t *receiveLength = new local_int_t[receiveList.size()];
-    local_int_t *sendLength = new local_int_t[sendList.size()];
-    int neighborCount = 0;
-    local_int_t receiveEntryCount = 0;
-    for (map_iter curNeighbor = receiveList.begin();
-         curNeighbor != receiveList.end();
-         ++curNeighbor, ++neighborCount) {
-        // rank of current neighbor we are processing
-        int neighborId = curNeighbor->first;
-        // store rank ID of current neighbor
-        neighbors[neighborCount] = neighborId;
-        receiveLength[neighborCount] = receiveList[neighborId].size();
-        // Get count of sends/receives
-        sendLength[neighborCount] = sendList[neighborId].size();
-        for (set_iter i = receiveList[neighborId].begin();
-             i != receiveList[neighborId].end();
-             ++i, ++receiveEntryCount) {
-            // The remote columns are indexed at end of internals
-            externalToLocalMap[*i] = localNumberOfRows + receiveEntryCount;
-        }
-    }
+    //
+    vector<int> sendNeighbors;
+    CompressHaloPairs(
+        recvPairs, lists.neighbors, lists.recvOffsets, lists.recvIDs
+    );
+    CompressHaloPairs(
+        sendPairs, sendNeighbors, lists.sendOffsets, lists.sendIDs
+    );
+    // Symmetry: I send to exactly the shards I receive from.
+    assert(sendNeighbors == lists.neighbors);
+}
+
+inline void
+GetNeighborInfo(
+    SparseMatrix &A
+) {
+    // Extract Matrix pieces
+    SparseMatrixScalars *const Asclrs = A.sclrs->data();
+    //
+    HaloLists lists;
+    BuildHaloLists(A, lists);
+    //
+    const int nNeighbors = int(lists.neighbors.size());
     // Store contents in our matrix struct.
-    Asclrs->numberOfRecvNeighbors = receiveList.size();
-    Asclrs->numberOfExternalValues = externalToLocalMap.size();
+    Asclrs->numberOfRecvNeighbors = nNeighbors;
+    Asclrs->numberOfExternalValues = lists.recvIDs.size();
     //
     Asclrs->localNumberOfColumns = Asclrs->localNumberOfRows
                                    + Asclrs->numberOfExternalValues;
     //
-    Asclrs->numberOfSendNeighbors = sendList.size();
-    Asclrs->totalToBeSent = totalToBeSent;
+    Asclrs->numberOfSendNeighbors = nNeighbors;
+    Asclrs->totalToBeSent = lists.sendIDs.size();
+    //
+    for (int n = 0; n < nNeighbors; ++n) {
+        A.neighbors->data()[n]  = lists.neighbors[n];
+        A.sendLength->data()[n] = lists.sendOffsets[n + 1]
+                                - lists.sendOffsets[n];
+        A.recvLength->data()[n] = lists.recvOffsets[n + 1]
+                                - lists.recvOffsets[n];
+    }
+}
+
+/**
+ * Splits the rows of A into interior rows (all columns local) and boundary
+ * rows (at least one halo column) so that kernels can work on the interior
+ * while the halo exchange is in flight. Must be rerun whenever the rows of A
+ * are permuted.
+ */
+inline void
+ClassifyHaloRows(
+    SparseMatrix &A,
+    LegionRuntime::HighLevel::Context ctx,
+    LegionRuntime::HighLevel::Runtime *lrt
+) {
+    const local_int_t nrow = A.sclrs->data()->localNumberOfRows;
+    const int nnpr = A.geom->data()->stencilSize;
+    //
+    const char *const nonzerosInRow = A.nonzerosInRow->data();
+    assert(nonzerosInRow);
+    Array2D<local_int_t> mtxIndL(nrow, nnpr, A.mtxIndL->data());
     //
-    for (int i = 0; i < Asclrs->numberOfSendNeighbors; ++i) {
-        A.neighbors->data()[i]  = neighbors[i];
-        A.sendLength->data()[i] = sendLength[i];
-        A.recvLength->data()[i] = receiveLength[i];
+    if (!A.haloSplitRows) {
+        A.lHaloSplitRows.allocate("haloSplitRows", nrow, ctx, lrt);
+        A.haloSplitRows = new Array<local_int_t>(
+            A.lHaloSplitRows.mapRegion(RW_E, ctx, lrt), ctx, lrt
+        );
     }
+    local_int_t *const splitRows = A.haloSplitRows->data();
+    assert(splitRows);
     //
-    delete[] elementsToSend;
-    delete[] neighbors;
-    delete[] receiveLength;
-    delete[] sendLength;
+    std::vector<char> isBoundary(nrow, 0);
+    local_int_t nInterior = 0;
+    for (local_int_t i = 0; i < nrow; ++i) {
+        const local_int_t *const cols = mtxIndL(i);
+        for (int j = 0; j < nonzerosInRow[i]; ++j) {
+            if (cols[j] >= nrow) {
+                isBoundary[i] = 1;
+                break;
+            }
+        }
+        if (!isBoundary[i]) ++nInterior;
+    }
+    A.nInteriorRows = nInterior;
+    // Stable split; rows are visited in storage (and therefore color) order.
+    local_int_t nextInterior = 0, nextBoundary = nInterior;
+    for (local_int_t i = 0; i < nrow; ++i) {
+        if (isBoundary[i]) splitRows[nextBoundary++] = i;
+        else               splitRows[nextInterior++] = i;
+    }
+    // Per-color ranges of both groups.
+    std::fill(
+        A.interiorColorOffsets, A.interiorColorOffsets + HPCG_STENCIL + 1, 0
+    );
+    std::fill(
+        A.boundaryColorOffsets, A.boundaryColorOffsets + HPCG_STENCIL + 1, 0
+    );
+    if (A.nColors > 0) {
+        A.interiorColorOffsets[0] = 0;
+        A.boundaryColorOffsets[0] = nInterior;
+        for (int c = 0; c < A.nColors; ++c) {
+            local_int_t nci = 0, ncb = 0;
+            for (local_int_t i = A.colorOffsets[c];
+                 i < A.colorOffsets[c + 1]; ++i) {
+                if (isBoundary[i]) ++ncb;
+                else               ++nci;
+            }
+            A.interiorColorOffsets[c + 1] = A.interiorColorOffsets[c] + nci;
+            A.boundaryColorOffsets[c + 1] = A.boundaryColorOffsets[c] + ncb;
+        }
+    }
 }
 
 /*!
@@ -183,39 +294,11 @@ SetupHalo(
         localNumberOfRows, numberOfNonzerosPerRow, A.mtxIndL->data()
     );
     //
-    global_int_t *AlocalToGlobalMap = A.localToGlobalMap->data();
-
-    std::map< int, std::set< global_int_t> > sendList, receiveList;
-    typedef std::map< int, std::set< global_int_t> >::iterator map_iter;
-    typedef std::set<global_int_t>::iterator set_iter;
-    std::map< local_int_t, local_int_t > externalToLocalMap;
-
-    for (local_int_t i = 0; i < localNumberOfRows; i++) {
-        global_int_t currentGlobalRow = AlocalToGlobalMap[i];
-        for (int j = 0; j < nonzerosInRow[i]; j++) {
-            global_int_t curIndex = mtxIndG(i, j);
-            int rankIdOfColumnEntry = ComputeRankOfMatrixRow(*(Ageom), curIndex);
-            // If column index is not a row index, then it comes from another
-            // processor
-            if (Ageom->rank != rankIdOfColumnEntry) {
-                receiveList[rankIdOfColumnEntry].insert(curIndex);
-                // Matrix symmetry means we know the neighbor process wants my
-                // value
-                sendList[rankIdOfColumnEntry].insert(currentGlobalRow);
-            }
-        }
-    }
+    HaloLists lists;
+    BuildHaloLists(A, lists);
     // Count number of matrix entries to send and receive.
-    local_int_t totalToBeSent = 0;
-    for (map_iter curNeighbor = sendList.begin();
-         curNeighbor != sendList.end(); ++curNeighbor) {
-        totalToBeSent += (curNeighbor->second).size();
-    }
-    local_int_t totalToBeReceived = 0;
-    for (map_iter curNeighbor = receiveList.begin();
-         curNeighbor != receiveList.end(); ++curNeighbor) {
-        totalToBeReceived += (curNeighbor->second).size();
-    }
+    const local_int_t totalToBeSent = lists.sendIDs.size();
+    const local_int_t totalToBeReceived = lists.recvIDs.size();
     // Build the arrays and lists needed by the ExchangeHalo function.
     A.lElementsToSend.allocate(
         "elementsToSend", totalToBeSent, ctx, lrt
@@ -225,48 +308,33 @@ SetupHalo(
     );
     local_int_t *elementsToSend = AelementsToSend->data();
     assert(elementsToSend);
-    //
-    int *neighbors = new int[sendList.size()];
-    local_int_t *receiveLength = new local_int_t[receiveList.size()];
-    local_int_t *sendLength = new local_int_t[sendList.size()];
-    int neighborCount = 0;
-    local_int_t receiveEntryCount = 0;
-    local_int_t sendEntryCount = 0;
-    for (map_iter curNeighbor = receiveList.begin();
-         curNeighbor != receiveList.end();
-         ++curNeighbor, ++neighborCount) {
-        // rank of current neighbor we are processing
-        int neighborId = curNeighbor->first;
-        // store rank ID of current neighbor
-        neighbors[neighborCount] = neighborId;
-        receiveLength[neighborCount] = receiveList[neighborId].size();
-        // Get count of sends/receives
-        sendLength[neighborCount] = sendList[neighborId].size();
-        for (set_iter i = receiveList[neighborId].begin();
-             i != receiveList[neighborId].end();
-             ++i, ++receiveEntryCount) {
-            // The remote columns are indexed at end of internals
-            externalToLocalMap[*i] = localNumberOfRows + receiveEntryCount;
-        }
-        for (set_iter i = sendList[neighborId].begin();
-             i != sendList[neighborId].end();
-             ++i, ++sendEntryCount) {
-            // Store local ids of entry to send.
-            elementsToSend[sendEntryCount] = A.globalToLocalMap[*i];
-        }
+    // The remote columns are indexed at end of internals in (neighbor,
+    // global ID) order.
+    FlatMap<global_int_t, local_int_t> externalToLocalMap;
+    externalToLocalMap.reserve(totalToBeReceived);
+    for (local_int_t i = 0; i < totalToBeReceived; ++i) {
+        externalToLocalMap.insert(lists.recvIDs[i], localNumberOfRows + i);
     }
-    //
+    externalToLocalMap.finalize();
+    // Store local ids of entry to send.
+    for (local_int_t i = 0; i < totalToBeSent; ++i) {
+        elementsToSend[i] = A.globalToLocalMap.at(lists.sendIDs[i]);
+    }
+    // Rewrite the column indices. Rows are independent and the maps are
+    // read-only here.
+    const int nThreads = Ageom->numThreads > 0 ? Ageom->numThreads : 1;
+    #pragma omp parallel for num_threads(nThreads) schedule(static)
     for (local_int_t i = 0; i < localNumberOfRows; i++) {
         for (int j = 0; j < nonzerosInRow[i]; j++) {
             global_int_t curIndex = mtxIndG(i, j);
             int rankIdOfColumnEntry = ComputeRankOfMatrixRow(*(Ageom), curIndex);
             // My column index, so convert to local index
             if (Ageom->rank == rankIdOfColumnEntry) {
-                mtxIndL(i, j) = A.globalToLocalMap[curIndex];
+                mtxIndL(i, j) = A.globalToLocalMap.at(curIndex);
             }
             // If column index is not a row index, then it comes from another processor
             else {
-                mtxIndL(i, j) = externalToLocalMap[curIndex];
+                mtxIndL(i, j) = externalToLocalMap.at(curIndex);
             }
         }
     }
@@ -295,16 +363,188 @@ SetupHalo(
     }
 #endif
 
-    delete[] neighbors;
-    delete[] receiveLength;
-    delete[] sendLength;
-    // delete[] elementsToSend; Don't delete. Stored in sparse matrix.
+    // elementsToSend is not deleted: it is stored in the sparse matrix.
+    //
+    ClassifyHaloRows(A, ctx, lrt);
 }
 
 /**
- *
+ * Creates the PhaseBarriers owned by this shard (Synchronizers::mine). Runs
+ * inside every shard once its neighbor information is known, so barrier
+ * creation is spread across the shards instead of serialized in the top-level
+ * task.
+ */
+inline void
+SetupHaloSynchronizers(
+    SparseMatrix &A,
+    LegionRuntime::HighLevel::Context ctx,
+    LegionRuntime::HighLevel::Runtime *lrt
+) {
+    const int nNeighbors = A.sclrs->data()->numberOfSendNeighbors;
+    Synchronizers *mySync = A.synchronizers->data();
+    assert(mySync);
+    //
+    mySync->mine = {
+        // Means I am ready for neighboring tasks to PULL values.
+        .ready = lrt->create_phase_barrier(ctx, 1),
+        // Means All pulls are complete.
+        .done  = lrt->create_phase_barrier(ctx, nNeighbors)
+    };
+}
+
+/**
+ * Ranks of the shards whose boxes touch that of shard rank in the npx by npy
+ * by npz processor grid, in ascending order. These are the neighbors
+ * BuildHaloLists finds for the 27-point stencil, on every level.
+ */
+inline void
+ComputeNeighborRanks(
+    int npx,
+    int npy,
+    int npz,
+    int rank,
+    std::vector<int> &ranks
+) {
+    const int ipz = rank / (npx * npy);
+    const int ipy = (rank - ipz * npx * npy) / npx;
+    const int ipx = rank % npx;
+    //
+    ranks.clear();
+    for (int dz = -1; dz <= 1; ++dz) {
+        if (ipz + dz < 0 || ipz + dz >= npz) continue;
+        for (int dy = -1; dy <= 1; ++dy) {
+            if (ipy + dy < 0 || ipy + dy >= npy) continue;
+            for (int dx = -1; dx <= 1; ++dx) {
+                if (ipx + dx < 0 || ipx + dx >= npx) continue;
+                if (dx == 0 && dy == 0 && dz == 0) continue;
+                ranks.push_back(
+                    (ipz + dz) * npx * npy + (ipy + dy) * npx + ipx + dx
+                );
+            }
+        }
+    }
+}
+
+/**
+ * Neighbor ranks of shard rank in the processor grid of geom.
  */
 inline void
+ComputeNeighborRanks(
+    const Geometry &geom,
+    int rank,
+    std::vector<int> &ranks
+) {
+    ComputeNeighborRanks(geom.npx, geom.npy, geom.npz, rank, ranks);
+}
+
+/**
+ * Projects region requirement n of a wireSynchronizersTask point onto the
+ * Synchronizers of the shard's n-th neighbor. Requirements past a shard's
+ * last neighbor are projected onto its own Synchronizers and are not read.
+ * The launch spans every shard, so its domain gives the processor grid, which
+ * GenerateGeometry derives from the shard count alone.
+ */
+class NeighborSyncsProjection : public ProjectionFunctor {
+public:
+    /**
+     *
+     */
+    NeighborSyncsProjection(void) : ProjectionFunctor() { }
+
+    /**
+     *
+     */
+    virtual LogicalRegion
+    project(
+        const Mappable *mappable,
+        unsigned index,
+        LogicalPartition upperBound,
+        const DomainPoint &point
+    ) {
+        const Task *const task = mappable->as_task();
+        assert(task);
+        const int nShards = int(task->index_domain.get_volume());
+        int npx, npy, npz;
+        ComputeOptimalShapeXYZ(nShards, npx, npy, npz);
+        //
+        const int shard = point.point_data[0];
+        std::vector<int> ranks;
+        ComputeNeighborRanks(npx, npy, npz, shard, ranks);
+        const int color = index < ranks.size() ? ranks[index] : shard;
+        return runtime->get_logical_subregion_by_color(
+            upperBound, DomainPoint::from_point<1>(Point<1>(color))
+        );
+    }
+
+    /**
+     *
+     */
+    virtual bool
+    is_exclusive(void) const { return true; }
+
+    /**
+     *
+     */
+    virtual unsigned
+    get_depth(void) const { return 0; }
+};
+
+/**
+ * Gathers the PhaseBarriers of a shard's neighbors. Regions are the
+ * Synchronizers of each neighbor, in neighbor-list order, followed by unused
+ * ones; the local argument is the number of neighbors. Only
+ * Synchronizers::neighbors and Synchronizers::nNeighbors of the result are
+ * populated.
+ */
+inline Synchronizers
+wireSynchronizersTask(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx,
+    HighLevelRuntime *lrt
+) {
+    Synchronizers res;
+    //
+    assert(task->local_arglen == sizeof(int));
+    const int nNeighbors = *(const int *)task->local_args;
+    res.nNeighbors = nNeighbors;
+    assert(nNeighbors <= int(regions.size()));
+    assert(nNeighbors <= HPCG_STENCIL - 1);
+    for (int n = 0; n < nNeighbors; ++n) {
+        Item<Synchronizers> nSync(regions[n], ctx, lrt);
+        assert(nSync.data());
+        res.neighbors[n] = nSync.data()->mine;
+    }
+    return res;
+}
+
+/**
+ * Stores the neighbor PhaseBarriers gathered by wireSynchronizersTask in A.
+ * They were gathered for the neighbors ComputeNeighborRanks predicts, which
+ * must be the ones SetupHalo found.
+ */
+inline void
+SetNeighborSynchronizers(
+    SparseMatrix &A,
+    const Synchronizers &wired
+) {
+    const int nNeighbors = A.sclrs->data()->numberOfSendNeighbors;
+    assert(wired.nNeighbors == nNeighbors);
+    Synchronizers *mySync = A.synchronizers->data();
+    assert(mySync);
+    //
+    for (int n = 0; n < nNeighbors; ++n) {
+        mySync->neighbors[n] = wired.neighbors[n];
+    }
+}
+
+/**
+ * Launches wireSynchronizersTask over all shards for the given level as one
+ * index launch. Each point reads only the Synchronizers of its own neighbors
+ * (see NeighborSyncsProjection); the results are handed to the benchmark
+ * tasks as futures (see SetNeighborSynchronizers).
+ */
+inline LegionRuntime::HighLevel::FutureMap
 SetupHaloTopLevel(
     LogicalSparseMatrix &A,
     int level,
@@ -313,115 +553,70 @@ SetupHaloTopLevel(
 ) {
     using namespace std;
     //
-    cout << "*** Setting Up Structures for SPMD Exchanges (Level "
+    cout << "*** Wiring Structures for SPMD Exchanges (Level "
          << level << ")" << endl;
     const double startTime = mytimer();
     const int nShards = A.geom->size;
-    // Extract required info from logical structures.
-    cout << "--> Memory for SparseMatrixScalars="
-         << (sizeof(SparseMatrixScalars) * nShards) / 1024.0 / 1024.0
-         << " MB" << endl;
-    Array<SparseMatrixScalars> aSparseMatrixScalars(
-        A.sclrs.mapRegion(RW_E, ctx, lrt), ctx, lrt
-    );
-    SparseMatrixScalars *smScalars = aSparseMatrixScalars.data();
-    assert(smScalars);
-    //
-    const int maxNumNeighbors = A.geom->stencilSize - 1;
-    cout << "--> Memory for Neighbors="
-         << (sizeof(int) * nShards * maxNumNeighbors) / 1024.0 / 1024.0
-         << " MB" << endl;
-    //
-    Array<int> aNeighbors(
-        A.neighbors.mapRegion(RO_E, ctx, lrt), ctx, lrt
-    );
-    // For convenience we'll interpret this as a 2D array.
-    Array2D<int> neighbors(nShards, maxNumNeighbors, aNeighbors.data());
-    //
-    cout << "--> Memory for Synchronizers="
-         << (sizeof(Synchronizers) * nShards) / 1024.0 / 1024.0
-         << " MB" << endl;
-    Array<Synchronizers> aSynchronizers(
-        A.synchronizers.mapRegion(RW_E, ctx, lrt), ctx, lrt
-    );
-    Synchronizers *synchronizers = aSynchronizers.data();
-    assert(synchronizers);
-    //
-    cout << "--> Memory for Send Lengths="
-         << (sizeof(local_int_t) * nShards * maxNumNeighbors) / 1024.0 / 1024.0
-         << " MB" << endl;
-    Array<local_int_t> aSendLengths(
-        A.sendLength.mapRegion(RO_E, ctx, lrt), ctx, lrt
-    );
-    Array2D<local_int_t> ASendLengths(
-        nShards, maxNumNeighbors, aSendLengths.data()
-    );
-    // Iterate over all shards and populate table that maps task IDs to their
-    // index into the neighbor list.
-    vector< map<int, int> > tidToNIdx(nShards);
+    // Every point gets as many requirements as the shard with the most
+    // neighbors, and its own neighbor count as its argument.
+    vector<int> nNeighbors(nShards);
+    int maxNeighbors = 0;
+    ArgumentMap argMap;
     for (int shard = 0; shard < nShards; ++shard) {
-        // Get total number of neighbors this shard has
-        const SparseMatrixScalars &myScalars = smScalars[shard];
-        const int nNeighbors = myScalars.numberOfSendNeighbors;
-        //
-        for (int n = 0; n < nNeighbors; ++n) {
-            int tid = neighbors(shard, n);
-            tidToNIdx[shard][tid] = n;
-        }
+        vector<int> ranks;
+        ComputeNeighborRanks(*A.geom, shard, ranks);
+        nNeighbors[shard] = int(ranks.size());
+        maxNeighbors = max(maxNeighbors, nNeighbors[shard]);
+        argMap.set_point(
+            DomainPoint::from_point<1>(Point<1>(shard)),
+            TaskArgument(&nNeighbors[shard], sizeof(int))
+        );
     }
-    // Iterate over all the shards and populate the synchronization structures.
-    for (int shard = 0; shard < nShards; ++shard) {
-        // Get total number of neighbors this shard has
-        const SparseMatrixScalars &myScalars = smScalars[shard];
-        const int nNeighbors = myScalars.numberOfSendNeighbors;
-#if 0 // Debug
-        cout << "Rank " << shard << " Has "
-             << nNeighbors << " Pull Neighbors: " << endl;
-        for (int n = 0; n < nNeighbors; ++n) {
-            cout << neighbors(shard, n) << " ";
-        }
-        cout << endl;
-#endif // Debug
-        // Create PhaseBarriers for shard.
-        PhaseBarriers pbs = {
-            // Means I am ready for neighboring tasks to PULL values.
-            .ready = lrt->create_phase_barrier(ctx, 1),
-            // Means All pulls are complete.
-            .done  = lrt->create_phase_barrier(ctx, nNeighbors)
-        };
-        //
-        Synchronizers &mySync = synchronizers[shard];
-        // This one is mine.
-        mySync.mine = pbs;
-        // Share mine with my all neighbors.
-        for (int n = 0; n < nNeighbors; ++n) {
-            // Get nth neighbor ID.
-            const int myn = neighbors(shard, n);
-            // Share my Synchronizers with that neighbor.
-            synchronizers[myn].neighbors[tidToNIdx[myn][shard]] = pbs;
-        }
-    }
-#if 0 // Debug Synchronizers
-    for (int shard = 0; shard < nShards; ++shard) {
-        const SparseMatrixScalars &myScalars = smScalars[shard];
-        const int nNeighbors = myScalars.numberOfSendNeighbors;
-        const Synchronizers &mySync = synchronizers[shard];
-        cout << "task=" << shard << " sync data: " << endl;
-        cout << "--------> mine.ready=" << mySync.mine.ready << endl;
-        cout << "--------> mine.done =" << mySync.mine.done << endl;
-        for (int n = 0; n < nNeighbors; ++n) {
-            cout << "--------> .ready=" << mySync.neighbors[n].ready << endl;
-            cout << "--------> .done =" << mySync.neighbors[n].done << endl;
-        }
+    //
+    Rect<1> shardBounds(Point<1>(0), Point<1>(nShards - 1));
+    IndexLauncher launcher(
+        WIRE_SYNCHRONIZERS_TID,
+        Domain::from_rect<1>(shardBounds),
+        TaskArgument(NULL, 0),
+        argMap
+    );
+    for (int n = 0; n < maxNeighbors; ++n) {
+        launcher.add_region_requirement(
+            RegionRequirement(
+                A.synchronizers.logicalPartition,
+                NEIGHBOR_SYNCS_PID,
+                RO_E,
+                A.synchronizers.logicalRegion
+            )
+        ).add_field(A.synchronizers.fid);
     }
-#endif
-    // Cleanup and reporting.
-    A.sclrs.unmapRegion(ctx, lrt);
-    A.neighbors.unmapRegion(ctx, lrt);
-    A.synchronizers.unmapRegion(ctx, lrt);
-    A.sendLength.unmapRegion(ctx, lrt);
+    FutureMap fm = lrt->execute_index_space(ctx, launcher);
     //
     const double initEnd = mytimer();
     const double initTime = initEnd - startTime;
     cout << "--> Time=" << initTime << " s" << endl;
+    //
+    return fm;
+}
+
+/**
+ *
+ */
+inline void
+registerSetupHaloTasks(void)
+{
+    HighLevelRuntime::preregister_projection_functor(
+        NEIGHBOR_SYNCS_PID, new NeighborSyncsProjection()
+    );
+    HighLevelRuntime::register_legion_task<
+        Synchronizers, wireSynchronizersTask
+    >(
+        WIRE_SYNCHRONIZERS_TID /* task id */,
+        Processor::LOC_PROC /* proc kind  */,
+        false /* single */,
+        true /* index */,
+        AUTO_GENERATE_ID,
+        TaskConfigOptions(true /* leaf task */),
+        "wireSynchronizersTask"
+    );
 }
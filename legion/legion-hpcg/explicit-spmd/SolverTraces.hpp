@@ -27,34 +27,58 @@
  * LA-CC 10-123
  */
 
+
+/*!
+    @file SolverTraces.hpp
+
+    Runtime trace IDs for the repeated launch sequences of the solvers.
+ */
+
 #pragma once
 
 #include "LegionStuff.hpp"
-#include "LegionArrays.hpp"
 
-#include <cstring>
+#include <map>
+#include <tuple>
 
 /**
- *
+ * Launch sequences that are traced.
  */
-inline void
-regionToRegionCopyTask(
-    const Task *task,
-    const std::vector<PhysicalRegion> &regions,
-    Context ctx,
-    Runtime *lrt
-) {
-    Array<floatType> src(regions[0], ctx, lrt);
-    Array<floatType> dst(regions[1], ctx, lrt);
-
-    assert(src.length() == dst.length());
-
-    const floatType *const sv = src.data();
-    assert(sv);
-
-    floatType *const dv = dst.data();
-    assert(dv);
-
-    const size_t cpySize = src.length() * sizeof(floatType);
-    (void)memmove(dv, sv, cpySize);
-}
+enum SolverTraceKind {
+    // One MG V-cycle (all levels).
+    SOLVER_TRACE_MG = 0,
+    // The body of a CG iteration after the preconditioner (k > 1).
+    SOLVER_TRACE_CG_ITERATION
+};
+
+/**
+ * Hands out one TraceID per (kind, kernel configuration, vector pair), so a
+ * trace is only replayed over the same launches on the same regions. Trace IDs
+ * are scoped by context, so each shard keeps its own registry.
+ */
+class SolverTraceRegistry {
+    using Key = std::tuple<int, int, LogicalRegion, LogicalRegion>;
+    //
+    std::map<Key, Legion::TraceID> mIDs;
+
+public:
+    /**
+     * Returns the TraceID for the given key, assigning a new one (starting at
+     * 1) the first time it is seen.
+     */
+    Legion::TraceID
+    getID(
+        int kind,
+        int config,
+        const LogicalRegion &a,
+        const LogicalRegion &b
+    ) {
+        const Key key(kind, config, a, b);
+        auto it = mIDs.find(key);
+        if (it != mIDs.end()) return it->second;
+        //
+        const Legion::TraceID tid = Legion::TraceID(mIDs.size() + 1);
+        mIDs[key] = tid;
+        return tid;
+    }
+};
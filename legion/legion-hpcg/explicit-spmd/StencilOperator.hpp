@@ -0,0 +1,236 @@
+/**
+ * Copyright (c)      2017 Los Alamos National Security, LLC
+ *                         All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * LA-CC 10-123
+ */
+
+
+/*!
+    @file StencilOperator.hpp
+
+    Matrix-free form of the 27-point operator of a SparseMatrix.
+ */
+
+#pragma once
+
+#include "hpcg.hpp"
+#include "LegionStuff.hpp"
+#include "LegionArrays.hpp"
+
+/**
+ * Local grid and row numbering of one level. Rows are either stored in
+ * natural order or, after OptimizeProblem, grouped by the parity color
+ * c = (ix % 2) + 2 (iy % 2) + 4 (iz % 2) with natural order within a color.
+ */
+struct StencilGrid {
+    // Local grid dimensions.
+    local_int_t nx;
+    local_int_t ny;
+    local_int_t nz;
+    // Whether rows are grouped by parity color.
+    bool colored;
+    // Number of colors (zero unless colored).
+    int nColors;
+    // Rows of color c are [colorOffsets[c], colorOffsets[c + 1]).
+    local_int_t colorOffsets[HPCG_STENCIL + 1];
+};
+
+/**
+ * The operator generated by GenerateProblem: the diagonal (read from
+ * matrixDiagonal, since TestCG changes it) and -1 for every neighbor. Rows
+ * whose neighbors are all local (the interior rows of ClassifyHaloRows) are
+ * computed from the grid alone. Only the boundary rows, which reference halo
+ * columns, keep explicit column indices.
+ */
+struct StencilOperator {
+    StencilGrid grid;
+    // Boundary row b is haloSplitRows[nInteriorRows + b]; its columns are
+    // boundaryColInds[b * HPCG_STENCIL ..] (boundaryNnz[b] of them).
+    local_int_t nBoundaryRows = 0;
+    LogicalArray<local_int_t> lBoundaryColInds;
+    Array<local_int_t> *boundaryColInds = nullptr;
+    LogicalArray<char> lBoundaryNnz;
+    Array<char> *boundaryNnz = nullptr;
+
+    /**
+     *
+     */
+    ~StencilOperator(void) {
+        delete boundaryColInds;
+        delete boundaryNnz;
+    }
+};
+
+/**
+ * Returns the storage row of grid point (ix, iy, iz).
+ */
+inline local_int_t
+StencilStorageRow(
+    const StencilGrid &g,
+    local_int_t ix,
+    local_int_t iy,
+    local_int_t iz
+) {
+    if (!g.colored) return (iz * g.ny + iy) * g.nx + ix;
+    //
+    const int px = ix & 1, py = iy & 1, pz = iz & 1;
+    // Points of this parity in x and y.
+    const local_int_t cx = (g.nx - px + 1) / 2;
+    const local_int_t cy = (g.ny - py + 1) / 2;
+    //
+    return g.colorOffsets[px + 2 * py + 4 * pz]
+         + ((iz >> 1) * cy + (iy >> 1)) * cx + (ix >> 1);
+}
+
+/**
+ * Returns the grid point of storage row i, which has color c (ignored unless
+ * the rows are colored).
+ */
+inline void
+StencilGridPoint(
+    const StencilGrid &g,
+    int c,
+    local_int_t i,
+    local_int_t &ix,
+    local_int_t &iy,
+    local_int_t &iz
+) {
+    if (!g.colored) {
+        ix = i % g.nx;
+        iy = (i / g.nx) % g.ny;
+        iz = i / (g.nx * g.ny);
+        return;
+    }
+    const int px = c & 1, py = (c >> 1) & 1, pz = (c >> 2) & 1;
+    const local_int_t cx = (g.nx - px + 1) / 2;
+    const local_int_t cy = (g.ny - py + 1) / 2;
+    const local_int_t r = i - g.colorOffsets[c];
+    //
+    ix = 2 * (r % cx) + px;
+    iy = 2 * ((r / cx) % cy) + py;
+    iz = 2 * (r / (cx * cy)) + pz;
+}
+
+/**
+ * Returns the sum of x over the neighbors of interior row i (color c). The
+ * off-diagonal entries are all -1, so row i of Ax is diag[i] x[i] minus this.
+ */
+inline floatType
+StencilInteriorNeighborSum(
+    const StencilGrid &g,
+    int c,
+    local_int_t i,
+    const floatType *const xv
+) {
+    local_int_t ix, iy, iz;
+    StencilGridPoint(g, c, i, ix, iy, iz);
+    //
+    floatType sum = 0.0;
+    for (int sz = -1; sz <= 1; ++sz) {
+        const local_int_t jz = iz + sz;
+        if (jz < 0 || jz >= g.nz) continue;
+        for (int sy = -1; sy <= 1; ++sy) {
+            const local_int_t jy = iy + sy;
+            if (jy < 0 || jy >= g.ny) continue;
+            for (int sx = -1; sx <= 1; ++sx) {
+                const local_int_t jx = ix + sx;
+                if (jx < 0 || jx >= g.nx) continue;
+                if (sx == 0 && sy == 0 && sz == 0) continue;
+                sum += xv[StencilStorageRow(g, jx, jy, jz)];
+            }
+        }
+    }
+    return sum;
+}
+
+/**
+ * Boundary-row counterpart of StencilInteriorNeighborSum.
+ */
+inline floatType
+StencilBoundaryNeighborSum(
+    local_int_t i,
+    const local_int_t *const cols,
+    int nnz,
+    const floatType *const xv
+) {
+    floatType sum = 0.0;
+    for (int j = 0; j < nnz; ++j) {
+        if (cols[j] != i) sum += xv[cols[j]];
+    }
+    return sum;
+}
+
+/**
+ * Box [lo, hi) of a local grid (x, y, z).
+ */
+struct StencilBox {
+    local_int_t lo[3];
+    local_int_t hi[3];
+};
+
+/**
+ * Structured form of the send lists of a level (see SetupStructuredHalo): the
+ * values neighbor n reads are the points of boxes[n] (one of the shard's 6
+ * faces, 12 edges, and 8 corners) in natural order.
+ */
+struct StructuredHalo {
+    StencilGrid grid;
+    int nNeighbors;
+    StencilBox boxes[HPCG_STENCIL - 1];
+};
+
+/**
+ * Gathers the points of box b of x into buf in natural order. Along x, the
+ * points of a parity color are contiguous, so every grid line is read as one
+ * (or, if colored, two interleaved) unit-stride streams.
+ */
+inline void
+PackStencilBox(
+    const StencilGrid &g,
+    const StencilBox &b,
+    const floatType *const xv,
+    floatType *buf
+) {
+    const local_int_t x0 = b.lo[0], x1 = b.hi[0];
+    for (local_int_t iz = b.lo[2]; iz < b.hi[2]; ++iz) {
+        for (local_int_t iy = b.lo[1]; iy < b.hi[1]; ++iy) {
+            if (!g.colored) {
+                const floatType *const line
+                    = xv + StencilStorageRow(g, 0, iy, iz);
+                for (local_int_t ix = x0; ix < x1; ++ix) *buf++ = line[ix];
+                continue;
+            }
+            // Row of the line's first even and odd point.
+            const floatType *const lines[2] = {
+                xv + StencilStorageRow(g, 0, iy, iz),
+                xv + (g.nx > 1 ? StencilStorageRow(g, 1, iy, iz) : 0)
+            };
+            for (local_int_t ix = x0; ix < x1; ++ix) {
+                *buf++ = lines[ix & 1][ix >> 1];
+            }
+        }
+    }
+}
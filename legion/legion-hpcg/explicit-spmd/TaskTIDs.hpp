@@ -38,23 +38,42 @@ enum {
     MAIN_TID = 0,
     GEN_PROB_TID,
     START_BENCHMARK_TID,
-    REGION_TO_REGION_COPY_TID,
+    WIRE_SYNCHRONIZERS_TID,
+    CREATE_NODE_COLLECTIVE_TID,
     DYN_COLL_TASK_CONTRIB_GIT_TID,
     DYN_COLL_TASK_CONTRIB_FT_TID,
     FLOAT_REDUCE_SUM_TID,
     FLOAT_REDUCE_MIN_TID,
     FLOAT_REDUCE_MAX_TID,
     INT_REDUCE_SUM_TID,
+    FLOAT_SUMS_REDUCE_SUM_TID,
+    COARSE_VECTOR_REDUCE_SUM_TID,
+    GRAM_SUMS_REDUCE_SUM_TID,
     COPY_VECTOR_TID,
     ZERO_VECTOR_TID,
     FILLRAND_VECTOR_TID,
     WAXPBY_TID,
     SPMV_TID,
     DDOT_TID,
+    DDOTS_TID,
     SYMGS_TID,
     PROLONGATION_TID,
     RESTRICTION_TID,
     FUTURE_MATH_TID,
     COMPUTE_RESIDUAL_TID,
-    EXCHANGE_HALO_TID
+    EXCHANGE_HALO_TID,
+    XR_UPDATE_TID,
+    P_UPDATE_TID,
+    PIPELINED_CG_UPDATE_TID,
+    AGGLOMERATE_GATHER_TID,
+    AGGLOMERATED_SOLVE_TID,
+    SSTEP_GRAM_TID,
+    SSTEP_COMBINE_TID
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Projection IDs (0 is the identity projection)
+////////////////////////////////////////////////////////////////////////////////
+enum {
+    NEIGHBOR_SYNCS_PID = 1
 };
@@ -53,6 +53,7 @@
 #include "LegionMatrices.hpp"
 #include "LegionCGData.hpp"
 #include "VectorOps.hpp"
+#include "CG.hpp"
 
 #include "hpcg.hpp"
 
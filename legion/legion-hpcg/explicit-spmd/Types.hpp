@@ -71,6 +71,12 @@ struct PhaseBarriers {
  */
 using floatType = double;
 
+/**
+ * Floating point type of the matrix copies used by the mixed-precision MG
+ * preconditioner (see SetupMixedPrecisionMG).
+ */
+using mgFloatType = float;
+
 /*!
     This defines the type for integers that have local subdomain dimension.
 
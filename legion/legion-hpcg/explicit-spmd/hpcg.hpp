@@ -48,10 +48,25 @@
 
 #pragma once
 
+#include "Geometry.hpp"
+
 #include <iostream>
 
 #define HPCG_STENCIL  27
 #define NUM_MG_LEVELS 4
+// Longest --save-checkpoint= or --load-checkpoint= directory.
+#define HPCG_MAX_PATH 256
+
+/*!
+  What is done with the per-shard problem checkpoints (see Checkpoint.hpp).
+*/
+enum CheckpointMode {
+    CHECKPOINT_NONE = 0,
+    // Write the problem once it is set up.
+    CHECKPOINT_SAVE,
+    // Read the problem instead of setting it up.
+    CHECKPOINT_LOAD
+};
 
 struct HPCG_Params {
     int commSize ; //!< Total number of shards.
@@ -62,6 +77,31 @@ struct HPCG_Params {
     //!< Number of seconds to run the timed portion of the benchmark.
     int runningTime;
     int stencilSize; //!< Size of the stencil
+    //!< SELL-C-sigma sorting window (0 selects the row-major layout).
+    int sellSigma;
+    //!< Timed CG waits on the residual norm every cgCheckFreq iterations.
+    int cgCheckFreq;
+    //!< If set, also time PipelinedCG and compare it against CG.
+    int pipelinedCG;
+    //!< If set, also run CG with the mixed-precision MG preconditioner.
+    int mixedMG;
+    //!< If set, apply the operator matrix-free in the optimized kernels.
+    int matrixFree;
+    //!< If set, run MG V-cycles and CG iterations as runtime traces.
+    int trace;
+    //!< Per-axis shard extents from --shard-weights= (even split if unset).
+    ShardSplits splits;
+    //!< Agglomerate the first coarse level with fewer rows per shard (0: off).
+    int agglomerateRows;
+    //!< Symmetric Gauss-Seidel sweeps of the agglomerated coarse solve.
+    int coarseSweeps;
+    //!< If set, also time the reduction-only SStepCG for s = 2 to this value
+    //   and compare it against CG.
+    int sstepCG;
+    //!< Save or load the set-up problem (see CheckpointMode).
+    int checkpointMode;
+    //!< Directory of the per-shard checkpoint files.
+    char checkpointDir[HPCG_MAX_PATH];
     double phase1InitTime;
 };
 
@@ -78,6 +118,18 @@ emit(const HPCG_Params &params) {
     cout << "nx: "          << params.nx << endl;
     cout << "ny: "          << params.ny << endl;
     cout << "nz: "          << params.nz << endl;
+    cout << "sellSigma: "   << params.sellSigma << endl;
+    cout << "cgCheckFreq: " << params.cgCheckFreq << endl;
+    cout << "pipelinedCG: " << params.pipelinedCG << endl;
+    cout << "mixedMG: "     << params.mixedMG << endl;
+    cout << "matrixFree: "  << params.matrixFree << endl;
+    cout << "trace: "       << params.trace << endl;
+    cout << "unevenShards: " << IsUneven(params.splits) << endl;
+    cout << "agglomerateRows: " << params.agglomerateRows << endl;
+    cout << "coarseSweeps: " << params.coarseSweeps << endl;
+    cout << "sstepCG: " << params.sstepCG << endl;
+    cout << "checkpointMode: " << params.checkpointMode << endl;
+    cout << "checkpointDir: " << params.checkpointDir << endl;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -42,11 +42,16 @@
 
 #include <cstdio>
 #include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
 
 #include "hpcg.hpp"
 #include "ReadHpcgDat.hpp"
+#include "GenerateGeometry.hpp"
 
 #include "LegionStuff.hpp"
+#include "CollectiveOps.hpp"
 
 static int
 startswith(
@@ -59,6 +64,23 @@ startswith(
     return 1;
 }
 
+/**
+ * Reads whitespace-separated shard weights (one per shard, in rank order).
+ */
+static int
+readShardWeights(
+    const char *fileName,
+    std::vector<double> &weights
+) {
+    FILE *wStream = fopen(fileName, "r");
+    if (!wStream) return 1;
+    double w;
+    weights.clear();
+    while (fscanf(wStream, "%lf", &w) == 1) weights.push_back(w);
+    fclose(wStream);
+    return 0;
+}
+
 int
 HPCG_Init(
     HPCG_Params &params,
@@ -68,6 +90,32 @@ HPCG_Init(
     char cparams[4][6] = {"--nx=", "--ny=", "--nz=", "--rt="};
     // Initialize iparams
     for (int i = 0; i < 4; ++i) iparams[i] = 0;
+    // Number of threads per shard (--nt=). Each shard owns one CPU, so more
+    // than one thread is opt-in.
+    int nThreads = 1;
+    // SELL-C-sigma sorting window (--sell-sigma=). Zero means row-major.
+    int sellSigma = 0;
+    // Timed CG residual check frequency (--cg-check-freq=).
+    int cgCheckFreq = 10;
+    // Pipelined CG comparison (--pipelined-cg=).
+    int pipelinedCG = 0;
+    // Mixed-precision MG comparison (--mixed-mg=).
+    int mixedMG = 0;
+    // Matrix-free operator (--matrix-free=).
+    int matrixFree = 0;
+    // Runtime tracing of the solvers (--trace=).
+    int trace = 1;
+    // Relative shard speeds for uneven decompositions (--shard-weights=).
+    std::string shardWeightsFile;
+    // Coarse-level agglomeration threshold (--agglomerate-rows=).
+    int agglomerateRows = 0;
+    // Sweeps of the agglomerated coarse solve (--coarse-sweeps=).
+    int coarseSweeps = 8;
+    // Largest block size of the s-step CG comparison (--sstep-cg=).
+    int sstepCG = 0;
+    // Problem checkpoint (--save-checkpoint=, --load-checkpoint=).
+    int checkpointMode = CHECKPOINT_NONE;
+    std::string checkpointDir;
     // process any user-supplied arguments
     const InputArgs &cArgs = HighLevelRuntime::get_input_args();
     for (int i = 1; i < cArgs.argc; ++i) {
@@ -79,6 +127,78 @@ HPCG_Init(
                 }
             }
         }
+        if (startswith(cArgs.argv[i], "--nt=")) {
+            if (sscanf(cArgs.argv[i] + strlen("--nt="), "%d", &nThreads) != 1
+                || nThreads < 1) {
+                nThreads = 1;
+            }
+        }
+        if (startswith(cArgs.argv[i], "--sell-sigma=")) {
+            if (sscanf(cArgs.argv[i] + strlen("--sell-sigma="), "%d",
+                       &sellSigma) != 1 || sellSigma < 0) {
+                sellSigma = 0;
+            }
+        }
+        if (startswith(cArgs.argv[i], "--cg-check-freq=")) {
+            if (sscanf(cArgs.argv[i] + strlen("--cg-check-freq="), "%d",
+                       &cgCheckFreq) != 1 || cgCheckFreq < 1) {
+                cgCheckFreq = 1;
+            }
+        }
+        if (startswith(cArgs.argv[i], "--pipelined-cg=")) {
+            if (sscanf(cArgs.argv[i] + strlen("--pipelined-cg="), "%d",
+                       &pipelinedCG) != 1 || pipelinedCG < 0) {
+                pipelinedCG = 0;
+            }
+        }
+        if (startswith(cArgs.argv[i], "--mixed-mg=")) {
+            if (sscanf(cArgs.argv[i] + strlen("--mixed-mg="), "%d",
+                       &mixedMG) != 1 || mixedMG < 0) {
+                mixedMG = 0;
+            }
+        }
+        if (startswith(cArgs.argv[i], "--matrix-free=")) {
+            if (sscanf(cArgs.argv[i] + strlen("--matrix-free="), "%d",
+                       &matrixFree) != 1 || matrixFree < 0) {
+                matrixFree = 0;
+            }
+        }
+        if (startswith(cArgs.argv[i], "--shard-weights=")) {
+            shardWeightsFile = cArgs.argv[i] + strlen("--shard-weights=");
+        }
+        if (startswith(cArgs.argv[i], "--agglomerate-rows=")) {
+            if (sscanf(cArgs.argv[i] + strlen("--agglomerate-rows="), "%d",
+                       &agglomerateRows) != 1 || agglomerateRows < 0) {
+                agglomerateRows = 0;
+            }
+        }
+        if (startswith(cArgs.argv[i], "--coarse-sweeps=")) {
+            if (sscanf(cArgs.argv[i] + strlen("--coarse-sweeps="), "%d",
+                       &coarseSweeps) != 1 || coarseSweeps < 1) {
+                coarseSweeps = 8;
+            }
+        }
+        if (startswith(cArgs.argv[i], "--sstep-cg=")) {
+            if (sscanf(cArgs.argv[i] + strlen("--sstep-cg="), "%d",
+                       &sstepCG) != 1 || sstepCG < 2) {
+                sstepCG = 0;
+            }
+            if (sstepCG > LGNCG_MAX_SSTEP) sstepCG = LGNCG_MAX_SSTEP;
+        }
+        if (startswith(cArgs.argv[i], "--save-checkpoint=")) {
+            checkpointMode = CHECKPOINT_SAVE;
+            checkpointDir = cArgs.argv[i] + strlen("--save-checkpoint=");
+        }
+        if (startswith(cArgs.argv[i], "--load-checkpoint=")) {
+            checkpointMode = CHECKPOINT_LOAD;
+            checkpointDir = cArgs.argv[i] + strlen("--load-checkpoint=");
+        }
+        if (startswith(cArgs.argv[i], "--trace=")) {
+            if (sscanf(cArgs.argv[i] + strlen("--trace="), "%d",
+                       &trace) != 1 || trace < 0) {
+                trace = 1;
+            }
+        }
     }
     // Check if --rt was specified on the command line
     // Assume runtime was not specified and will be read from the hpcg.dat file
@@ -109,10 +229,56 @@ HPCG_Init(
     params.runningTime = iparams[3];
     //
     params.commSize = spmdMeta.nRanks;
+    // Size shard boxes by weight. nx, ny, and nz then only set the global
+    // problem size.
+    params.splits.np[0] = params.splits.np[1] = params.splits.np[2] = 0;
+    if (!shardWeightsFile.empty()) {
+        std::vector<double> weights;
+        const int mgDiv = 1 << (NUM_MG_LEVELS - 1);
+        if (readShardWeights(shardWeightsFile.c_str(), weights)
+            || ComputeWeightedSplits(
+                   params.commSize, params.nx, params.ny, params.nz,
+                   weights, mgDiv, params.splits
+               )) {
+            std::cerr << "WARNING: cannot use shard weights from "
+                      << shardWeightsFile << " (expected " << params.commSize
+                      << " positive weights); using an even split."
+                      << std::endl;
+        }
+    }
     //
-    params.numThreads = 1;
+    params.numThreads = nThreads;
     //
     params.stencilSize = HPCG_STENCIL;
     //
+    params.sellSigma = sellSigma;
+    //
+    params.cgCheckFreq = cgCheckFreq;
+    //
+    params.pipelinedCG = pipelinedCG;
+    //
+    params.mixedMG = mixedMG;
+    //
+    params.matrixFree = matrixFree;
+    //
+    params.trace = trace;
+    //
+    params.agglomerateRows = agglomerateRows;
+    //
+    params.coarseSweeps = coarseSweeps;
+    //
+    params.sstepCG = sstepCG;
+    //
+    if (checkpointDir.empty() || checkpointDir.size() >= HPCG_MAX_PATH) {
+        if (checkpointMode != CHECKPOINT_NONE) {
+            std::cerr << "WARNING: ignoring checkpoint directory '"
+                      << checkpointDir << "'." << std::endl;
+        }
+        checkpointMode = CHECKPOINT_NONE;
+        checkpointDir.clear();
+    }
+    params.checkpointMode = checkpointMode;
+    strcpy(params.checkpointDir, checkpointDir.c_str());
+    //
     return 0;
 }
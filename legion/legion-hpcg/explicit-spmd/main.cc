@@ -55,8 +55,15 @@
 #include "GenerateProblem.hpp"
 #include "GenerateCoarseProblem.hpp"
 #include "SetupHalo.hpp"
+#include "OptimizeProblem.hpp"
 #include "CG.hpp"
+#include "PipelinedCG.hpp"
+#include "SStepCG.hpp"
+#include "Checkpoint.hpp"
+#include "TestCG.hpp"
+#include "TestSymmetry.hpp"
 #include "TestNorms.hpp"
+#include "ReportResults.hpp"
 #include "CheckProblem.hpp"
 #include "ComputeResidual.hpp"
 
@@ -102,7 +109,8 @@ genProblemTask(
         params.numThreads,
         nx, ny, nz,
         params.stencilSize,
-        A.geom->data()
+        A.geom->data(),
+        &params.splits
     );
     ierr = CheckAspectRatio(
         0.125,
@@ -117,6 +125,7 @@ genProblemTask(
     SparseMatrix *curLevelMatrix = &A;
     for (int level = 1; level < NUM_MG_LEVELS; ++level) {
         curLevelMatrix->Ac = new SparseMatrix(regions, rid, ctx, runtime);
+        curLevelMatrix->Ac->level = level;
         rid += curLevelMatrix->Ac->nRegionEntries();
         curLevelMatrix = curLevelMatrix->Ac;
     }
@@ -125,13 +134,31 @@ genProblemTask(
     Array<floatType> x     (regions[rid++], ctx, runtime);
     Array<floatType> xexact(regions[rid++], ctx, runtime);
     //
-    const int levelZero = 0;
-    GenerateProblem(A, &b, &x, &xexact, levelZero, ctx, runtime);
-    GetNeighborInfo(A);
-    //
+    // Every level can instead come from the shards' checkpoints.
+    const bool loaded = params.checkpointMode == CHECKPOINT_LOAD
+                     && LoadProblemCheckpoint(
+                            params.checkpointDir, A, b, x, xexact, ctx, runtime
+                        ) == 0;
+    if (!loaded) {
+        if (params.checkpointMode == CHECKPOINT_LOAD && rank == 0) {
+            cerr << "WARNING: no matching checkpoint in "
+                 << params.checkpointDir << "; generating the problem."
+                 << endl;
+        }
+        const int levelZero = 0;
+        GenerateProblem(A, &b, &x, &xexact, levelZero, ctx, runtime);
+        GetNeighborInfo(A);
+        //
+        curLevelMatrix = &A;
+        for (int level = 1; level < NUM_MG_LEVELS; ++level) {
+            GenerateCoarseProblem(*curLevelMatrix, level, ctx, runtime);
+            curLevelMatrix = curLevelMatrix->Ac;
+        }
+    }
+    // Create the PhaseBarriers this shard owns on every level.
     curLevelMatrix = &A;
-    for (int level = 1; level < NUM_MG_LEVELS; ++level) {
-        GenerateCoarseProblem(*curLevelMatrix, level, ctx, runtime);
+    for (int level = 0; level < NUM_MG_LEVELS; ++level) {
+        SetupHaloSynchronizers(*curLevelMatrix, ctx, runtime);
         curLevelMatrix = curLevelMatrix->Ac;
     }
 }
@@ -159,7 +186,8 @@ generateInitGeometry(
         params.numThreads,
         nx, ny, nz,
         params.stencilSize,
-        &globalGeom
+        &globalGeom,
+        &params.splits
     );
 }
 
@@ -173,6 +201,7 @@ createLogicalStructures(
     LogicalArray<floatType> &y,
     LogicalArray<floatType> &xexact,
     const Geometry          &geom,
+    const ShardSplits       &splits,
     Context ctx,
     HighLevelRuntime *runtime
 ) {
@@ -181,16 +210,18 @@ createLogicalStructures(
     // Application structures
     // First calculate global XYZ for the problem.
     global_int_t globalXYZ = getGlobalXYZ(geom);
+    // Shard boxes may differ in size.
+    const auto shardRows = ShardRowCounts(geom, &splits);
     //
     A.allocate("A", geom, ctx, runtime);
-    A.partition(geom.size, ctx, runtime);
+    A.partition(shardRows, ctx, runtime);
     A.geom = new Geometry(geom);
     x.allocate("x", globalXYZ, ctx, runtime);
-    x.partition(geom.size, ctx, runtime);
+    x.partition(shardRows, ctx, runtime);
     y.allocate("y", globalXYZ, ctx, runtime);
-    y.partition(geom.size, ctx, runtime);
+    y.partition(shardRows, ctx, runtime);
     xexact.allocate("xexact", globalXYZ, ctx, runtime);
-    xexact.partition(geom.size, ctx, runtime);
+    xexact.partition(shardRows, ctx, runtime);
     //
     cout << "*** Creating Logical MG Structures..." << endl;
     LogicalSparseMatrix *curLevelMatrix = &A;
@@ -244,7 +275,9 @@ mainTask(
     const vector<PhysicalRegion> &,
     Context ctx, HighLevelRuntime *runtime
 ) {
-    // Ask the mapper how many shards we can have.
+    // Ask the mapper how many shards we can have. Exactly one per processor:
+    // the shards are launched in a must epoch, and the runtime does not let
+    // two must-epoch tasks share a processor.
     const size_t nShards = getNumProcs();
     cout << endl;
     cout << "*****************************************************" << endl;
@@ -277,6 +310,16 @@ mainTask(
     cout << "--> ny="   << initGeom.ny   << endl;
     cout << "--> nz="   << initGeom.nz   << endl;
     cout << "--> nmg="  << NUM_MG_LEVELS << endl;
+    if (IsUneven(params.splits)) {
+        const char *axes[3] = {"x", "y", "z"};
+        for (int d = 0; d < 3; ++d) {
+            cout << "--> shard n" << axes[d] << "=";
+            for (int i = 0; i < params.splits.np[d]; ++i) {
+                cout << (i ? "," : "") << params.splits.widths[d][i];
+            }
+            cout << endl;
+        }
+    }
     ////////////////////////////////////////////////////////////////////////////
     cout << "*** Starting Initialization..." << endl;;
     // Application structures.
@@ -284,7 +327,7 @@ mainTask(
     LogicalArray<floatType> b, x, xexact;
     //
     createLogicalStructures(
-        A, b, x, xexact, initGeom, ctx, runtime
+        A, b, x, xexact, initGeom, params.splits, ctx, runtime
     );
     // Time to initialize problem before start of benchmark (phase 1).
     const double initStart = mytimer();
@@ -316,13 +359,16 @@ mainTask(
         fm.wait_all_results(silenceWarnings /*silence_warnings*/);
         //
     }
-    // Now that we have all the setup information stored in LogicalRegions,
-    // perform the top-level setup required for inter-task synchronization using
-    // PhaseBarriers.
+    // Now that every shard has created its PhaseBarriers, have the shards
+    // gather those of their neighbors. The results are consumed by the
+    // benchmark tasks, so there is no need to wait on them here.
+    vector<FutureMap> wiredSyncs;
     {
         LogicalSparseMatrix *curLevelMatrix = &A;
         for (int level = 0; level < NUM_MG_LEVELS; ++level) {
-            SetupHaloTopLevel(*curLevelMatrix, level, ctx, runtime);
+            wiredSyncs.push_back(
+                SetupHaloTopLevel(*curLevelMatrix, level, ctx, runtime)
+            );
             curLevelMatrix = curLevelMatrix->Ac;
         }
     }
@@ -358,6 +404,14 @@ mainTask(
             b.intent(     RW_E, shard, launcher, ctx, runtime);
             x.intent(     RW_E, shard, launcher, ctx, runtime);
             xexact.intent(RW_E, shard, launcher, ctx, runtime);
+            // Neighbor PhaseBarriers, one future per level.
+            for (int level = 0; level < NUM_MG_LEVELS; ++level) {
+                launcher.add_future(
+                    wiredSyncs[level].get_future(
+                        DomainPoint::from_point<1>(shard)
+                    )
+                );
+            }
             //
             mel.add_single_task(DomainPoint::from_point<1>(shard), launcher);
         }
@@ -461,9 +515,19 @@ startBenchmarkTask(
     SparseMatrix *curLevelMatrix = &A;
     for (int level = 1; level < numberOfMgLevels; ++level) {
         curLevelMatrix->Ac = new SparseMatrix(regions, rid, aif, ctx, lrt);
+        curLevelMatrix->Ac->level = level;
         rid += curLevelMatrix->Ac->nRegionEntries();
         curLevelMatrix = curLevelMatrix->Ac;
     }
+    // Neighbor PhaseBarriers gathered during initialization.
+    curLevelMatrix = &A;
+    for (int level = 0; level < numberOfMgLevels; ++level) {
+        SetNeighborSynchronizers(
+            *curLevelMatrix,
+            task->futures[level].get_result<Synchronizers>(silenceWarnings)
+        );
+        curLevelMatrix = curLevelMatrix->Ac;
+    }
     //
     Array<floatType> b     (regions[rid++], ctx, lrt);
     Array<floatType> x     (regions[rid++], ctx, lrt);
@@ -496,9 +560,17 @@ startBenchmarkTask(
         curLevelMatrix = curLevelMatrix->Ac;
     }
     // Setup halo information for all levels before we begin.
-    curLevelMatrix = &A;
-    for (int level = 0; level < numberOfMgLevels; ++level) {
+    vector<double> haloSetupTimes(numberOfMgLevels, 0.0);
+    const bool haloLoaded = params.checkpointMode == CHECKPOINT_LOAD
+                         && LoadHaloCheckpoint(
+                                params.checkpointDir, A, haloSetupTimes,
+                                ctx, lrt
+                            ) == 0;
+    curLevelMatrix = haloLoaded ? nullptr : &A;
+    for (int level = 0; curLevelMatrix && level < numberOfMgLevels; ++level) {
+        const double haloStart = mytimer();
         SetupHalo(*curLevelMatrix, ctx, lrt);
+        haloSetupTimes[level] = mytimer() - haloStart;
         curLevelMatrix = curLevelMatrix->Ac;
     }
     // Ghost info setup (we can't do it lazily like before because Legion
@@ -524,6 +596,75 @@ startBenchmarkTask(
     times[9] = setup_time;
     //
     const int rank = A.geom->data()->rank;
+    int ierr = 0;
+    // The checkpoint holds the problem as generated, so it is written before
+    // OptimizeProblem reorders it (and is not part of the setup time).
+    double checkpointTime = 0.0;
+    if (params.checkpointMode == CHECKPOINT_SAVE) {
+        checkpointTime = mytimer();
+        ierr = SaveProblemCheckpoint(params.checkpointDir, A, b, x, xexact);
+        if (ierr) {
+            cerr << "Error in call to SaveProblemCheckpoint: " << ierr
+                 << ".\n" << endl;
+        }
+        checkpointTime = mytimer() - checkpointTime;
+    }
+    // Multicolor reordering of all levels for the optimized SYMGS. This has to
+    // happen while the structures are still mapped in this task.
+    double t7 = mytimer();
+    ierr = OptimizeProblem(A, data, b, x, xexact, ctx, lrt);
+    if (ierr) {
+        cerr << "Error in call to OptimizeProblem: " << ierr << ".\n" << endl;
+    }
+    // Optional SELL-C-sigma layout for the vectorized SpMV and SYMGS.
+    if (params.sellSigma > 0) {
+        for (SparseMatrix *curLevelMatrix = &A; curLevelMatrix;
+             curLevelMatrix = curLevelMatrix->Ac) {
+            ierr = SetupSellMatrix(*curLevelMatrix, params.sellSigma, ctx, lrt);
+            if (ierr) {
+                cerr << "Error in call to SetupSellMatrix: " << ierr
+                     << ".\n" << endl;
+            }
+        }
+    }
+    // Optional matrix-free operator.
+    if (params.matrixFree) {
+        for (SparseMatrix *curLevelMatrix = &A; curLevelMatrix;
+             curLevelMatrix = curLevelMatrix->Ac) {
+            ierr = SetupStencilOperator(*curLevelMatrix, ctx, lrt);
+            if (ierr) {
+                cerr << "Error in call to SetupStencilOperator: " << ierr
+                     << ".\n" << endl;
+            }
+        }
+    }
+    // Structured halo packing on every level whose send lists are grid boxes
+    // (the others keep packing through their index lists).
+    int nStructuredHaloLevels = 0;
+    for (SparseMatrix *curLevelMatrix = &A; curLevelMatrix;
+         curLevelMatrix = curLevelMatrix->Ac) {
+        if (SetupStructuredHalo(*curLevelMatrix) == 0) ++nStructuredHaloLevels;
+    }
+    // Optional coarse-level agglomeration.
+    const int agglomeratedLevel = SetupAgglomeration(
+        A, params.agglomerateRows, params.coarseSweeps, ctx, lrt
+    );
+    t7 = mytimer() - t7;
+    times[7] = t7;
+    // Optional reduced-precision matrix copies for the mixed-precision MG
+    // comparison (not part of the optimization time).
+    if (params.mixedMG) {
+        for (SparseMatrix *curLevelMatrix = &A; curLevelMatrix;
+             curLevelMatrix = curLevelMatrix->Ac) {
+            ierr = SetupMixedPrecisionMG(*curLevelMatrix, ctx, lrt);
+            if (ierr) {
+                cerr << "Error in call to SetupMixedPrecisionMG: " << ierr
+                     << ".\n" << endl;
+            }
+        }
+    }
+    // Let the runtime memoize the solvers' repeated launch sequences.
+    A.isTraced = (params.trace != 0);
     //
     if (rank == 0) {
         bool taskingEnabled = false;
@@ -536,6 +677,53 @@ startBenchmarkTask(
              << endl;
         cout << "--> Total problem setup time in main (s) = "
              << setup_time << endl;
+        cout << "--> Problem checkpoint = "
+             << (params.checkpointMode == CHECKPOINT_SAVE
+                 ? "saved to " + string(params.checkpointDir) + " ("
+                   + to_string(checkpointTime) + " s)"
+                 : haloLoaded
+                 ? "loaded from " + string(params.checkpointDir)
+                 : string("none"))
+             << endl;
+        for (int level = 0; level < numberOfMgLevels; ++level) {
+            cout << "--> Halo setup time (level " << level << ") (s) = "
+                 << haloSetupTimes[level] << endl;
+        }
+        cout << "--> Number of threads per shard = "
+             << A.geom->data()->numThreads << endl;
+        cout << "--> Number of SYMGS colors (level 0) = "
+             << A.nColors << endl;
+        cout << "--> Matrix layout = "
+             << (A.stencil ? string("matrix-free 27-point stencil")
+                 : A.sell ? "SELL-C-sigma (C=" + to_string(LGNCG_SELL_C)
+                            + ", sigma=" + to_string(params.sellSigma) + ", "
+                            + GetSellSliceDot().name + " kernel)"
+                          : string("row-major"))
+             << endl;
+        cout << "--> Structured halo packing levels = "
+             << nStructuredHaloLevels << " of " << numberOfMgLevels << endl;
+        cout << "--> Agglomerated coarse level = "
+             << (agglomeratedLevel > 0
+                 ? to_string(agglomeratedLevel) + " ("
+                   + to_string(params.coarseSweeps) + " sweeps)"
+                 : params.agglomerateRows > 0
+                 ? string("none (requested, but no level qualified)")
+                 : string("none"))
+             << endl;
+        if (params.agglomerateRows > 0 && agglomeratedLevel == 0) {
+            const SparseMatrix *Ac = &A;
+            while (Ac->Ac) Ac = Ac->Ac;
+            const Geometry *const geom = Ac->geom->data();
+            cerr << "WARNING: --agglomerate-rows="
+                 << params.agglomerateRows << " was not applied: the "
+                 << "coarsest level has " << geom->gnx * geom->gny * geom->gnz
+                 << " global rows (" << geom->nx * geom->ny * geom->nz
+                 << " per shard), and at most "
+                 << LGNCG_MAX_AGGLOMERATED_ROWS << " can be gathered. "
+                 << "Running the full V-cycle." << endl;
+        }
+        cout << "--> Total problem optimization time (s) = "
+             << t7 << endl;
     }
 
     // Now unmap structures that are done using accessors.
@@ -552,13 +740,11 @@ startBenchmarkTask(
 
     // Sanity
     assert(getTaskID(task) == rank);
-    // Used to check return codes on function calls.
-    int ierr = 0;
     int numberOfCalls = 10;
     //QuickPath means we do on one call of each block of repetitive code.
     if (quickPath) numberOfCalls = 1;
     //
-    //const auto *const Asclrs = A.sclrs->data();
+    const auto *const Asclrs = A.sclrs->data();
 
     ////////////////////////////////////////////////////////////////////////////
     // Problem Sanity Phase
@@ -581,7 +767,35 @@ startBenchmarkTask(
         }
     }
 #endif
-    //
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Reference SpMV+MG Timing Phase                                         //
+    ////////////////////////////////////////////////////////////////////////////
+    // Call reference SpMV and MG. Compute optimization time as ratio of times
+    // in these routines. The CG work vectors p (with ghosts) and Ap are free at
+    // this point, so use them as x_overlap and b_computed.
+    {
+        SetOptimizedKernels(A, false);
+        Array<floatType> &x_overlap  = *data.p;
+        Array<floatType> &b_computed = *data.Ap;
+        // First load vector with random values.
+        FillRandomVector(x_overlap, ctx, lrt);
+        //
+        const double t_begin = mytimer();
+        for (int i = 0; i < numberOfCalls; ++i) {
+            // b_computed = A * x_overlap.
+            ierr = ComputeSPMV(A, x_overlap, b_computed, ctx, lrt);
+            if (ierr) cerr << "Error in call to SpMV: " << ierr << ".\n" << endl;
+            // x_overlap = Minv * b_computed.
+            ierr = ComputeMG(A, b_computed, x_overlap, ctx, lrt);
+            if (ierr) cerr << "Error in call to MG: " << ierr << ".\n" << endl;
+        }
+        // Wait for all the launched work before stopping the clock.
+        lrt->issue_execution_fence(ctx).get_void_result(silenceWarnings);
+        // Total time divided by number of calls.
+        times[8] = (mytimer() - t_begin) / double(numberOfCalls);
+    }
+
     ////////////////////////////////////////////////////////////////////////////
     // Reference CG Timing Phase                                              //
     ////////////////////////////////////////////////////////////////////////////
@@ -599,6 +813,8 @@ startBenchmarkTask(
     // Set tolerance to zero to make all runs do maxIters iterations.
     double tolerance = 0.0;
     int err_count = 0;
+    // The reference phase sweeps rows in their natural order.
+    SetOptimizedKernels(A, false);
     for (int i = 0; i < numberOfCalls; ++i) {
         ZeroVector(x, ctx, lrt);
         ierr = CG(A, data, b, x, refMaxIters, tolerance, niters,
@@ -611,7 +827,6 @@ startBenchmarkTask(
     if (rank == 0 && err_count) {
         cerr << err_count << " error(s) in call(s) to reference CG." << endl;
     }
-#if 0
     //
     double refTolerance = normr / normr0;
 
@@ -619,6 +834,12 @@ startBenchmarkTask(
     // Optimized CG Setup Phase                                               //
     ////////////////////////////////////////////////////////////////////////////
 
+    // From here on, use the multicolor SYMGS set up by OptimizeProblem (its
+    // cost was already captured in times[7]).
+    SetOptimizedKernels(A, true);
+    // Assume all is well: no failures.
+    int global_failure = 0;
+    //
     niters                 = 0;
     normr                  = 0.0;
     normr0                 = 0.0;
@@ -649,6 +870,8 @@ startBenchmarkTask(
         floatType current_time = opt_times[0] - last_cummulative_time;
         if (current_time > opt_worst_time) opt_worst_time = current_time;
     }
+    // Iterations CG needed to reach refTolerance.
+    const int cgNitersToRefTol = niters;
     //
     Future localOptWorstF = Future::from_value(lrt, opt_worst_time);
     opt_worst_time = allReduce(
@@ -659,12 +882,24 @@ startBenchmarkTask(
         cerr << err_count << " error(s) in call(s) to optimized CG." << endl;
     }
     if (tolerance_failures) {
+        global_failure = 1;
         if (rank == 0) {
             cerr << "Failed to reduce the residual "
                  << tolerance_failures << " times." << endl;
         }
     }
 
+    ////////////////////////////////////////////////////////////////////////////
+    // Validation Testing Phase                                               //
+    ////////////////////////////////////////////////////////////////////////////
+
+    TestCGData testCGData;
+    testCGData.count_pass = testCGData.count_fail = 0;
+    TestCG(A, data, b, x, testCGData, ctx, lrt);
+    //
+    TestSymmetryData testSymmetryData;
+    TestSymmetry(A, b, xexact, testSymmetryData, ctx, lrt);
+
     ////////////////////////////////////////////////////////////////////////////
     // Optimized CG Timing Phase                                              //
     ////////////////////////////////////////////////////////////////////////////
@@ -689,12 +924,22 @@ startBenchmarkTask(
     testnormsData.samples = numberOfCgSets;
     testnormsData.values = new double[numberOfCgSets];
 
+    // Only the timed phase goes into the kernel profile, so drain the
+    // validation work before starting the clock.
+    lrt->issue_execution_fence(ctx).get_void_result(silenceWarnings);
+    const Processor shardProc = lrt->get_executing_processor(ctx);
+    KernelProfiler::take(shardProc);
+    //
     const double optTimeStart = mytimer();
+    floatType cgScaledResidual = 0.0;
     for (int i = 0; i < numberOfCgSets; ++i) {
         // Zero out x.
         ZeroVector(x, ctx, lrt);
+        // The tolerance is zero, so the residual norm is only needed for
+        // reporting: let the iterations run ahead of the reductions.
         ierr = CG(A, data, b, x, optMaxIters, optTolerance, niters,
-                  normr, normr0, &times[0], doMG, ctx, lrt
+                  normr, normr0, &times[0], doMG, ctx, lrt,
+                  params.cgCheckFreq
                );
         if (ierr) {
             cerr << "Error in call to CG: " << ierr << ".\n" << endl;
@@ -705,7 +950,15 @@ startBenchmarkTask(
         }
         // Record scaled residual from this run.
         testnormsData.values[i] = normr / normr0;
+        cgScaledResidual = normr / normr0;
     }
+    // Wait for all the launched work before stopping the clock.
+    lrt->issue_execution_fence(ctx).get_void_result(silenceWarnings);
+    const double cgSetsTime = mytimer() - optTimeStart;
+    const KernelProfile kernelProfile = KernelProfiler::take(shardProc);
+    // Reported as the halo exchange time, but only packing the send buffers
+    // is timed (see ExchangeHalo).
+    times[6] = kernelProfile.time(KP_HALO);
     //
     if (rank == 0) {
         const double optTimeEnd = mytimer();
@@ -732,11 +985,182 @@ startBenchmarkTask(
         cout << "Difference between computed and exact = "
              << residual << ".\n" << endl;
     }
-#endif
-#if 0
     // Test Norm Results.
     ierr = TestNorms(testnormsData);
 
+    ////////////////////////////////////////////////////////////////////////////
+    // Pipelined CG Comparison Phase                                          //
+    ////////////////////////////////////////////////////////////////////////////
+    if (params.pipelinedCG) {
+        PipelinedCGData pdata;
+        pdata.allocate(A, ctx, lrt);
+        // Convergence: iterations to reach the reference residual reduction.
+        std::vector<double> pcg_times(9, 0.0);
+        ZeroVector(x, ctx, lrt);
+        ierr = PipelinedCG(A, data, pdata, b, x, optMaxIters, refTolerance,
+                           niters, normr, normr0, &pcg_times[0], doMG,
+                           ctx, lrt
+               );
+        if (ierr) {
+            cerr << "Error in call to PipelinedCG: " << ierr << ".\n" << endl;
+        }
+        const int pcgNitersToRefTol = niters;
+        // Time: same number of sets and iterations as the timed phase.
+        floatType pcgScaledResidual = 0.0;
+        lrt->issue_execution_fence(ctx).get_void_result(silenceWarnings);
+        const double pcgTimeStart = mytimer();
+        for (int i = 0; i < numberOfCgSets; ++i) {
+            ZeroVector(x, ctx, lrt);
+            ierr = PipelinedCG(A, data, pdata, b, x, optMaxIters, optTolerance,
+                               niters, normr, normr0, &pcg_times[0], doMG,
+                               ctx, lrt, params.cgCheckFreq
+                   );
+            if (ierr) {
+                cerr << "Error in call to PipelinedCG: "
+                     << ierr << ".\n" << endl;
+            }
+            pcgScaledResidual = normr / normr0;
+        }
+        lrt->issue_execution_fence(ctx).get_void_result(silenceWarnings);
+        const double pcgSetsTime = mytimer() - pcgTimeStart;
+        //
+        if (rank == 0) {
+            cout << "Pipelined CG iterations to reach " << refTolerance
+                 << ": " << pcgNitersToRefTol << " (CG: "
+                 << cgNitersToRefTol << ")" << endl;
+            cout << "Pipelined CG scaled residual after " << optMaxIters
+                 << " iterations: " << pcgScaledResidual << " (CG: "
+                 << cgScaledResidual << ")" << endl;
+            cout << "Pipelined CG average run time: "
+                 << pcgSetsTime / double(numberOfCgSets) << " s (CG: "
+                 << cgSetsTime / double(numberOfCgSets) << " s, saved "
+                 << 100.0 * (cgSetsTime - pcgSetsTime) / cgSetsTime
+                 << "%)" << endl;
+        }
+        //
+        pdata.deallocate(ctx, lrt);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // s-Step CG Comparison Phase                                             //
+    ////////////////////////////////////////////////////////////////////////////
+    if (params.sstepCG) {
+        SStepCGData sdata;
+        sdata.allocate(A, params.sstepCG, ctx, lrt);
+        //
+        const local_int_t nrow = Asclrs->localNumberOfRows;
+        std::vector<double> scg_times(9, 0.0);
+        double t4Unused = 0.0;
+        Future trueNormrFuture;
+        //
+        if (rank == 0) {
+            cout << "s-step CG is reduction-only: every SpMV still exchanges "
+                 << "its halo." << endl;
+        }
+        for (int s = 2; s <= params.sstepCG; ++s) {
+            // Stability: iterations to reach the reference residual reduction,
+            // and how far the recursive residual drifted from b - A * x.
+            ZeroVector(x, ctx, lrt);
+            const int breakdown = SStepCG(
+                A, data, sdata, s, b, x, optMaxIters, refTolerance,
+                niters, normr, normr0, &scg_times[0], doMG, ctx, lrt
+            );
+            const int scgNitersToRefTol = niters;
+            const floatType scgRecursiveResidual = normr / normr0;
+            //
+            CopyVector(x, *data.p, ctx, lrt);
+            ComputeSPMV(A, *data.p, *data.Ap, ctx, lrt);
+            ComputeWAXPBY(nrow, 1.0, b, -1.0, *data.Ap, *data.r, ctx, lrt);
+            ComputeDotProduct(
+                nrow, *data.r, *data.r, trueNormrFuture, t4Unused,
+                *A.dcAllRedSumFT, ctx, lrt
+            );
+            const floatType scgTrueResidual = sqrt(
+                trueNormrFuture.get_result<floatType>(silenceWarnings)
+            ) / normr0;
+            //
+            if (breakdown) {
+                if (rank == 0) {
+                    cout << "s-step CG (s = " << s << ") broke down after "
+                         << scgNitersToRefTol << " iterations, true scaled "
+                         << "residual: " << scgTrueResidual << endl;
+                }
+                continue;
+            }
+            // Time: same number of sets and iterations as the timed phase.
+            lrt->issue_execution_fence(ctx).get_void_result(silenceWarnings);
+            const double scgTimeStart = mytimer();
+            for (int i = 0; i < numberOfCgSets; ++i) {
+                ZeroVector(x, ctx, lrt);
+                ierr = SStepCG(A, data, sdata, s, b, x, optMaxIters,
+                               optTolerance, niters, normr, normr0,
+                               &scg_times[0], doMG, ctx, lrt
+                       );
+                if (ierr) {
+                    cerr << "Error in call to SStepCG: "
+                         << ierr << ".\n" << endl;
+                }
+            }
+            lrt->issue_execution_fence(ctx).get_void_result(silenceWarnings);
+            const double scgSetsTime = mytimer() - scgTimeStart;
+            //
+            if (rank == 0) {
+                cout << "s-step CG (s = " << s << ") iterations to reach "
+                     << refTolerance << ": " << scgNitersToRefTol << " (CG: "
+                     << cgNitersToRefTol << "), scaled residual recursive: "
+                     << scgRecursiveResidual << ", true: "
+                     << scgTrueResidual << endl;
+                cout << "s-step CG (s = " << s << ") average run time: "
+                     << scgSetsTime / double(numberOfCgSets) << " s (CG: "
+                     << cgSetsTime / double(numberOfCgSets) << " s, speedup "
+                     << cgSetsTime / scgSetsTime << ")" << endl;
+            }
+        }
+        //
+        sdata.deallocate(ctx, lrt);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Mixed-Precision MG Comparison Phase                                    //
+    ////////////////////////////////////////////////////////////////////////////
+    if (params.mixedMG) {
+        // Time to solution: solve to the reference residual reduction with
+        // the double and the mixed-precision preconditioner.
+        std::vector<double> mp_times(9, 0.0);
+        int nitersToRefTol[2] = {0, 0};
+        double solveTime[2] = {0.0, 0.0};
+        for (int mixed = 0; mixed < 2; ++mixed) {
+            SetMixedPrecisionMG(A, mixed == 1);
+            lrt->issue_execution_fence(ctx).get_void_result(silenceWarnings);
+            const double solveTimeStart = mytimer();
+            for (int i = 0; i < numberOfCalls; ++i) {
+                ZeroVector(x, ctx, lrt);
+                ierr = CG(A, data, b, x, optMaxIters, refTolerance, niters,
+                          normr, normr0, &mp_times[0], doMG, ctx, lrt
+                       );
+                if (ierr) {
+                    cerr << "Error in call to CG: " << ierr << ".\n" << endl;
+                }
+            }
+            lrt->issue_execution_fence(ctx).get_void_result(silenceWarnings);
+            solveTime[mixed] = (mytimer() - solveTimeStart)
+                             / double(numberOfCalls);
+            nitersToRefTol[mixed] = niters;
+        }
+        SetMixedPrecisionMG(A, false);
+        //
+        if (rank == 0) {
+            cout << "Mixed-precision MG iterations to reach " << refTolerance
+                 << ": " << nitersToRefTol[1] << " (double MG: "
+                 << nitersToRefTol[0] << ")" << endl;
+            cout << "Mixed-precision MG average time to solution: "
+                 << solveTime[1] << " s (double MG: " << solveTime[0]
+                 << " s, saved "
+                 << 100.0 * (solveTime[0] - solveTime[1]) / solveTime[0]
+                 << "%)" << endl;
+        }
+    }
+
     ////////////////////////////////////////////////////////////////////////////
     // Report Results                                                         //
     ////////////////////////////////////////////////////////////////////////////
@@ -748,6 +1172,7 @@ startBenchmarkTask(
         refMaxIters,
         optMaxIters,
         &times[0],
+        kernelProfile,
         testCGData,
         testSymmetryData,
         testnormsData,
@@ -756,7 +1181,8 @@ startBenchmarkTask(
         ctx,
         lrt
     );
-#endif
+    //
+    delete[] testnormsData.values;
     ////////////////////////////////////////////////////////////////////////////
     // Cleanup task-local strucutres allocated for solve.
     ////////////////////////////////////////////////////////////////////////////